@@ -10,6 +10,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "adaptive.h"
 
@@ -22,7 +23,37 @@
 #include "limits.h"
 #include "status.h"
 #include "mt.h"
+#include "mtcache.h"
 #include "paths.h"
+#include "tile.h"
+
+/*
+  the key for the metric tensor cache file, the hash of the
+  caller's key for the field data with everything else on
+  which the tensor depends
+*/
+
+static uint64_t mt_key(const vfp_context_t *ctx, const vfp_opt_t *opt,
+		       bbox_t bb, int nx, int ny)
+{
+  uint64_t h = MTCACHE_HASH_INIT;
+  uint64_t fk = opt->place.adaptive.mtfile.key;
+  double v[] = {
+    bb.x.min, bb.x.max, bb.y.min, bb.y.max,
+    opt->arrow.aspect,
+    ctx->margin.rate,
+    ctx->margin.major,
+    ctx->margin.minor,
+    ctx->margin.scale
+  };
+  int n[] = {nx, ny};
+
+  h = mtcache_hash(h, &fk, sizeof(fk));
+  h = mtcache_hash(h, v, sizeof(v));
+  h = mtcache_hash(h, n, sizeof(n));
+
+  return h;
+}
 
 extern int vfplot_adaptive(const domain_t *dom,
 			   vfun_t fv,
@@ -31,6 +62,32 @@ extern int vfplot_adaptive(const domain_t *dom,
 			   vfp_opt_t *opt,
                            size_t *nA, arrow_t **pA,
 			   size_t *nN, nbs_t **pN)
+{
+  vfp_context_t ctx;
+
+  vfplot_context_init(&ctx, fv, fc, field, opt->arrow.aspect);
+
+  /*
+    the dim2 iteration can take a while, so SIGINT schedules
+    a graceful halt; since the handler needs a file-scope
+    pointer to the context this is only done here, callers of
+    vfplot_adaptive_r() should arrange to halt it themselves
+  */
+
+  vfplot_context_sigint(&ctx);
+
+  int err = vfplot_adaptive_r(&ctx, dom, opt, nA, pA, nN, pN);
+
+  vfplot_context_sigint_restore();
+
+  return err;
+}
+
+extern int vfplot_adaptive_r(vfp_context_t *ctx,
+			     const domain_t *dom,
+			     vfp_opt_t *opt,
+			     size_t *nA, arrow_t **pA,
+			     size_t *nN, nbs_t **pN)
 {
   if (opt->verbose)  printf("adaptive placement\n");
 
@@ -39,8 +96,6 @@ extern int vfplot_adaptive(const domain_t *dom,
 
   int err;
 
-  evaluate_register(fv, fc, field, opt->arrow.aspect);
-
   if (opt->verbose)
     printf("scaling %.f, arrow margins %.2f pt, %.2f pt, rate %.2f\n",
 	   opt->page.scale,
@@ -48,10 +103,10 @@ extern int vfplot_adaptive(const domain_t *dom,
 	   opt->place.adaptive.margin.minor,
 	   opt->place.adaptive.margin.rate);
 
-  arrow_register(opt->place.adaptive.margin.rate,
-		 opt->place.adaptive.margin.major,
-		 opt->place.adaptive.margin.minor,
-		 opt->page.scale);
+  ctx->margin.rate  = opt->place.adaptive.margin.rate;
+  ctx->margin.major = opt->place.adaptive.margin.major;
+  ctx->margin.minor = opt->place.adaptive.margin.minor;
+  ctx->margin.scale = opt->page.scale;
 
   /* cache metric tensor */
 
@@ -72,19 +127,70 @@ extern int vfplot_adaptive(const domain_t *dom,
       ny = mtc;
     }
 
-  if (opt->verbose)
+  double mttol = opt->place.adaptive.mttol;
+  const char *mtfile = opt->place.adaptive.mtfile.file;
+  uint64_t mtkey = 0;
+
+  err = ERROR_NODATA;
+
+  if (mtfile)
     {
-      printf("caching %i x %i metric tensor ..", nx, ny);
-      fflush(stdout);
+      mtkey = mt_key(ctx, opt, bb, nx, ny);
+
+      switch (err = mtcache_read(mtfile, mtkey, bb, nx, ny, &mt))
+	{
+	case ERROR_OK:
+	  if (opt->verbose)
+	    printf("read %i x %i metric tensor from %s\n", nx, ny, mtfile);
+	  break;
+	case ERROR_NODATA:
+	  if (opt->verbose)
+	    printf("no matching metric tensor in %s\n", mtfile);
+	  break;
+	default:
+	  fprintf(stderr, "failed read of %s\n", mtfile);
+	  return err;
+	}
     }
 
-  if ((err = metric_tensor_new(bb, nx, ny, &mt)) != ERROR_OK)
+  if (err == ERROR_NODATA)
     {
-      fprintf(stderr, "failed metric tensor generation\n");
-      return err;
-    }
+      if (opt->verbose)
+	{
+	  printf("caching %i x %i %smetric tensor ..",
+		 nx, ny, (mttol > 0 ? "adaptive " : ""));
+	  fflush(stdout);
+	}
+
+      if (mttol > 0)
+	err = metric_tensor_new_adaptive(ctx, bb, nx, ny, opt->threads, mttol, &mt);
+      else
+	err = metric_tensor_new(ctx, bb, nx, ny, opt->threads, &mt);
+
+      if (err != ERROR_OK)
+	{
+	  fprintf(stderr, "failed metric tensor generation\n");
+	  return err;
+	}
 
-  if (opt->verbose) printf(". done\n");
+      if (opt->verbose)
+	{
+	  printf(". done\n");
+	  if (mttol > 0) status("cells", metric_tensor_cells(mt));
+	}
+
+      if (mtfile)
+	{
+	  if ((err = mtcache_write(mtfile, mtkey, mt)) != ERROR_OK)
+	    {
+	      fprintf(stderr, "failed write of %s\n", mtfile);
+	      return err;
+	    }
+
+	  if (opt->verbose)
+	    printf("wrote metric tensor to %s\n", mtfile);
+	}
+    }
 
 #ifdef MT_AREA_DATA
 
@@ -94,10 +200,37 @@ extern int vfplot_adaptive(const domain_t *dom,
     (there are no NaNs)
   */
 
-  bilinear_write("mt.a.dat", mt.a);
-  bilinear_write("mt.b.dat", mt.b);
-  bilinear_write("mt.c.dat", mt.c);
-  bilinear_write("mt.area.dat", mt.area);
+  if (! mt.qtree)
+    {
+      const char *name[MT_GRID_STRIDE] =
+	{"mt.a.dat", "mt.b.dat", "mt.c.dat", "mt.area.dat"};
+      const mt_grid_t *G = &(mt.grid);
+
+      for (int k = 0 ; k < MT_GRID_STRIDE ; k++)
+	{
+	  FILE *st;
+
+	  if ((st = fopen(name[k], "w")) == NULL) continue;
+
+	  for (int i = 0 ; i < G->nx ; i++)
+	    {
+	      for (int j = 0 ; j < G->ny ; j++)
+		{
+		  const double *z =
+		    G->v + ((size_t)j*G->nx + i)*MT_GRID_STRIDE;
+
+		  if (isnan(z[0])) continue;
+
+		  fprintf(st, "%g %g %g\n",
+			  (i*bb.x.max + (G->nx-1-i)*bb.x.min)/(G->nx-1),
+			  (j*bb.y.max + (G->ny-1-j)*bb.y.min)/(G->ny-1),
+			  z[k]);
+		}
+	    }
+
+	  fclose(st);
+	}
+    }
 
 #endif
 
@@ -109,7 +242,7 @@ extern int vfplot_adaptive(const domain_t *dom,
 
   double eI, bbA = bbox_volume(opt->bbox);
 
-  if ((err = bilinear_integrate(opt->bbox, mt.area, &eI)) != ERROR_OK)
+  if ((err = metric_tensor_integrate_area(mt, &eI)) != ERROR_OK)
     {
       fprintf(stderr, "failed to find mean area\n");
       return err;
@@ -135,9 +268,9 @@ extern int vfplot_adaptive(const domain_t *dom,
   /* coverity[suspicious_sizeof : FALSE] */
 
   gstack_t *paths = gstack_new(sizeof(gstack_t*), 10, 10);
-  dim0_opt_t d0opt = {*opt, paths, me, mt};
+  dim0_opt_t d0opt = {*opt, paths, me, mt, ctx};
 
-  if ((err = domain_iterate(dom, (difun_t)dim0,  &d0opt)) != ERROR_OK)
+  if ((err = dim0(dom, &d0opt)) != ERROR_OK)
     {
       fprintf(stderr, "failed generation at dimension zero\n");
       return err;
@@ -159,7 +292,7 @@ extern int vfplot_adaptive(const domain_t *dom,
 
   if (! opt->place.adaptive.decimate.late)
     {
-      if ((err = paths_decimate(paths, dcd)) != ERROR_OK)
+      if ((err = paths_decimate(paths, &(ctx->margin), dcd)) != ERROR_OK)
 	{
 	  fprintf(stderr, "failed early decimation\n");
 	  return err;
@@ -176,7 +309,7 @@ extern int vfplot_adaptive(const domain_t *dom,
 
   /* dim 1 */
 
-  dim1_opt_t d1opt = {mt};
+  dim1_opt_t d1opt = {mt, ctx, opt->threads};
 
   if (opt->verbose) printf("dimension one\n");
 
@@ -198,7 +331,7 @@ extern int vfplot_adaptive(const domain_t *dom,
 
   if (opt->place.adaptive.decimate.late)
     {
-      if ((err = paths_decimate(paths, dcd)) != ERROR_OK)
+      if ((err = paths_decimate(paths, &(ctx->margin), dcd)) != ERROR_OK)
 	{
 	  fprintf(stderr, "failed late decimation\n");
 	  return err;
@@ -213,6 +346,23 @@ extern int vfplot_adaptive(const domain_t *dom,
 	}
     }
 
+  /*
+     decimation between paths, for glyphs on neighbouring
+     boundaries which would otherwise overlap (those are
+     fixed in the dynamics)
+  */
+
+  if (opt->place.adaptive.decimate.inter)
+    {
+      if ((err = paths_decimate_inter(paths, &(ctx->margin), dcd)) != ERROR_OK)
+	{
+	  fprintf(stderr, "failed inter-path decimation\n");
+	  return err;
+	}
+
+      if (opt->verbose) status("separated", paths_count(paths));
+    }
+
   /* convert path to array of arrows */
 
   if ((err = paths_serialise(paths, nA, pA)) != ERROR_OK)
@@ -225,9 +375,28 @@ extern int vfplot_adaptive(const domain_t *dom,
 
   if (opt->verbose) printf("dimension two\n");
 
-  dim2_opt_t d2opt = {*opt, me, dom, mt};
+  dindex_t *dix;
+
+  if ((dix = dindex_new(dom)) == NULL)
+    {
+      fprintf(stderr, "failed to index domain\n");
+      return ERROR_MALLOC;
+    }
+
+  dim2_opt_t d2opt = {*opt, me, dom, dix, mt, ctx, NULL};
+
+  int
+    tx = opt->place.adaptive.tiles.x,
+    ty = opt->place.adaptive.tiles.y;
+
+  if ((tx > 0) && (ty > 0) && (tx*ty > 1))
+    err = dim2_tiled(&d2opt, tx, ty, nA, pA, nN, pN);
+  else
+    err = dim2(&d2opt, nA, pA, nN, pN);
+
+  dindex_destroy(dix);
 
-  if ((err = dim2(&d2opt,  nA,  pA,  nN,  pN)) != ERROR_OK)
+  if (err != ERROR_OK)
     {
       fprintf(stderr, "failed at dimension two\n");
       return err;
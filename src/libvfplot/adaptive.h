@@ -9,6 +9,7 @@
 
 #include "vfplot.h"
 #include "dim2.h"
+#include "context.h"
 
 extern int vfplot_adaptive(const domain_t*,
 			   vfun_t,
@@ -18,4 +19,10 @@ extern int vfplot_adaptive(const domain_t*,
 			   size_t*, arrow_t**,
 			   size_t*, nbs_t**);
 
+extern int vfplot_adaptive_r(vfp_context_t*,
+			     const domain_t*,
+			     vfp_opt_t*,
+			     size_t*, arrow_t**,
+			     size_t*, nbs_t**);
+
 #endif
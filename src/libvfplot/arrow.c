@@ -19,14 +19,20 @@
 #include "sincos.h"
 
 
-static double M, bmaj, bmin, scale;
+/*
+  the registered margin, used by arrow_ellipse(); callers
+  which need to be reentrant should use their own margin
+  and arrow_ellipse_r() instead
+*/
+
+static arrow_margin_t registered = {0.0, 0.0, 0.0, 1.0};
 
 extern void arrow_register(double M0, double bmaj0, double bmin0, double scale0)
 {
-  M     = M0;
-  bmaj  = bmaj0;
-  bmin  = bmin0;
-  scale = scale0;
+  registered.rate  = M0;
+  registered.major = bmaj0;
+  registered.minor = bmin0;
+  registered.scale = scale0;
 }
 
 /*
@@ -38,10 +44,17 @@ static void arrow_proximal_ellipse(const arrow_t*, ellipse_t*);
 
 extern void arrow_ellipse(const arrow_t* A, ellipse_t* E)
 {
+  arrow_ellipse_r(&registered, A, E);
+}
+
+extern void arrow_ellipse_r(const arrow_margin_t* m, const arrow_t* A, ellipse_t* E)
+{
+  double scale = m->scale;
+
   arrow_proximal_ellipse(A, E);
 
-  E->major += margin((E->major)*scale, bmaj, M)/scale;
-  E->minor += margin((E->minor)*scale, bmin, M)/scale;
+  E->major += margin((E->major)*scale, m->major, m->rate)/scale;
+  E->minor += margin((E->minor)*scale, m->minor, m->rate)/scale;
 }
 
 static void arrow_proximal_ellipse(const arrow_t* a, ellipse_t* pe)
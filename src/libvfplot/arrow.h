@@ -28,9 +28,21 @@ typedef struct
   double theta, length, width, curv;
 } arrow_t;
 
+/*
+  the margin added to the proximal ellipse of an arrow,
+  see margin.h for the meaning of the rate, major and
+  minor values; the scale is that of the page.
+*/
+
+typedef struct
+{
+  double rate, major, minor, scale;
+} arrow_margin_t;
+
 extern void arrow_register(double, double, double, double);
 
 extern void arrow_ellipse(const arrow_t*, ellipse_t*);
+extern void arrow_ellipse_r(const arrow_margin_t*, const arrow_t*, ellipse_t*);
 
 extern arrow_t arrow_translate(arrow_t, vector_t);
 extern arrow_t arrow_rotate(arrow_t, double);
@@ -46,3 +46,9 @@ extern double bbox_volume(bbox_t b)
 {
   return bbox_height(b) * bbox_width(b);
 }
+
+extern int bbox_contains(bbox_t b, vector_t v)
+{
+  return ((v.x >= b.x.min) && (v.x <= b.x.max) &&
+	  (v.y >= b.y.min) && (v.y <= b.y.max));
+}
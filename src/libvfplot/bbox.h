@@ -7,6 +7,8 @@
 #ifndef BBOX_H
 #define BBOX_H
 
+#include "vector.h"
+
 typedef struct {
   struct {
     double min, max;
@@ -22,5 +24,6 @@ extern int bbox_intersect(bbox_t, bbox_t);
 extern double bbox_width(bbox_t);
 extern double bbox_height(bbox_t);
 extern double bbox_volume(bbox_t);
+extern int bbox_contains(bbox_t, vector_t);
 
 #endif
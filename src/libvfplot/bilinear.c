@@ -11,6 +11,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <math.h>
 
 #include "bilinear.h"
@@ -21,19 +22,87 @@
 #include "garray.h"
 #include "gstack.h"
 #include "macros.h"
+#include "parallel.h"
 
 typedef struct
 {
   int x, y;
 } dim2_t;
 
+/*
+  the optional compiled form (see bilinear_compile) holds,
+  for each cell, the coefficients c of the interpolant
+
+    z = c[0] + c[1]X + c[2]Y + c[3]XY
+
+  in the local coordinates X, Y of the cell, and the nodata
+  case of the cell, a mask with a bit set for each of the
+  corners z00, z10, z01, z11 which is nodata.  For cells with
+  any nodata corners c[3] is set to NaN so that the mask need
+  only be consulted for them, the interior cells then take a
+  single memory access.  We also hold the reciprocal of the
+  cell sizes.
+*/
+
+typedef struct
+{
+  double c[4];
+} cell_coef_t;
+
+#define CELL_Z00 1
+#define CELL_Z10 2
+#define CELL_Z01 4
+#define CELL_Z11 8
+
+/*
+  the values are stored either row-major or, after a call
+  to bilinear_tile(), in square tiles each covering 2^tile
+  by 2^tile cells, so (2^tile + 1)^2 nodes, stored row-major,
+  the tiles themselves in row-major order with ntx tiles per
+  row of them.  Adjacent tiles overlap by a row (or column)
+  of nodes, so that the four corners of every cell are in
+  the same small block of memory, rather than in rows which
+  may be far apart for large grids, at the cost of holding
+  the nodes on the tile edges twice (or four times).  All
+  reads of the values are via pid() and all writes via nset()
+  which writes each of the copies of the node.  The tile size
+  BILINEAR_TILE is in bilinear.h.
+*/
+
+/*
+  the values may be stored in reduced precision (see
+  bilinear_store), as floats or as 16-bit integers q
+  representing qo + qs*q, with the smallest integer for
+  nodata; the interpolation is still in double precision
+*/
+
+#define QUANT_NODATA INT16_MIN
+#define QUANT_MAX    INT16_MAX
+
 struct bilinear_t
 {
   dim2_t n;
   bbox_t bb;
-  double *v;
+  void *v;
+  bilinear_store_t store;
+  double qs, qo;
+  int tile, ntx;
+  cell_coef_t *coef;
+  unsigned char *mask;
+  double rdx, rdy;
 };
 
+/* discard the compiled form, called when the values change */
+
+static void bilinear_decompile(bilinear_t *B)
+{
+  free(B->coef);
+  free(B->mask);
+
+  B->coef = NULL;
+  B->mask = NULL;
+}
+
 extern bilinear_t* bilinear_new(void)
 {
   bilinear_t* B = malloc(sizeof(bilinear_t));
@@ -42,7 +111,14 @@ extern bilinear_t* bilinear_new(void)
 
   B->n.x  = 0;
   B->n.y  = 0;
-  B->v    = NULL;
+  B->v     = NULL;
+  B->store = bilinear_double;
+  B->qs    = 1.0;
+  B->qo    = 0.0;
+  B->tile  = 0;
+  B->ntx  = 0;
+  B->coef = NULL;
+  B->mask = NULL;
 
   return B;
 }
@@ -62,10 +138,17 @@ extern int bilinear_dimension(int nx, int ny, bbox_t bb, bilinear_t *B)
   for (size_t i = 0 ; i < nx*ny ; i++)
     v[i] = NAN;
 
+  bilinear_decompile(B);
+
   B->n.x  = nx;
   B->n.y  = ny;
   B->bb   = bb;
-  B->v    = v;
+  B->v     = v;
+  B->store = bilinear_double;
+  B->qs    = 1.0;
+  B->qo    = 0.0;
+  B->tile  = 0;
+  B->ntx  = 0;
 
   return ERROR_OK;
 }
@@ -87,17 +170,279 @@ extern void bilinear_getxy(int i, int j, bilinear_t* B, double* x, double* y)
   *y = (j*bb.y.max + (n.y-1-j)*bb.y.min)/(n.y - 1);
 }
 
-#define PID(i, j, n) ((j)*((n).x) + (i))
 #define MID(i, j, n) ((j)*((n).x-1) + (i))
 
-extern void bilinear_setz(int i, int j, double z, bilinear_t *B)
+/*
+  the side of a tile in nodes, the number of tiles needed
+  to cover m nodes (so m - 1 cells), and the tile holding
+  the node i (the last if the node is on the edge of it)
+*/
+
+#define TSIDE(t) ((1 << (t)) + 1)
+
+static inline int tcover(int m, int t)
 {
-  dim2_t n  = B->n;
-  double* v = B->v;
+  return ((m - 1) + (1 << t) - 1) >> t;
+}
+
+static inline int tnode(int i, int t, int nt)
+{
+  return MIN(i >> t, nt - 1);
+}
+
+/* the index in v of the node (i, j) */
+
+static inline size_t pid(const bilinear_t *B, int i, int j)
+{
+  if (B->tile == 0)
+    return (size_t)j*B->n.x + i;
+
+  int
+    t  = B->tile,
+    s  = TSIDE(t),
+    tx = tnode(i, t, B->ntx),
+    ty = tnode(j, t, tcover(B->n.y, t));
+
+  return
+    ((size_t)ty*B->ntx + tx)*s*s +
+    (size_t)(j - (ty << t))*s + (i - (tx << t));
+}
+
+#define PID(i, j, B) pid(B, i, j)
+
+/*
+  the index in v of the node (i, j) as the first corner of
+  the cell (i, j), so in the tile holding that cell
+*/
+
+static inline size_t cid(const bilinear_t *B, int i, int j)
+{
+  if (B->tile == 0)
+    return (size_t)j*B->n.x + i;
+
+  int
+    t = B->tile,
+    s = TSIDE(t),
+    m = (1 << t) - 1;
+
+  return
+    ((size_t)(j >> t)*B->ntx + (i >> t))*s*s +
+    (size_t)(j & m)*s + (i & m);
+}
 
+/* the number of values in v, including any padding */
+
+static size_t nvalues(const bilinear_t *B)
+{
+  if (B->tile == 0)
+    return (size_t)B->n.x*B->n.y;
+
+  int
+    t = B->tile,
+    s = TSIDE(t);
+
+  return (size_t)B->ntx*tcover(B->n.y, t)*s*s;
+}
+
+/* the value at index k in v, and setting it */
+
+static size_t store_size(bilinear_store_t store)
+{
+  switch (store)
+    {
+    case bilinear_float: return sizeof(float);
+    case bilinear_int16: return sizeof(int16_t);
+    default: return sizeof(double);
+    }
+}
+
+static inline double vget(const bilinear_t *B, size_t k)
+{
+  switch (B->store)
+    {
+    case bilinear_double:
+      return ((const double*)B->v)[k];
+
+    case bilinear_float:
+      return ((const float*)B->v)[k];
+
+    default:
+      {
+	int16_t q = ((const int16_t*)B->v)[k];
+
+	return (q == QUANT_NODATA ? NAN : B->qo + B->qs*q);
+      }
+    }
+}
+
+/* values outside the range of the quantisation are clamped */
+
+static inline void vset(bilinear_t *B, size_t k, double z)
+{
+  switch (B->store)
+    {
+    case bilinear_double:
+      ((double*)B->v)[k] = z;
+      break;
+
+    case bilinear_float:
+      ((float*)B->v)[k] = z;
+      break;
+
+    default:
+      {
+	int16_t q = QUANT_NODATA;
+
+	if (! isnan(z))
+	  {
+	    double r = (B->qs != 0 ? round((z - B->qo)/B->qs) : 0);
+
+	    q = MAX(-QUANT_MAX, MIN(QUANT_MAX, r));
+	  }
+
+	((int16_t*)B->v)[k] = q;
+      }
+    }
+}
+
+/*
+  set the node (i, j), when tiled a node on the edge of a
+  tile is also held by its neighbours (see above)
+*/
+
+static void nset(bilinear_t *B, int i, int j, double z)
+{
+  if (B->tile == 0)
+    {
+      vset(B, PID(i, j, B), z);
+      return;
+    }
+
+  int
+    t   = B->tile,
+    s   = TSIDE(t),
+    m   = (1 << t) - 1,
+    ntx = B->ntx,
+    nty = tcover(B->n.y, t),
+    tx1 = tnode(i, t, ntx),
+    ty1 = tnode(j, t, nty),
+    tx0 = (((i & m) == 0) && (i > 0) ? (i >> t) - 1 : tx1),
+    ty0 = (((j & m) == 0) && (j > 0) ? (j >> t) - 1 : ty1);
+
+  for (int ty = ty0 ; ty <= ty1 ; ty++)
+    for (int tx = tx0 ; tx <= tx1 ; tx++)
+      vset(B,
+	   ((size_t)ty*ntx + tx)*s*s +
+	   (size_t)(j - (ty << t))*s + (i - (tx << t)),
+	   z);
+}
+
+extern void bilinear_setz(int i, int j, double z, bilinear_t *B)
+{
   if (isnan(z)) return;
 
-  v[PID(i, j, n)] = z;
+  if (B->coef) bilinear_decompile(B);
+
+  nset(B, i, j, z);
+}
+
+/*
+  change the storage of the values, we can only change to
+  int16 once the values are set since they determine the
+  scale and offset of the quantisation, which uses the full
+  range of the integers on the range of the values
+*/
+
+extern int bilinear_store(bilinear_t *B, bilinear_store_t store)
+{
+  if (store == B->store) return ERROR_OK;
+
+  bilinear_decompile(B);
+
+  size_t nv = nvalues(B);
+  void *v;
+
+  if ((v = malloc(nv*store_size(store))) == NULL)
+    return ERROR_MALLOC;
+
+  bilinear_t B0 = *B;
+
+  B->v     = v;
+  B->store = store;
+
+  if (store == bilinear_int16)
+    {
+      double zmin = INFINITY, zmax = -INFINITY;
+
+      for (size_t k = 0 ; k < nv ; k++)
+	{
+	  double z = vget(&B0, k);
+
+	  if (isnan(z)) continue;
+
+	  zmin = MIN(zmin, z);
+	  zmax = MAX(zmax, z);
+	}
+
+      if (zmin > zmax)
+	{
+	  B->qo = 0.0;
+	  B->qs = 1.0;
+	}
+      else
+	{
+	  B->qo = (zmax + zmin)/2;
+	  B->qs = (zmax - zmin)/(2*QUANT_MAX);
+	}
+    }
+
+  for (size_t k = 0 ; k < nv ; k++)
+    vset(B, k, vget(&B0, k));
+
+  free(B0.v);
+
+  return ERROR_OK;
+}
+
+/*
+  change the storage of the values to tiles (see above), this
+  is transparent to the other functions.  The tiles are padded
+  to cover the grid and overlap, so this takes a little more
+  memory, around 13% for the default tile size
+*/
+
+extern int bilinear_tile(bilinear_t *B)
+{
+  if (B->tile != 0) return ERROR_OK;
+
+  dim2_t n = B->n;
+  int
+    t = BILINEAR_TILE,
+    s = TSIDE(t),
+    ntx = tcover(n.x, t),
+    nty = tcover(n.y, t);
+  size_t nv = (size_t)ntx*nty*s*s;
+  void *v;
+
+  if ((v = malloc(nv*store_size(B->store))) == NULL)
+    return ERROR_MALLOC;
+
+  bilinear_t T0 = *B;
+
+  B->v    = v;
+  B->tile = t;
+  B->ntx  = ntx;
+
+  for (size_t k = 0 ; k < nv ; k++)
+    vset(B, k, NAN);
+
+  for (int j = 0 ; j < n.y ; j++)
+    for (int i = 0 ; i < n.x ; i++)
+      nset(B, i, j, vget(&T0, PID(i, j, &T0)));
+
+  free(T0.v);
+
+  return ERROR_OK;
 }
 
 extern bbox_t bilinear_bbox(bilinear_t* B)
@@ -125,7 +470,7 @@ extern int bilinear_write(const char *name, bilinear_t *B)
     {
       for (j=0 ; j<n.y ; j++)
 	{
-	  double z = B->v[PID(i, j, n)];
+	  double z = vget(B, PID(i, j, B));
 
 	  if (isnan(z)) continue;
 
@@ -143,13 +488,19 @@ extern int bilinear_write(const char *name, bilinear_t *B)
 
 extern void bilinear_scale(bilinear_t* B, double M)
 {
-  int i, j;
-  dim2_t  n = B->n;
-  double* v = B->v;
+  bilinear_decompile(B);
 
-  for (i=0 ; i<n.x ; i++)
-    for (j=0 ; j<n.y ; j++)
-      v[PID(i, j, n)] *= M;
+  if (B->store == bilinear_int16)
+    {
+      B->qs *= M;
+      B->qo *= M;
+      return;
+    }
+
+  size_t nv = nvalues(B);
+
+  for (size_t k = 0 ; k < nv ; k++)
+    vset(B, k, vget(B, k)*M);
 }
 
 extern int bilinear_sample(sfun_t f, void* arg, bilinear_t *B)
@@ -157,7 +508,8 @@ extern int bilinear_sample(sfun_t f, void* arg, bilinear_t *B)
   int i;
   dim2_t n  = B->n;
   bbox_t bb = B->bb;
-  double* v = B->v;
+
+  bilinear_decompile(B);
 
   for (i=0 ; i<n.x ; i++)
     {
@@ -172,7 +524,7 @@ extern int bilinear_sample(sfun_t f, void* arg, bilinear_t *B)
 	  switch (f(x, y, arg, &z))
 	    {
 	    case ERROR_OK:
-	      v[PID(i, j, n)] = z;
+	      nset(B, i, j, z);
 	      break;
 
 	    case ERROR_NODATA:
@@ -221,27 +573,215 @@ static void bilinear_get_ijXY(double x, double y, bilinear_t *B,
   *Y = yn - *j;
 }
 
-static double zij(int i, int j, double *v, dim2_t n)
+static double zij(int i, int j, const bilinear_t *B)
 {
+  dim2_t n = B->n;
+
   if ((i>=0) && (i<n.x) && (j>=0) && (j<n.y))
-    return v[PID(i, j, n)];
+    return vget(B, PID(i, j, B));
   else
     return NAN;
 }
 
-extern int bilinear(double x, double y, bilinear_t *B, double *z)
+/*
+  compile the interpolant, precomputing the coefficients and
+  nodata case of each cell so that bilinear() need not fetch
+  and classify the corner values on each call. This takes
+  about four times the memory of the grid values, and is
+  discarded if they are subsequently modified (so should be
+  called after the grid is complete)
+*/
+
+extern int bilinear_compile(bilinear_t *B)
 {
   dim2_t n  = B->n;
-  double* v = B->v;
+  size_t nc = (size_t)(n.x-1)*(n.y-1);
+
+  bilinear_decompile(B);
+
+  if ((B->coef = malloc(nc*sizeof(cell_coef_t))) == NULL)
+    return ERROR_MALLOC;
+
+  if ((B->mask = malloc(nc)) == NULL)
+    {
+      bilinear_decompile(B);
+      return ERROR_MALLOC;
+    }
+
+  B->rdx = (n.x - 1)/bbox_width(B->bb);
+  B->rdy = (n.y - 1)/bbox_height(B->bb);
+
+  for (int j = 0 ; j < n.y-1 ; j++)
+    {
+      for (int i = 0 ; i < n.x-1 ; i++)
+	{
+	  double
+	    z00 = zij(i, j, B),
+	    z10 = zij(i+1, j, B),
+	    z01 = zij(i, j+1, B),
+	    z11 = zij(i+1, j+1, B);
+	  unsigned char m =
+	    (isnan(z00) ? CELL_Z00 : 0) |
+	    (isnan(z10) ? CELL_Z10 : 0) |
+	    (isnan(z01) ? CELL_Z01 : 0) |
+	    (isnan(z11) ? CELL_Z11 : 0);
+	  double *c = B->coef[MID(i, j, n)].c;
+
+	  /* the 3-point cases are linear, as in bilinear() */
+
+	  switch (m)
+	    {
+	    case 0:
+	      c[0] = z00;
+	      c[1] = z10 - z00;
+	      c[2] = z01 - z00;
+	      c[3] = z11 - z10 - z01 + z00;
+	      break;
+	    case CELL_Z11:
+	      c[0] = z00;
+	      c[1] = z10 - z00;
+	      c[2] = z01 - z00;
+	      c[3] = NAN;
+	      break;
+	    case CELL_Z01:
+	      c[0] = z00;
+	      c[1] = z10 - z00;
+	      c[2] = z11 - z10;
+	      c[3] = NAN;
+	      break;
+	    case CELL_Z10:
+	      c[0] = z00;
+	      c[1] = z11 - z01;
+	      c[2] = z01 - z00;
+	      c[3] = NAN;
+	      break;
+	    case CELL_Z00:
+	      c[0] = z10 + z01 - z11;
+	      c[1] = z11 - z01;
+	      c[2] = z11 - z10;
+	      c[3] = NAN;
+	      break;
+	    default:
+	      c[0] = c[1] = c[2] = c[3] = NAN;
+	    }
+
+	  B->mask[MID(i, j, n)] = m;
+	}
+    }
+
+  return ERROR_OK;
+}
+
+/* evaluate the compiled interpolant at X, Y in cell i, j */
+
+static int cell_eval(const bilinear_t *B, int i, int j,
+		     double X, double Y, double *z)
+{
+  dim2_t n = B->n;
+
+  if ((i < 0) || (i >= n.x-1) || (j < 0) || (j >= n.y-1))
+    return ERROR_NODATA;
+
+  size_t k = MID(i, j, n);
+  const double *c = B->coef[k].c;
+
+  if (! isnan(c[3]))
+    {
+      *z = c[0] + c[2]*Y + X*(c[1] + c[3]*Y);
+      return ERROR_OK;
+    }
+
+  switch (B->mask[k])
+    {
+    case CELL_Z11:
+      if (X+Y < 1) break;
+      return ERROR_NODATA;
+    case CELL_Z01:
+      if (X > Y) break;
+      return ERROR_NODATA;
+    case CELL_Z10:
+      if (X < Y) break;
+      return ERROR_NODATA;
+    case CELL_Z00:
+      if (X+Y > 1) break;
+      return ERROR_NODATA;
+    default:
+      return ERROR_NODATA;
+    }
+
+  *z = c[0] + c[2]*Y + c[1]*X;
+
+  return ERROR_OK;
+}
+
+static int bilinear_compiled(double x, double y, bilinear_t *B, double *z)
+{
+  double
+    xn = (x - B->bb.x.min)*B->rdx,
+    yn = (y - B->bb.y.min)*B->rdy;
+  int
+    i = (int)floor(xn),
+    j = (int)floor(yn);
+
+  return cell_eval(B, i, j, xn - i, yn - j, z);
+}
+
+/*
+  the values at the corners of cell (i, j), NaN for those
+  outside the grid.  For cells inside the grid we find the
+  index of the first corner and step to the others, since
+  the tiles overlap the corners are always in the one tile
+*/
+
+static void cell_corners(const bilinear_t *B, int i, int j,
+			 double *z00, double *z10,
+			 double *z01, double *z11)
+{
+  dim2_t n = B->n;
+
+  if ((i >= 0) && (i < n.x-1) && (j >= 0) && (j < n.y-1))
+    {
+      size_t
+	k  = cid(B, i, j),
+	dy = (B->tile ? TSIDE(B->tile) : n.x);
+
+      if (B->store == bilinear_double)
+	{
+	  const double *v = (const double*)B->v + k;
+
+	  *z00 = v[0];
+	  *z10 = v[1];
+	  *z01 = v[dy];
+	  *z11 = v[dy+1];
+	}
+      else
+	{
+	  *z00 = vget(B, k);
+	  *z10 = vget(B, k+1);
+	  *z01 = vget(B, k+dy);
+	  *z11 = vget(B, k+dy+1);
+	}
+
+      return;
+    }
+
+  *z00 = zij(i, j, B);
+  *z10 = zij(i+1, j, B);
+  *z01 = zij(i, j+1, B);
+  *z11 = zij(i+1, j+1, B);
+}
+
+extern int bilinear(double x, double y, bilinear_t *B, double *z)
+{
+  if (B->coef) return bilinear_compiled(x, y, B, z);
+
   int i, j; double X, Y;
 
   bilinear_get_ijXY(x, y, B, &i, &j, &X, &Y);
 
-  double
-    z00 = zij(i, j, v, n),
-    z10 = zij(i+1, j, v, n),
-    z01 = zij(i, j+1, v, n),
-    z11 = zij(i+1, j+1, v, n);
+  double z00, z10, z01, z11;
+
+  cell_corners(B, i, j, &z00, &z10, &z01, &z11);
 
   int err = ERROR_NODATA;
 
@@ -311,6 +851,108 @@ extern int bilinear(double x, double y, bilinear_t *B, double *z)
   return err;
 }
 
+/*
+  interpolate at the n points (x[k], y[k]) into z[k], which
+  is NaN if there is no data at the point. For a compiled
+  grid the points are taken in blocks, the local coordinates
+  of a block are found in a branch-free loop which the
+  compiler can vectorise, then the cells evaluated. The
+  results are the same as those of bilinear()
+*/
+
+#define BATCH_BLOCK 64
+
+static void bilinear_batch_compiled(size_t n, const double *x,
+				    const double *y, bilinear_t *B,
+				    double *z)
+{
+  double
+    x0 = B->bb.x.min, rdx = B->rdx,
+    y0 = B->bb.y.min, rdy = B->rdy;
+
+  for (size_t k0 = 0 ; k0 < n ; k0 += BATCH_BLOCK)
+    {
+      size_t nb = MIN(BATCH_BLOCK, n - k0);
+      const double
+	*xb = x + k0,
+	*yb = y + k0;
+      double X[BATCH_BLOCK], Y[BATCH_BLOCK];
+      int i[BATCH_BLOCK], j[BATCH_BLOCK];
+
+      for (size_t k = 0 ; k < nb ; k++)
+	{
+	  double
+	    xn = (xb[k] - x0)*rdx,
+	    yn = (yb[k] - y0)*rdy;
+
+	  i[k] = (int)floor(xn);
+	  j[k] = (int)floor(yn);
+	  X[k] = xn - i[k];
+	  Y[k] = yn - j[k];
+	}
+
+      double *zb = z + k0;
+
+      for (size_t k = 0 ; k < nb ; k++)
+	{
+	  if (cell_eval(B, i[k], j[k], X[k], Y[k], zb + k) != ERROR_OK)
+	    zb[k] = NAN;
+	}
+    }
+}
+
+extern int bilinear_batch(size_t n, const double *x, const double *y,
+			  bilinear_t *B, double *z)
+{
+  if (B->coef)
+    bilinear_batch_compiled(n, x, y, B, z);
+  else
+    {
+      for (size_t k = 0 ; k < n ; k++)
+	{
+	  if (bilinear(x[k], y[k], B, z + k) != ERROR_OK)
+	    z[k] = NAN;
+	}
+    }
+
+  return ERROR_OK;
+}
+
+/*
+  as bilinear_batch() for the components U, V of a vector
+  field, giving its direction t[k] and magnitude m[k], these
+  both NaN where either component has no data
+*/
+
+extern int bilinear_batch_polar(size_t n, const double *x, const double *y,
+				bilinear_t *U, bilinear_t *V,
+				double *t, double *m)
+{
+  int err;
+
+  if ((err = bilinear_batch(n, x, y, U, t)) != ERROR_OK)
+    return err;
+
+  if ((err = bilinear_batch(n, x, y, V, m)) != ERROR_OK)
+    return err;
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      double u = t[k], v = m[k];
+
+      if (isnan(u) || isnan(v))
+	{
+	  t[k] = m[k] = NAN;
+	  continue;
+	}
+
+      t[k] = atan2(v, u);
+      m[k] = hypot(v, u);
+    }
+
+  return ERROR_OK;
+}
+
 static double bilinear_dx(bilinear_t* B)
 {
   double w = bbox_width(B->bb);
@@ -350,27 +992,139 @@ static double bilinear_dy(bilinear_t* B)
   of them are non-nan) otherwise it returns nan
 */
 
-static double nandif(double a, double b, double c)
+static inline double nandif(double a, double b, double c)
 {
+  double d = (c-a)/2;
+
+  if (! isnan(d)) return d;
+
   if (isnan(a))
     return ((isnan(b) || isnan(c)) ? NAN : c-b);
 
   if (isnan(c))
     return (isnan(b) ? NAN : b-a);
 
-  return (c-a)/2;
+  return d;
 }
 
-extern bilinear_t* bilinear_curvature(bilinear_t* uB, bilinear_t* vB)
+/* the unit vectors of the field on row j for i in [i0, i1) */
+
+static void curvature_unit_row(bilinear_t *uB, bilinear_t *vB,
+			       int j, int i0, int i1,
+			       double *ux, double *uy)
+{
+  for (int i = i0 ; i < i1 ; i++)
+    {
+      double
+	u = zij(i, j, uB),
+	v = zij(i, j, vB),
+	r = 1/hypot(u, v);
+
+      ux[i-i0] = r*u;
+      uy[i-i0] = r*v;
+    }
+}
+
+/*
+  set the curvature in kB at the nodes [i0, i1) x [j0, j1)
+  (clipped to the interior of the grid), the unit vectors
+  are found a row at a time and held for the three rows
+  of the stencil, so the inner loop is just arithmetic.
+  Calls on disjoint node ranges may run concurrently.
+*/
+
+extern int bilinear_curvature_fill(bilinear_t *uB, bilinear_t *vB,
+				   int i0, int i1, int j0, int j1,
+				   bilinear_t *kB)
 {
   dim2_t n = uB->n;
-  bbox_t bb = uB->bb;
-  double
-    *uval = uB->v,
-    *vval = vB->v;
+
+  i0 = MAX(i0, 1);
+  i1 = MIN(i1, n.x-1);
+  j0 = MAX(j0, 1);
+  j1 = MIN(j1, n.y-1);
+
+  if ((i0 >= i1) || (j0 >= j1)) return ERROR_OK;
+
+  if (kB->coef) bilinear_decompile(kB);
+
   double
     dx = bilinear_dx(uB),
-    dy = bilinear_dy(uB);
+    dy = bilinear_dy(uB),
+    *buf;
+  int w = i1 - i0 + 2;
+
+  if ((buf = malloc(6*w*sizeof(double))) == NULL)
+    return ERROR_MALLOC;
+
+  /* rows j-1, j, j+1 of the unit vectors, including i0-1 and i1 */
+
+  double
+    *bx = buf,       *by = buf + w,
+    *cx = buf + 2*w, *cy = buf + 3*w,
+    *tx = buf + 4*w, *ty = buf + 5*w;
+
+  curvature_unit_row(uB, vB, j0-1, i0-1, i1+1, bx, by);
+  curvature_unit_row(uB, vB, j0, i0-1, i1+1, cx, cy);
+
+  for (int j = j0 ; j < j1 ; j++)
+    {
+      curvature_unit_row(uB, vB, j+1, i0-1, i1+1, tx, ty);
+
+      for (int i = i0 ; i < i1 ; i++)
+	{
+	  int c = i - i0 + 1;
+	  double
+	    u0x = cx[c],
+	    u0y = cy[c],
+	    dudx = nandif(cx[c-1], u0x, cx[c+1])/dx,
+	    dudy = nandif(bx[c], u0x, tx[c])/dy,
+	    dvdx = nandif(cy[c-1], u0y, cy[c+1])/dx,
+	    dvdy = nandif(by[c], u0y, ty[c])/dy,
+	    vkx = dudx*u0x + dudy*u0y,
+	    vky = dvdx*u0x + dvdy*u0y,
+	    k = ((u0x*vky - u0y*vkx) < 0 ? 1 : -1)*hypot(vkx, vky);
+
+	  if (! isnan(k)) nset(kB, i, j, k);
+	}
+
+      double *x = bx, *y = by;
+
+      bx = cx; by = cy;
+      cx = tx; cy = ty;
+      tx = x;  ty = y;
+    }
+
+  free(buf);
+
+  return ERROR_OK;
+}
+
+/*
+  the curvature grid, the rows are filled in blocks of this
+  many, the blocks shared between nt threads by parallel_for()
+*/
+
+#define CURVATURE_ROW_BLOCK 64
+
+typedef struct
+{
+  bilinear_t *uB, *vB, *kB;
+} curvature_grids_t;
+
+static int curvature_block(size_t k, const curvature_grids_t *c)
+{
+  int
+    j0 = k*CURVATURE_ROW_BLOCK,
+    j1 = MIN(j0 + CURVATURE_ROW_BLOCK, c->uB->n.y);
+
+  return bilinear_curvature_fill(c->uB, c->vB, 0, c->uB->n.x, j0, j1, c->kB);
+}
+
+extern bilinear_t* bilinear_curvature(bilinear_t* uB, bilinear_t* vB, int nt)
+{
+  dim2_t n = uB->n;
+  bbox_t bb = uB->bb;
 
   bilinear_t *kB;
 
@@ -383,42 +1137,83 @@ extern bilinear_t* bilinear_curvature(bilinear_t* uB, bilinear_t* vB)
       return NULL;
     }
 
-  for (int i = 1 ; i < n.x-1 ; i++)
+  curvature_grids_t c = { .uB = uB, .vB = vB, .kB = kB };
+  size_t nb = (n.y + CURVATURE_ROW_BLOCK - 1)/CURVATURE_ROW_BLOCK;
+
+  if (parallel_for(nb, nt, (pfun_t)curvature_block, &c) != ERROR_OK)
+    {
+      bilinear_destroy(kB);
+      return NULL;
+    }
+
+  return kB;
+}
+
+/*
+  a grid of half the resolution of B, each node being the
+  weighted mean (with weights 1, 2, 1 in each direction) of
+  the 3x3 nodes of B around the corresponding node, over those
+  which are not nodata, and nodata where that node is.  The
+  grid covers the nodes of B with even index, so may lose the
+  last row or column of B.  Returns NULL if B is too small to
+  be decimated, or on failure
+*/
+
+extern bilinear_t* bilinear_decimate(bilinear_t* B)
+{
+  dim2_t n = B->n;
+  int
+    nx = (n.x - 1)/2 + 1,
+    ny = (n.y - 1)/2 + 1;
+
+  if ((nx < 2) || (ny < 2)) return NULL;
+
+  bbox_t bb = B->bb;
+
+  bb.x.max = bb.x.min + 2*(nx - 1)*bilinear_dx(B);
+  bb.y.max = bb.y.min + 2*(ny - 1)*bilinear_dy(B);
+
+  bilinear_t *D;
+
+  if ((D = bilinear_new()) == NULL)
+    return NULL;
+
+  if (bilinear_dimension(nx, ny, bb, D) != ERROR_OK)
+    {
+      bilinear_destroy(D);
+      return NULL;
+    }
+
+  const double w[3] = {1, 2, 1};
+
+  for (int i = 0 ; i < nx ; i++)
     {
-      for (int j = 1 ; j < n.y-1 ; j++)
+      for (int j = 0 ; j < ny ; j++)
 	{
-	  vector_t
-	    v0 = {uval[PID(i,   j, n)], vval[PID(i, j, n)]},
-	    vt = {uval[PID(i, j+1, n)], vval[PID(i, j+1, n)]},
-	    vb = {uval[PID(i, j-1, n)], vval[PID(i, j-1, n)]},
-	    vl = {uval[PID(i-1, j, n)], vval[PID(i-1, j, n)]},
-	    vr = {uval[PID(i+1, j, n)], vval[PID(i+1, j, n)]};
-
-	  vector_t
-	    u0 = vunit(v0),
-	    ut = vunit(vt),
-	    ub = vunit(vb),
-	    ul = vunit(vl),
-	    ur = vunit(vr);
+	  if (isnan(zij(2*i, 2*j, B))) continue;
 
-	  double
-	    dudx = nandif(ul.x, u0.x, ur.x)/dx,
-	    dudy = nandif(ub.x, u0.x, ut.x)/dy,
-	    dvdx = nandif(ul.y, u0.y, ur.y)/dx,
-	    dvdy = nandif(ub.y, u0.y, ut.y)/dy;
+	  double s = 0, sw = 0;
 
-	  m2_t M = MAT(dudx, dudy,
-		       dvdx, dvdy);
+	  for (int di = -1 ; di <= 1 ; di++)
+	    {
+	      for (int dj = -1 ; dj <= 1 ; dj++)
+		{
+		  double z = zij(2*i + di, 2*j + dj, B);
 
-	  vector_t vk = m2vmul(M, u0);
+		  if (isnan(z)) continue;
 
-	  double k = (bend_2v(u0, vk) == rightward ? 1 : -1)*vabs(vk);
+		  double wij = w[di+1]*w[dj+1];
 
-	  bilinear_setz(i, j, k, kB);
+		  s  += wij*z;
+		  sw += wij;
+		}
+	    }
+
+	  nset(D, i, j, s/sw);
 	}
     }
 
-  return kB;
+  return D;
 }
 
 /*
@@ -435,7 +1230,6 @@ extern int bilinear_integrate(bbox_t ibb, bilinear_t *B, double *I)
 {
   int n0, n1, m0, m1, i, j;
   dim2_t n = B->n;
-  double* v = B->v;
   bbox_t gbb = B->bb;
 
   /*
@@ -498,10 +1292,10 @@ extern int bilinear_integrate(bbox_t ibb, bilinear_t *B, double *I)
 #endif
 
 	  double
-	    z00 = zij(i, j, v, n),
-	    z10 = zij(i+1, j, v, n),
-	    z01 = zij(i, j+1, v, n),
-	    z11 = zij(i+1, j+1, v, n);
+	    z00 = zij(i, j, B),
+	    z10 = zij(i+1, j, B),
+	    z01 = zij(i, j+1, B),
+	    z11 = zij(i+1, j+1, B);
 
 	  switch (isnan(z00) + isnan(z01) + isnan(z10) + isnan(z11))
 	    {
@@ -559,7 +1353,6 @@ extern int bilinear_defarea(bilinear_t* B, double* area)
 {
   dim2_t n = B->n;
   bbox_t bb = B->bb;
-  double* v = B->v;
   double dA = bbox_volume(bb)/((n.y-1)*(n.x-1));
   unsigned long sum = 0L;
 
@@ -568,10 +1361,10 @@ extern int bilinear_defarea(bilinear_t* B, double* area)
       for (int j = 0 ; j < n.y-1 ; j++)
 	{
 	  double
-	    z00 = zij(i, j, v, n),
-	    z10 = zij(i+1, j, v, n),
-	    z01 = zij(i, j+1, v, n),
-	    z11 = zij(i+1, j+1, v, n);
+	    z00 = zij(i, j, B),
+	    z10 = zij(i+1, j, B),
+	    z01 = zij(i, j+1, B),
+	    z11 = zij(i+1, j+1, B);
 
 	  switch (isnan(z00) + isnan(z01) + isnan(z10) + isnan(z11))
 	    {
@@ -624,7 +1417,6 @@ extern domain_t* bilinear_domain(bilinear_t* B)
 {
   domain_t *dom = NULL;
   dim2_t n = B->n;
-  double *v = B->v;
   cell_t **g;
 
   /*
@@ -644,7 +1436,7 @@ extern domain_t* bilinear_domain(bilinear_t* B)
 
   for (int i = 0 ; i < n.x ; i++)
     for (int j = 0 ; j < n.y ; j++)
-      if (! isnan(zij(i, j, v, n)))
+      if (! isnan(zij(i, j, B)))
 	{
 	  g[i+1][j+1] |= CELL_BL;
 	  g[i+1][j]   |= CELL_TL;
@@ -1092,6 +1884,7 @@ extern void bilinear_destroy(bilinear_t *B)
   if (B)
     {
       if (B->v) free(B->v);
+      bilinear_decompile(B);
       free(B);
     }
 }
@@ -7,10 +7,20 @@
 #ifndef BILINEAR_H
 #define BILINEAR_H
 
+#include <stdlib.h>
+
 #include "bbox.h"
 #include "domain.h"
 
 typedef struct bilinear_t bilinear_t;
+
+enum bilinear_store_e {
+  bilinear_double,
+  bilinear_float,
+  bilinear_int16
+};
+
+typedef enum bilinear_store_e bilinear_store_t;
 typedef int (*sfun_t)(double, double, void*, double*);
 
 extern bilinear_t* bilinear_new(void);
@@ -31,6 +41,30 @@ extern int bilinear_sample(sfun_t, void*, bilinear_t*);
 
 extern int bilinear(double, double, bilinear_t*, double*);
 
+/* interpolate at many points, NaN for nodata */
+
+extern int bilinear_batch(size_t, const double*, const double*,
+			  bilinear_t*, double*);
+extern int bilinear_batch_polar(size_t, const double*, const double*,
+				bilinear_t*, bilinear_t*,
+				double*, double*);
+
+/*
+  store the values in reduced precision, or in tiles, which
+  are 2^BILINEAR_TILE cells on a side
+*/
+
+#define BILINEAR_TILE 4
+
+
+extern int bilinear_store(bilinear_t*, bilinear_store_t);
+
+extern int bilinear_tile(bilinear_t*);
+
+/* precompute cell coefficients for faster interpolation */
+
+extern int bilinear_compile(bilinear_t*);
+
 /* scale */
 
 extern void bilinear_scale(bilinear_t*, double);
@@ -50,7 +84,14 @@ extern int bilinear_defarea(bilinear_t*, double*);
 
 /* curvature */
 
-extern bilinear_t* bilinear_curvature(bilinear_t*, bilinear_t*);
+extern bilinear_t* bilinear_curvature(bilinear_t*, bilinear_t*, int);
+extern int bilinear_curvature_fill(bilinear_t*, bilinear_t*,
+				   int, int, int, int,
+				   bilinear_t*);
+
+/* half-resolution averaged grid */
+
+extern bilinear_t* bilinear_decimate(bilinear_t*);
 
 /* write to file */
 
@@ -148,6 +148,84 @@ static void contact_d(vector_t r, m2_t A, m2_t B, double t,
   *ddF = -(rDADBDr + rDBDADr);
 }
 
+/*
+  A single-precision version of contact_mt() for the
+  dim2 force kernel (see the --single-precision option).
+  The metric tensors are symmetric so are passed as their
+  upper triangles {a, b, d}; with A, B and D symmetric we
+  also have rDADBDr = rDBDADr = (ADr).D(BDr) which saves
+  a few multiplies in the calculation of F''.
+
+  The tolerance is relaxed to suit float arithmetic, which
+  is ample for the pw-distance since it is only used to
+  evaluate a piecewise-linear force.
+*/
+
+#define CONTACTF_EPS 1e-5f
+
+static void contactf_d(float, float, const float*, const float*, float,
+		       float*, float*, float*);
+
+extern float contact_mtf(float rx, float ry, const float *A, const float *B)
+{
+  float F, dF, ddF, t = 0.5f;
+  int i;
+
+  for (i=0 ; i<CONTACT_ITER ; i++)
+    {
+      contactf_d(rx, ry, A, B, t, &F, &dF, &ddF);
+
+      if ((fabsf(dF) < CONTACTF_EPS) || (F > 1.0f))
+	return F;
+
+      float t1 = t - dF/ddF;
+
+      if (t1 < 0)
+	t = t/2;
+      else if (t1 > 1)
+	t = (t + 1)/2;
+      else
+	t = t1;
+    }
+
+  return -1;
+}
+
+static void contactf_d(float rx, float ry,
+		       const float *A, const float *B, float t,
+		       float *F, float *dF, float *ddF)
+{
+  float
+    s  = 1-t,
+    Sa = s*A[0] + t*B[0],
+    Sb = s*A[1] + t*B[1],
+    Sd = s*A[2] + t*B[2],
+    k  = 1/(Sa*Sd - Sb*Sb),
+    Da =  k*Sd,
+    Db = -k*Sb,
+    Dd =  k*Sa;
+
+  float
+    Drx  = Da*rx + Db*ry,
+    Dry  = Db*rx + Dd*ry,
+    ADrx = A[0]*Drx + A[1]*Dry,
+    ADry = A[1]*Drx + A[2]*Dry,
+    BDrx = B[0]*Drx + B[1]*Dry,
+    BDry = B[1]*Drx + B[2]*Dry;
+
+  float
+    rDr     = rx*Drx + ry*Dry,
+    rDADr   = Drx*ADrx + Dry*ADry,
+    rDBDr   = Drx*BDrx + Dry*BDry,
+    rDADBDr =
+    ADrx*(Da*BDrx + Db*BDry) +
+    ADry*(Db*BDrx + Dd*BDry);
+
+  *F   = s*t*rDr;
+  *dF  = s*s*rDADr - t*t*rDBDr;
+  *ddF = -2*rDADBDr;
+}
+
 #ifdef FVALS
 
 /*
@@ -13,5 +13,6 @@
 
 extern double contact(ellipse_t, ellipse_t);
 extern double contact_mt(vector_t, m2_t, m2_t);
+extern float contact_mtf(float, float, const float*, const float*);
 
 #endif
@@ -0,0 +1,129 @@
+/*
+  context.c
+  state of a single plot, so that several plots can
+  be made concurrently
+*/
+
+/*
+  the _GNU_SOURCE needed to enable the use of strsignal()
+  which is a gnu extension to POSIX.  On non-gnu systems
+  this will have no effect and the strsignal() will be
+  ifdef-ed out by configure anyway
+*/
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#include "context.h"
+
+extern void vfplot_context_init(vfp_context_t *ctx,
+				vfun_t fv, cfun_t fc,
+				void *field, double aspect)
+{
+  ctx->evaluate.fv     = fv;
+  ctx->evaluate.fc     = fc;
+  ctx->evaluate.fvb    = NULL;
+  ctx->evaluate.fj     = NULL;
+  ctx->evaluate.cache  = NULL;
+  ctx->evaluate.field  = field;
+  ctx->evaluate.aspect = aspect;
+
+  ctx->margin.rate  = 0.0;
+  ctx->margin.major = 0.0;
+  ctx->margin.minor = 0.0;
+  ctx->margin.scale = 1.0;
+
+  ctx->halt = 0;
+}
+
+extern void vfplot_context_batch(vfp_context_t *ctx, vfun_batch_t fvb)
+{
+  ctx->evaluate.fvb = fvb;
+}
+
+extern void vfplot_context_jacobian(vfp_context_t *ctx, jfun_t fj)
+{
+  ctx->evaluate.fj = fj;
+}
+
+extern void vfplot_context_cache(vfp_context_t *ctx, evcache_t *cache)
+{
+  ctx->evaluate.cache = cache;
+}
+
+extern void vfplot_context_halt(vfp_context_t *ctx)
+{
+  ctx->halt = 1;
+}
+
+/*
+   signal handler
+
+   the dim2 iteration can take a while, so we install
+   a handler for SIGINT (control-c) which schedules
+   a graceful exit at the end of the next cycle.
+
+   since a signal handler takes no arguments this needs
+   a file-scope pointer to the context being plotted, so
+   only one context at a time can be so halted
+*/
+
+#ifdef HAVE_SIGNAL_H
+
+static vfp_context_t *sigctx = NULL;
+static struct sigaction sigold;
+
+static void sighalt(int sig)
+{
+  if (sigctx) vfplot_context_halt(sigctx);
+
+#ifdef HAVE_STRSIGNAL
+  fprintf(stderr,
+	  "[signal] caught %i (%s), halt scheduled\n",
+	  sig, strsignal(sig));
+#else
+  fprintf(stderr, "[signal] caught %i, halt scheduled\n", sig);
+#endif
+}
+
+#endif
+
+extern void vfplot_context_sigint(vfp_context_t *ctx)
+{
+#ifdef HAVE_SIGNAL_H
+
+  struct sigaction act;
+
+  sigctx = ctx;
+
+  act.sa_handler = sighalt;
+  act.sa_flags   = 0;
+  sigemptyset(&act.sa_mask);
+
+  if (sigaction(SIGINT, &act, &sigold) == -1)
+    fprintf(stderr, "failed to install signal handler\n");
+
+#endif
+}
+
+extern void vfplot_context_sigint_restore(void)
+{
+#ifdef HAVE_SIGNAL_H
+
+  if (sigaction(SIGINT, &sigold, NULL) == -1)
+    fprintf(stderr, "failed to restore signal handler\n");
+
+  sigctx = NULL;
+
+#endif
+}
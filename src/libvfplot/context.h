@@ -0,0 +1,53 @@
+/*
+  context.h
+  state of a single plot, so that several plots can
+  be made concurrently
+*/
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <signal.h>
+
+#include "arrow.h"
+#include "evaluate.h"
+#include "vfplot.h"
+
+/*
+  evaluate : the field functions, see evaluate.h
+  margin   : the arrow margins, see arrow.h
+  halt     : if set then the dynamics (dim2) will halt
+             gracefully at the end of the current cycle
+
+  the context is initialised with vfplot_context_init(),
+  the margins are set by the constructor (for those which
+  need them), vfplot_context_halt() may be called from a
+  signal handler or from another thread.  A batch version
+  of the field function (see vfplot.h) can be registered
+  with vfplot_context_batch() after initialisation, and
+  the Jacobian of the field with vfplot_context_jacobian(),
+  and a cache of evaluations with vfplot_context_cache().
+
+  vfplot_context_sigint() installs a SIGINT handler which
+  halts the given context, vfplot_context_sigint_restore()
+  reinstates the previous handler; there is one such handler
+  per process, so these are not for use with several
+  contexts plotted concurrently.
+*/
+
+typedef struct
+{
+  evaluate_t evaluate;
+  arrow_margin_t margin;
+  volatile sig_atomic_t halt;
+} vfp_context_t;
+
+extern void vfplot_context_init(vfp_context_t*, vfun_t, cfun_t, void*, double);
+extern void vfplot_context_batch(vfp_context_t*, vfun_batch_t);
+extern void vfplot_context_jacobian(vfp_context_t*, jfun_t);
+extern void vfplot_context_cache(vfp_context_t*, evcache_t*);
+extern void vfplot_context_halt(vfp_context_t*);
+extern void vfplot_context_sigint(vfp_context_t*);
+extern void vfplot_context_sigint_restore(void);
+
+#endif
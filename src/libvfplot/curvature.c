@@ -1,6 +1,7 @@
 /*
   curvature.c
-  calculate curvature from RK4 streamlines
+  calculate curvature from RK4 streamlines, or from
+  the Jacobian of the field
   J.J.Green 2007
 */
 
@@ -9,9 +10,11 @@
 #endif
 
 #include <math.h>
+#include <stdlib.h>
 
 #include "curvature.h"
 #include "aspect.h"
+#include "error.h"
 #include "sincos.h"
 
 
@@ -23,7 +26,11 @@
   circle to that arc.
 */
 
+#define RK4_POINTS 20
+
 static int rk4(vfun_t, void*, int, vector_t*, double);
+static int rk4_batch(vfun_batch_t, void*, int, size_t,
+		     double*, double*, const double*);
 
 static double curv_3pt(vector_t, vector_t, vector_t);
 
@@ -35,12 +42,13 @@ extern int curvature(vfun_t fv, void* field, double x, double y,
   double t0, m0;
   double len, wdt;
 
-  fv(field, x, y, &t0, &m0);
-  aspect_fixed(asp, m0, &len, &wdt);
+  if ((fv(field, x, y, &t0, &m0) != 0) ||
+      (aspect_fixed(asp, m0, &len, &wdt) != 0))
+    return 1;
 
   /* rk4 forward and back, save tail, midpoint & head in a[] */
 
-  int n = 20;
+  int n = RK4_POINTS;
   vector_t v[n];
   vector_t a0, a1, a2;
   double h = 0.5*len/n;
@@ -64,6 +72,99 @@ extern int curvature(vfun_t fv, void* field, double x, double y,
   return 0;
 }
 
+/*
+  the curvature at the n points (x[k], y[k]) for arrows of
+  shaft-length len[k], as curvature() but with all of the
+  streamlines traced together, with a call of the batch field
+  function fvb for each Runge-Kutta stage (see rk4_batch).
+  The curvature is NaN where len is NaN, the return value is
+  not ERROR_OK only on failure.  Where fvb gives the same values
+  as the scalar field function, NaN angle for nodata, the result
+  is that of curvature() to rounding, including for streamlines
+  which meet nodata.
+*/
+
+extern int curvature_batch(vfun_batch_t fvb, void *field, size_t n,
+			   const double *x, const double *y,
+			   const double *len, double *curv)
+{
+  if (n == 0) return ERROR_OK;
+
+  size_t m = 2*n;
+  double *w;
+
+  if ((w = malloc(3*m*sizeof(double))) == NULL)
+    return ERROR_MALLOC;
+
+  /* forward streamlines in [0, n), backward in [n, 2n) */
+
+  double *px = w, *py = w + m, *h = w + 2*m;
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      px[k] = px[n+k] = x[k];
+      py[k] = py[n+k] = y[k];
+      h[k] = 0.5*len[k]/RK4_POINTS;
+      h[n+k] = -h[k];
+    }
+
+  int err = rk4_batch(fvb, field, RK4_POINTS, m, px, py, h);
+
+  if (err == ERROR_OK)
+    {
+      for (size_t k = 0 ; k < n ; k++)
+	{
+	  if (isnan(len[k]))
+	    {
+	      curv[k] = NAN;
+	      continue;
+	    }
+
+	  vector_t
+	    a0 = {px[n+k], py[n+k]},
+	    a1 = {x[k], y[k]},
+	    a2 = {px[k], py[k]};
+
+	  bend_t bend = bend_3pt(a0, a1, a2);
+
+	  curv[k] = (bend == rightward ? 1 : -1) * curv_3pt(a0, a1, a2);
+	}
+    }
+
+  free(w);
+
+  return err;
+}
+
+/*
+  the curvature of the streamline through (x, y) in closed
+  form: for the field F = (u, v) with Jacobian J, the
+  acceleration along the streamline is a = JF, and the
+  curvature is the cross product F x a divided by |F|^3,
+  this is invariant under multiplying F by a positive
+  function.  The sign is negated for our convention of
+  positive for rightward bend.
+*/
+
+extern int curvature_jacobian(jfun_t fj, void* field,
+			      double x, double y, double* curv)
+{
+  double u, v, J[4];
+
+  if (fj(field, x, y, &u, &v, J) != 0) return 1;
+
+  double
+    ax = J[0]*u + J[1]*v,
+    ay = J[2]*u + J[3]*v,
+    F  = hypot(u, v);
+
+  if (F <= 0.0) return 1;
+
+  *curv = (v*ax - u*ay)/(F*F*F);
+
+  return 0;
+}
+
 /*
   fit a circle to 3 points, and return the curvature
   of this circle (1/r).
@@ -107,7 +208,10 @@ static double curv_3pt(vector_t a, vector_t b, vector_t c)
   assigned to the starting point.
 
   At each Runge-Kutta step we rotate the coordinate frame,
-  so that the stream line comes out along the x-axis
+  so that the stream line comes out along the x-axis.  If
+  the field is nodata at any stage of a step then the
+  streamline stops at its last point (so the remainder of
+  v is that point), as in rk4_batch()
 */
 
 static int rk4(vfun_t fv, void* field, int n, vector_t* v, double h)
@@ -122,7 +226,7 @@ static int rk4(vfun_t fv, void* field, int n, vector_t* v, double h)
       fprintf(paths, "%f %f\n", v[i].x, v[i].y);
 #endif
 
-      fv(field, v[i].x, v[i].y, &t0, &m0);
+      if (fv(field, v[i].x, v[i].y, &t0, &m0) != 0) break;
 
       double st, ct;
 
@@ -136,22 +240,22 @@ static int rk4(vfun_t fv, void* field, int n, vector_t* v, double h)
 
       double k2, k3, k4;
 
-      fv(field,
-	 v[i].x + ct*h/2,
-	 v[i].y + st*h/2,
-	 &t, &m);
+      if (fv(field,
+	     v[i].x + ct*h/2,
+	     v[i].y + st*h/2,
+	     &t, &m) != 0) break;
       k2 = tan(t-t0);
 
-      fv(field,
-	 v[i].x + (ct - st*k2)*h/2,
-	 v[i].y + (st + ct*k2)*h/2,
-	 &t, &m);
+      if (fv(field,
+	     v[i].x + (ct - st*k2)*h/2,
+	     v[i].y + (st + ct*k2)*h/2,
+	     &t, &m) != 0) break;
       k3 = tan(t-t0);
 
-      fv(field,
-	 v[i].x + (ct - st*k3)*h,
-	 v[i].y + (st + ct*k3)*h,
-	 &t, &m);
+      if (fv(field,
+	     v[i].x + (ct - st*k3)*h,
+	     v[i].y + (st + ct*k3)*h,
+	     &t, &m) != 0) break;
       k4 = tan(t-t0);
 
       double k = (2.0*(k2+k3) + k4)/6.0;
@@ -160,6 +264,8 @@ static int rk4(vfun_t fv, void* field, int n, vector_t* v, double h)
       v[i+1].y = v[i].y + (st + ct*k)*h;
     }
 
+  for ( ; i<n-1 ; i++) v[i+1] = v[i];
+
 #ifdef PATHS
   fprintf(paths, "%f %f\n", v[n-1].x, v[n-1].y);
   fprintf(paths, "\n");
@@ -167,3 +273,161 @@ static int rk4(vfun_t fv, void* field, int n, vector_t* v, double h)
 
   return 0;
 }
+
+/*
+  the batch version of rk4(): advance the m streamlines from
+  (px[k], py[k]) with steps h[k] for n-1 steps in lockstep,
+  writing the final points back to (px, py).  Each Runge-Kutta
+  stage of every live streamline is a single query of fvb, and
+  the working arrays are held in SoA form (compacted to the live
+  streamlines) so that the arithmetic between the queries
+  vectorises.  A streamline which meets nodata (where fvb gives
+  a NaN angle) stops at its last point, as in rk4(), as does
+  one for which the step is NaN.
+*/
+
+static size_t rk4_live(size_t na, const double *t, size_t *act,
+		       double *const *a, int narr)
+{
+  size_t nb = 0;
+
+  for (size_t j = 0 ; j < na ; j++)
+    {
+      if (isnan(t[j])) continue;
+
+      act[nb] = act[j];
+
+      for (int l = 0 ; l < narr ; l++)
+	a[l][nb] = a[l][j];
+
+      nb++;
+    }
+
+  return nb;
+}
+
+static int rk4_batch(vfun_batch_t fvb, void *field, int n, size_t m,
+		     double *px, double *py, const double *h)
+{
+  size_t *act;
+  double *w;
+
+  if ((act = malloc(m*sizeof(size_t))) == NULL)
+    return ERROR_MALLOC;
+
+  if ((w = malloc(12*m*sizeof(double))) == NULL)
+    {
+      free(act);
+      return ERROR_MALLOC;
+    }
+
+  double
+    *x0 = w,
+    *y0 = w + m,
+    *hh = w + 2*m,
+    *t0 = w + 3*m,
+    *st = w + 4*m,
+    *ct = w + 5*m,
+    *k2 = w + 6*m,
+    *k3 = w + 7*m,
+    *qx = w + 8*m,
+    *qy = w + 9*m,
+    *t  = w + 10*m,
+    *mg = w + 11*m;
+
+  double *const live[] = {t, x0, y0, hh, t0, st, ct, k2, k3};
+  size_t na = 0;
+  int err = ERROR_OK;
+
+  for (size_t k = 0 ; k < m ; k++)
+    if (! isnan(h[k])) act[na++] = k;
+
+  for (int i = 0 ; (i < n-1) && (na > 0) ; i++)
+    {
+      for (size_t j = 0 ; j < na ; j++)
+	{
+	  qx[j] = px[act[j]];
+	  qy[j] = py[act[j]];
+	}
+
+      if (fvb(field, na, qx, qy, t, mg) != 0)
+	{
+	  err = ERROR_BUG;
+	  break;
+	}
+
+      if ((na = rk4_live(na, t, act, live, 1)) == 0) break;
+
+      for (size_t j = 0 ; j < na ; j++)
+	{
+	  size_t k = act[j];
+
+	  x0[j] = px[k];
+	  y0[j] = py[k];
+	  hh[j] = h[k];
+	  t0[j] = t[j];
+	}
+
+      for (size_t j = 0 ; j < na ; j++)
+	sincos(t0[j], st + j, ct + j);
+
+      /* k1 = 0 as in rk4() */
+
+      for (size_t j = 0 ; j < na ; j++)
+	{
+	  qx[j] = x0[j] + ct[j]*hh[j]/2;
+	  qy[j] = y0[j] + st[j]*hh[j]/2;
+	}
+
+      if (fvb(field, na, qx, qy, t, mg) != 0)
+	{
+	  err = ERROR_BUG;
+	  break;
+	}
+
+      if ((na = rk4_live(na, t, act, live, 7)) == 0) break;
+
+      for (size_t j = 0 ; j < na ; j++)
+	{
+	  k2[j] = tan(t[j] - t0[j]);
+	  qx[j] = x0[j] + (ct[j] - st[j]*k2[j])*hh[j]/2;
+	  qy[j] = y0[j] + (st[j] + ct[j]*k2[j])*hh[j]/2;
+	}
+
+      if (fvb(field, na, qx, qy, t, mg) != 0)
+	{
+	  err = ERROR_BUG;
+	  break;
+	}
+
+      if ((na = rk4_live(na, t, act, live, 8)) == 0) break;
+
+      for (size_t j = 0 ; j < na ; j++)
+	{
+	  k3[j] = tan(t[j] - t0[j]);
+	  qx[j] = x0[j] + (ct[j] - st[j]*k3[j])*hh[j];
+	  qy[j] = y0[j] + (st[j] + ct[j]*k3[j])*hh[j];
+	}
+
+      if (fvb(field, na, qx, qy, t, mg) != 0)
+	{
+	  err = ERROR_BUG;
+	  break;
+	}
+
+      if ((na = rk4_live(na, t, act, live, 9)) == 0) break;
+
+      for (size_t j = 0 ; j < na ; j++)
+	{
+	  double k = (2.0*(k2[j] + k3[j]) + tan(t[j] - t0[j]))/6.0;
+
+	  px[act[j]] = x0[j] + (ct[j] - st[j]*k)*hh[j];
+	  py[act[j]] = y0[j] + (st[j] + ct[j]*k)*hh[j];
+	}
+    }
+
+  free(w);
+  free(act);
+
+  return err;
+}
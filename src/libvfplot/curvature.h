@@ -1,14 +1,21 @@
 /*
   curvature.h
-  calculate curvature from RK4 streamlines
+  calculate curvature from RK4 streamlines, or from
+  the Jacobian of the field
   J.J.Green 2007
 */
 
 #ifndef CURVATURE_H
 #define CURVATURE_H
 
+#include <stdlib.h>
+
 #include "vfplot.h"
 
 extern int curvature(vfun_t, void*, double, double, double, double*);
+extern int curvature_jacobian(jfun_t, void*, double, double, double*);
+extern int curvature_batch(vfun_batch_t, void*, size_t,
+			   const double*, const double*, const double*,
+			   double*);
 
 #endif
@@ -22,6 +22,7 @@
 #include "contact.h"
 #include "paths.h"
 #include "macros.h"
+#include "parallel.h"
 
 /* number of iterations in dim-0 placement */
 
@@ -42,13 +43,20 @@
 
 static int dim0_corner(vector_t, vector_t, vector_t, dim0_opt_t*, arrow_t*);
 
-extern int dim0(domain_t *dom, dim0_opt_t *opt, int L)
+/*
+  the path of glyphs at the corners of a polyline, or NULL
+  if there are none
+*/
+
+static int dim0_polyline(const domain_t *dom, dim0_opt_t *opt, gstack_t **ppath)
 {
   polyline_t p = dom->p;
   int i, err = 0;
   gstack_t *path = gstack_new(sizeof(corner_t), p.n, p.n);
   corner_t cn;
 
+  *ppath = NULL;
+
   for (i=0 ; i<p.n ; i++)
     {
       int j = (i+1) % p.n, k = (i+2) % p.n;
@@ -72,6 +80,7 @@ extern int dim0(domain_t *dom, dim0_opt_t *opt, int L)
       fprintf(stderr, "failed placement at %i corner%s\n", err, (err == 1 ? "" : "s"));
 
 #ifdef DIM0_PLACE_STRICT
+      gstack_destroy(path);
       return ERROR_NODATA;
 #endif
     }
@@ -85,11 +94,82 @@ extern int dim0(domain_t *dom, dim0_opt_t *opt, int L)
       return ERROR_OK;
     }
 
-  gstack_push(opt->paths, (void*)(&path));
+  *ppath = path;
 
   return ERROR_OK;
 }
 
+/*
+  the polylines of the domain are independent, so we
+  place their glyphs concurrently (with opt->opt.threads
+  threads) into the paths[] array and then push them onto
+  opt->paths in domain_iterate() order, so that the result
+  does not depend on the number of threads
+*/
+
+typedef struct
+{
+  size_t n;
+  const domain_t **dom;
+  gstack_t **path;
+  dim0_opt_t *opt;
+} dim0_job_t;
+
+static int dim0_collect(const domain_t *dom, dim0_job_t *job, int L)
+{
+  if (job->dom) job->dom[job->n] = dom;
+  job->n++;
+
+  return 0;
+}
+
+static int dim0_job(size_t k, dim0_job_t *job)
+{
+  return dim0_polyline(job->dom[k], job->opt, job->path + k);
+}
+
+extern int dim0(const domain_t *dom, dim0_opt_t *opt)
+{
+  dim0_job_t job = {0, NULL, NULL, opt};
+  int err;
+
+  if ((err = domain_iterate(dom, (difun_t)dim0_collect, &job)) != 0)
+    return err;
+
+  if (job.n == 0) return ERROR_OK;
+
+  size_t n = job.n;
+
+  if ((job.dom = malloc(n*sizeof(domain_t*))) == NULL)
+    return ERROR_MALLOC;
+
+  if ((job.path = calloc(n, sizeof(gstack_t*))) == NULL)
+    {
+      free(job.dom);
+      return ERROR_MALLOC;
+    }
+
+  job.n = 0;
+
+  if ((err = domain_iterate(dom, (difun_t)dim0_collect, &job)) == 0)
+    err = parallel_for(n, opt->opt.threads, (pfun_t)dim0_job, &job);
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      if (! job.path[k]) continue;
+
+      if (err == ERROR_OK)
+	gstack_push(opt->paths, (void*)(job.path + k));
+      else
+	gstack_destroy(job.path[k]);
+    }
+
+  free(job.path);
+  free(job.dom);
+
+  return err;
+}
+
 /*
   for each polyline we place a glyph at each corner,
   we assume that the polylines are oriented
@@ -167,12 +247,12 @@ static int dim0_corner(vector_t a, vector_t b, vector_t c,
 
 #endif
 
-	  if ((err = evaluate(A)) != ERROR_OK)
+	  if ((err = evaluate_r(&(opt->ctx->evaluate), A)) != ERROR_OK)
 	    return err;
 
 	  ellipse_t e;
 
-	  arrow_ellipse(A, &e);
+	  arrow_ellipse_r(&(opt->ctx->margin), A, &e);
 
 	  vector_t r[2], p0, q0;
 	  vector_t C[2];
@@ -226,12 +306,12 @@ static int dim0_corner(vector_t a, vector_t b, vector_t c,
 
 #endif
 
-	  if ((err = evaluate(A)) != ERROR_OK)
+	  if ((err = evaluate_r(&(opt->ctx->evaluate), A)) != ERROR_OK)
 	    return err;
 
 	  ellipse_t e;
 
-	  arrow_ellipse(A, &e);
+	  arrow_ellipse_r(&(opt->ctx->margin), A, &e);
 
 	  double d = ellipse_radius(e, e.theta-t4);
 
@@ -10,6 +10,7 @@
 #include "vfplot.h"
 #include "gstack.h"
 #include "mt.h"
+#include "context.h"
 
 typedef struct
 {
@@ -17,9 +18,10 @@ typedef struct
   gstack_t* paths;
   double area;
   mt_t mt;
+  const vfp_context_t *ctx;
 } dim0_opt_t;
 
-extern int dim0(domain_t*, dim0_opt_t*, int);
+extern int dim0(const domain_t*, dim0_opt_t*);
 extern int dim0_decimate(gstack_t*);
 
 #endif
@@ -18,15 +18,16 @@
 #include "contact.h"
 #include "evaluate.h"
 #include "paths.h"
+#include "parallel.h"
 
 
 /* number of iterations in dim-1 placement */
 
 #define DIM1_POS_ITER 8
 
-/* maximum number of arrows on a boundary segment */
+/* initial size of the scratch arrays of corners and arrows */
 
-#define DIM1_MAX_ARROWS 256
+#define DIM1_SCRATCH_INIT 64
 
 /*
    iterations to find slack, and the smallest value
@@ -78,39 +79,146 @@
 
 static int path_dim1(gstack_t**, dim1_opt_t*);
 
+/*
+  each path is filled in place and independently of the
+  others, so we do so concurrently with opt->threads
+  threads; the paths are first collected into an array
+*/
+
+typedef struct
+{
+  size_t n;
+  gstack_t **path[];
+} dim1_paths_t;
+
+static int dim1_collect(gstack_t **path, dim1_paths_t *P)
+{
+  P->path[P->n++] = path;
+
+  return 1;
+}
+
+typedef struct
+{
+  dim1_paths_t *P;
+  dim1_opt_t *opt;
+} dim1_job_t;
+
+static int dim1_job(size_t k, dim1_job_t *job)
+{
+  return (path_dim1(job->P->path[k], job->opt) < 0 ?
+	  ERROR_MALLOC : ERROR_OK);
+}
+
 extern int dim1(gstack_t *paths, dim1_opt_t *opt)
 {
-  return gstack_foreach(paths, (int(*)(void*, void*))path_dim1, opt);
+  if (opt->threads < 2)
+    return (gstack_foreach(paths, (int(*)(void*, void*))path_dim1, opt) ?
+	    ERROR_MALLOC : ERROR_OK);
+
+  size_t n = gstack_size(paths);
+  dim1_paths_t *P;
+
+  if ((P = malloc(sizeof(dim1_paths_t) + n*sizeof(gstack_t**))) == NULL)
+    return ERROR_MALLOC;
+
+  P->n = 0;
+
+  gstack_foreach(paths, (int(*)(void*, void*))dim1_collect, P);
+
+  dim1_job_t job = {P, opt};
+  int err = parallel_for(P->n, opt->threads, (pfun_t)dim1_job, &job);
+
+  free(P);
+
+  return err;
 }
 
-static int dim1_edge(gstack_t*, corner_t, corner_t, dim1_opt_t*);
+/*
+  the corners of a path and the arrows of a segment are
+  held in scratch arrays, one pair for each call of
+  path_dim1() (so one per thread), which grow as needed
+  so there is no limit on the number of arrows
+*/
+
+typedef struct
+{
+  size_t nc, na;
+  corner_t *c;
+  arrow_t *A;
+} dim1_scratch_t;
+
+static int scratch_grow(void **p, size_t *alloc, size_t n, size_t size)
+{
+  if (n <= *alloc) return 0;
+
+  size_t m = (*alloc ? *alloc : DIM1_SCRATCH_INIT);
+
+  while (m < n) m *= 2;
+
+  void *q = realloc(*p, m*size);
+
+  if (!q) return 1;
+
+  *p = q;
+  *alloc = m;
+
+  return 0;
+}
+
+static int scratch_corners(dim1_scratch_t *S, size_t n)
+{
+  return scratch_grow((void**)&(S->c), &(S->nc), n, sizeof(corner_t));
+}
+
+static int scratch_arrows(dim1_scratch_t *S, size_t n)
+{
+  return scratch_grow((void**)&(S->A), &(S->na), n, sizeof(arrow_t));
+}
+
+static int dim1_edge(gstack_t*, corner_t, corner_t,
+		     dim1_scratch_t*, dim1_opt_t*);
+
+/*
+  the corners are popped into the scratch array and the
+  filled segments pushed straight back onto the path, in
+  reverse order and each reversed, so that the path has
+  the same order as when filled segment by segment onto
+  a new stack then popped back
+
+  note that the ordering of the corners passed to
+  dim1_edge() is important
+*/
 
 static int path_dim1(gstack_t** path, dim1_opt_t *opt)
 {
-  corner_t c0;
+  size_t m = gstack_size(*path);
 
-  if (gstack_pop(*path, &c0) == 0)
-    {
-      corner_t c1=c0, c2;
-      gstack_t* newpath = gstack_new(sizeof(corner_t), 10, 10);
+  if (m == 0) return 1;
 
-      /*
-	 note that the ordering of the corners passed to
-	 dim1_path() is important
-      */
+  dim1_scratch_t S = {0, 0, NULL, NULL};
+  int err = ERROR_OK;
 
-      while (gstack_pop(*path, &c2) == 0)
-	{
-	  dim1_edge(newpath, c1, c2, opt);
-	  c1 = c2;
-	}
+  if (scratch_corners(&S, m) != 0)
+    err = ERROR_MALLOC;
+  else
+    {
+      for (size_t i=0 ; i<m ; i++)
+	gstack_pop(*path, S.c + i);
 
-      dim1_edge(newpath, c1, c0, opt);
+      err = dim1_edge(*path, S.c[m-1], S.c[0], &S, opt);
+
+      for (size_t i=m-1 ; (i>0) && (err == ERROR_OK) ; i--)
+	err = dim1_edge(*path, S.c[i-1], S.c[i], &S, opt);
+    }
 
-      while (gstack_pop(newpath, &c0) == 0)
-	gstack_push(*path, &c0);
+  free(S.c);
+  free(S.A);
 
-      gstack_destroy(newpath);
+  if (err != ERROR_OK)
+    {
+      fprintf(stderr, "failed allocation filling boundary\n");
+      return -1;
     }
 
   return 1;
@@ -120,20 +228,69 @@ static int path_dim1(gstack_t** path, dim1_opt_t *opt)
   fill path with corner_t structs between c0 and c1
 */
 
-static int project_ellipse(vector_t, vector_t, vector_t, mt_t, ellipse_t*);
+/*
+  the metric tensor at the last point it was evaluated on the
+  segment: the projection of an ellipse onto the segment is a
+  fixed-point iteration, and the bracketing of each glyph starts
+  from the previous one, so the tensor is often wanted at (or
+  within rounding of) the same point again; then we reuse it.
+  The tolerance eps is a small multiple of the segment length
+*/
 
-static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
+#define DIM1_MT_EPS 1e-12
+
+typedef struct
+{
+  const mt_t *mt;
+  double eps;
+  int valid;
+  vector_t x;
+  m2_t M;
+} dim1_mt_t;
+
+static int dim1_metric_tensor(dim1_mt_t *T, vector_t x, m2_t *M)
 {
-  int i;
-  arrow_t A[DIM1_MAX_ARROWS];
+  if (T->valid &&
+      (fabs(x.x - T->x.x) <= T->eps) &&
+      (fabs(x.y - T->x.y) <= T->eps))
+    {
+      *M = T->M;
+      return ERROR_OK;
+    }
+
+  int err;
+
+  if ((err = metric_tensor(x, *(T->mt), M)) != ERROR_OK)
+    return err;
+
+  T->valid = 1;
+  T->x = x;
+  T->M = *M;
+
+  return ERROR_OK;
+}
+
+static int project_ellipse(vector_t, vector_t, vector_t, dim1_mt_t*, ellipse_t*);
+
+static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1,
+		     dim1_scratch_t *S, dim1_opt_t *opt)
+{
+  int i, share = 0;
+  double slack = 0.0;
   arrow_t Aa = c0.A, Ab = c1.A;
   vector_t pa = c0.v, pb = c1.v;
   vector_t seg = vsub(pb, pa);
   double len = vabs(seg);
   vector_t v = vunit(seg);
   double psi = vang(v);
+  dim1_mt_t T = { .mt = &(opt->mt), .eps = DIM1_MT_EPS*len, .valid = 0 };
+
+  /* initialise A[], the first two arrows are always available */
 
-  /* initialise A[] */
+  if (scratch_arrows(S, 2) != 0)
+    return ERROR_MALLOC;
+
+  arrow_t *A = S->A;
 
   A[0] = Aa;
 
@@ -143,8 +300,8 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
   ellipse_t Ea, Eb;
 
-  arrow_ellipse(&Aa, &Ea);
-  arrow_ellipse(&Ab, &Eb);
+  arrow_ellipse_r(&(opt->ctx->margin), &Aa, &Ea);
+  arrow_ellipse_r(&(opt->ctx->margin), &Ab, &Eb);
 
   /* don't bother with very short segments */
 
@@ -164,7 +321,7 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
     {
       vector_t x0 = vsub(Ea.centre, smul(mu, v));
 
-      if (project_ellipse(pa, v, x0, opt->mt, &E1) != ERROR_OK)
+      if (project_ellipse(pa, v, x0, &T, &E1) != ERROR_OK)
 	{
 	  /* FIXME */
 
@@ -175,7 +332,7 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
       A1.centre = vadd(Aa.centre, vsub(E1.centre, Ea.centre));
 
-      evaluate(&A1);
+      evaluate_r(&(opt->ctx->evaluate), &A1);
 
       if (!ellipse_intersect(Ea, E1))
 	{
@@ -210,7 +367,7 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
     {
       double w = (DIM1_SHIFT_MIN + DIM1_SHIFT_STEP*i) * dw;
 
-      if (project_ellipse(pa, v, vadd(E1.centre, smul(w, v)), opt->mt, &E2) == ERROR_OK)
+      if (project_ellipse(pa, v, vadd(E1.centre, smul(w, v)), &T, &E2) == ERROR_OK)
 	{
 	  isect = ellipse_intersect(E2, Ea);
 	}
@@ -230,7 +387,12 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
   for (i=0 ; i<DIM1_POS_ITER ; i++)
     {
-      project_ellipse(pa, v, vmid(E1.centre, E2.centre), opt->mt, &Et);
+      if (project_ellipse(pa, v, vmid(E1.centre, E2.centre), &T, &Et) != ERROR_OK)
+	{
+	  fprintf(stderr, "failed project at bracket (%f, %f)\n",
+		  pa.x, pa.y);
+	  goto output;
+	}
 
       if (ellipse_intersect(Et, Ea)) E1 = Et;
       else E2 = Et;
@@ -239,7 +401,7 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
   if (ellipse_intersect(Et, Eb)) goto output;
 
   A[k].centre = vadd(Aa.centre, vsub(Et.centre, Ea.centre));
-  evaluate(A+k);
+  evaluate_r(&(opt->ctx->evaluate), A+k);
   k++;
 
   /*
@@ -249,13 +411,14 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
   */
 
   ellipse_t Ep = Et;
+  double mup = projline(pa, v, Ep.centre);
 
 #ifdef TRACE_EDGE
   printf("---\n");
   printf("Ep = (%f, %f)\n", Ep.centre.x, Ep.centre.y);
 #endif
 
-  for (i=0 ; i<DIM1_MAX_ARROWS ; i++)
+  for (i=0 ; ; i++)
     {
       int j;
 
@@ -274,7 +437,7 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 	  printf("j=%i, w=%f\n", j, w);
 #endif
 
-	  if (project_ellipse(pa, v, vadd(E1.centre, smul(w, v)), opt->mt, &E2) == ERROR_OK)
+	  if (project_ellipse(pa, v, vadd(E1.centre, smul(w, v)), &T, &E2) == ERROR_OK)
 	    {
 	      isect = ellipse_intersect(E2, Ep);
 #ifdef TRACE_EDGE
@@ -295,7 +458,7 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
       for (j=0 ; j<DIM1_POS_ITER ; j++)
 	{
-	  if (project_ellipse(pa, v, vmid(E1.centre, E2.centre), opt->mt, &Et) != ERROR_OK)
+	  if (project_ellipse(pa, v, vmid(E1.centre, E2.centre), &T, &Et) != ERROR_OK)
 	    {
 	      fprintf(stderr, "failed project at shuffle to (%f, %f)\n",
 		      E1.centre.x, E1.centre.y);
@@ -309,15 +472,41 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
       if (ellipse_intersect(Et, Eb))
 	goto output;
 
+      /*
+	 without a limit on the number of arrows we need
+	 to check that each is further along the segment
+	 than the last, and not far past its end
+      */
+
+      double mut = projline(pa, v, Et.centre);
+
+      if (mut <= mup)
+	{
+	  fprintf(stderr, "no progress at ellipse %i (%f, %f)\n",
+		  i, Et.centre.x, Et.centre.y);
+	  goto output;
+	}
+
+      if (mut > len + 2.0*Eb.major)
+	{
+	  fprintf(stderr, "overshot segment end at ellipse %i (%f, %f)\n",
+		  i, Et.centre.x, Et.centre.y);
+	  goto output;
+	}
+
+      if (scratch_arrows(S, k+1) != 0)
+	return ERROR_MALLOC;
+
+      A = S->A;
+
       A[k].centre = vadd(A[k-1].centre, vsub(Et.centre, Ep.centre));
-      evaluate(A+k);
+      evaluate_r(&(opt->ctx->evaluate), A+k);
       k++;
 
-      Ep = Et;
+      Ep  = Et;
+      mup = mut;
     }
 
-  fprintf(stderr, "too many arrows on one segment (%i)\n", DIM1_MAX_ARROWS);
-
   /* goto considered groovy */
 
  output:
@@ -326,7 +515,6 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
   if (k>2)
     {
-      double slack;
       double w = 2.0*ellipse_radius(Ep, Ep.theta-psi);
 
       ellipse_t E = Ep;
@@ -351,23 +539,28 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
       /* if there's enough to share then do so */
 
-      if (slack > DIM1_SLACK_MIN*w)
-	for (i=1 ; i<k ; i++)
-	  A[i].centre = vadd(A[i].centre, smul(i*slack/k, v));
+      share = (slack > DIM1_SLACK_MIN*w);
     }
 
-  /* generate the path */
+  /*
+     append to the path in reverse (see path_dim1), sharing
+     out the slack as we go
+  */
 
-  for (i=0 ; i<k ; i++)
+  for (i=k-1 ; i>=0 ; i--)
     {
       corner_t c;
 
       c.A = A[i];
 
-      gstack_push(path, &c);
+      if (share && (i > 0))
+	c.A.centre = vadd(c.A.centre, smul(i*slack/k, v));
+
+      if (gstack_push(path, &c) != 0)
+	return ERROR_MALLOC;
     }
 
-  return 0;
+  return ERROR_OK;
 }
 
 /*
@@ -378,7 +571,8 @@ static int dim1_edge(gstack_t *path, corner_t c0, corner_t c1, dim1_opt_t *opt)
 
 // #define TRACE_PROJECT
 
-static int project_ellipse(vector_t p, vector_t v, vector_t x, mt_t mt, ellipse_t* pE)
+static int project_ellipse(vector_t p, vector_t v, vector_t x,
+			   dim1_mt_t *T, ellipse_t* pE)
 {
   size_t i;
   ellipse_t E;
@@ -389,7 +583,7 @@ static int project_ellipse(vector_t p, vector_t v, vector_t x, mt_t mt, ellipse_
     {
       E.centre = x;
 
-      if ((err = metric_tensor(x, mt, &M)) != ERROR_OK)
+      if ((err = dim1_metric_tensor(T, x, &M)) != ERROR_OK)
 	{
 #ifdef TRACE_PROJECT
 	  printf("failed metric_tensor at (%f, %f)\n", x.x, x.y);
@@ -427,7 +621,7 @@ static int project_ellipse(vector_t p, vector_t v, vector_t x, mt_t mt, ellipse_
 
   pE->centre = x;
 
-  if ((err = metric_tensor(x, mt, &M)) != ERROR_OK ||
+  if ((err = dim1_metric_tensor(T, x, &M)) != ERROR_OK ||
       (err = mt_ellipse(M, pE)) != ERROR_OK)
     return err;
 
@@ -9,10 +9,13 @@
 
 #include "gstack.h"
 #include "mt.h"
+#include "context.h"
 
 typedef struct
 {
   mt_t mt;
+  const vfp_context_t *ctx;
+  int threads;
 } dim1_opt_t;
 
 extern int dim1(gstack_t*, dim1_opt_t*);
@@ -4,15 +4,6 @@
   J.J.Green 2007,  2012
 */
 
-/*
-  the _GNU_SOURCE needed to enable the use of strsignal()
-  which is a gnu extension to POSIX.  On non-gnu systems
-  this will have no effect and the strsignal() will be
-  ifdef-ed out by configure anyway
-*/
-
-#define _GNU_SOURCE
-
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -39,10 +30,6 @@
 
 #include <kdtree.h>
 
-#ifdef HAVE_SIGNAL_H
-#include <signal.h>
-#endif
-
 
 #ifndef INFINITY
 #define INFINITY HUGE_VALF
@@ -84,6 +71,20 @@ typedef struct
   vector_t v, dv, F;
 } particle_t;
 
+/*
+  single-precision copy of the particle data read by the
+  force kernel, refreshed from the particle array before
+  each force accumulation when the single option is set.
+  M holds the upper triangle {a, b, d} of the (symmetric)
+  metric tensor, as expected by contact_mtf()
+*/
+
+typedef struct
+{
+  float x, y, M[3], charge;
+  flag_t flag;
+} particlef_t;
+
 /*
    we use pthreads for force accumulation and use
    these structures to pass arguments to the threads.
@@ -108,6 +109,7 @@ typedef struct
 {
   int *edge;
   particle_t *p;
+  particlef_t *pf;
   double rd, rt;
   size_t n1, n2;
 
@@ -129,6 +131,7 @@ typedef struct
 
 static int subdivide(size_t, size_t, size_t*, size_t*);
 static void* forces(tdata_t*);
+static void* forcesf(tdata_t*);
 
 #ifdef PTHREAD_FORCES
 
@@ -164,36 +167,6 @@ static int ensure_alloc(int n1, int n2, particle_t **pp, int *na)
   return 0;
 }
 
-/*
-   signal handler
-
-   the dim2 iteration can take a while, so we install
-   a handler for SIGINT (control-c) which schedules
-   a graceful exit at the end of the next cycle.
-
-   this needs a file-scope value exitflag which is
-   checked at the end of each outer iteration
-*/
-
-#ifdef HAVE_SIGNAL_H
-
-static int exitflag = 0;
-
-static void setexitflag(int sig)
-{
-  exitflag = 1;
-
-#ifdef HAVE_STRSIGNAL
-  fprintf(stderr,
-	  "[signal] caught %i (%s), halt scheduled\n",
-	  sig, strsignal(sig));
-#else
-  fprintf(stderr, "[signal] caught %i, halt scheduled\n", sig);
-#endif
-}
-
-#endif
-
 static int neighbours(particle_t*, int, int, int**, int*);
 static nbs_t* nbs_populate(int, int*, int, particle_t*);
 
@@ -251,6 +224,13 @@ static double sinspline(double t, double t0, double z0, double t1, double z1)
 #define DETRUNC_R0 0.90
 #define DETRUNC_R1 0.00
 
+/*
+  for a warm start (see warm_start() below) the schedule
+  starts at the beginning of the cleaning phase
+*/
+
+#define WARM_T0 CLEAN_T0
+
 /* breakpoints defined in terms of these */
 
 #define BREAK_SUPER     (0.95*CLEAN_T0)
@@ -367,6 +347,115 @@ static double force(double d, double x, double x0)
   return 0;
 }
 
+static float forcef(float d, float x, float x0)
+{
+  float K = 1/(1-x0);
+
+  if (d < x) return K*(1-x);
+  if (d < 1) return K*(1-d);
+  return 0;
+}
+
+/* initialise a free particle from an evaluated arrow */
+
+static void set_particle(const dim2_opt_t *opt, const arrow_t *A, particle_t *p)
+{
+  ellipse_t E;
+  vector_t zero = {0, 0};
+
+  arrow_ellipse_r(&(opt->ctx->margin), A, &E);
+
+  p->v     = E.centre;
+  p->dv    = zero;
+  p->M     = ellipse_mt(E);
+  p->major = E.major;
+  p->minor = E.minor;
+  p->flag  = 0;
+}
+
+/*
+  warm start: rather than an initial grid, we seed the
+  dim2 particles with the arrows given in the options
+  (typically the placement of the previous frame of an
+  animation), re-evaluated for the current field. We
+  discard those which are outside the domain, have no
+  data, or which are within the cleaning radius of the
+  (fixed) dim 0/1 ellipses -- the latter found with a
+  kd-tree of the dim 0/1 centres.
+*/
+
+static int warm_start(const dim2_opt_t *opt, particle_t *p, int n1, int *pn2)
+{
+  const arrow_t *A0 = opt->v.place.adaptive.warm.A;
+  size_t nw = opt->v.place.adaptive.warm.n;
+  struct kdtree *kd;
+  double rmax = 0.0;
+  int n2 = 0;
+
+  if (!(kd = kd_create(2))) return ERROR_BUG;
+
+  for (int i = 0 ; i < n1 ; i++)
+    {
+      double v[2] = {p[i].v.x, p[i].v.y};
+
+      kd_insert(kd, v, p+i);
+      rmax = MAX(rmax, p[i].major);
+    }
+
+  for (size_t i = 0 ; i < nw ; i++)
+    {
+      arrow_t A;
+
+      A.centre = A0[i].centre;
+
+      if (! dindex_inside(A.centre, opt->dix)) continue;
+
+      int err = evaluate_r(&(opt->ctx->evaluate), &A);
+
+      if (err == ERROR_NODATA) continue;
+
+      if (err != ERROR_OK)
+	{
+	  kd_free(kd);
+	  return err;
+	}
+
+      particle_t *q = p + n1 + n2;
+
+      set_particle(opt, &A, q);
+
+      double v[2] = {q->v.x, q->v.y};
+      struct kdres *res;
+
+      if (!(res = kd_nearest_range(kd, v, q->major + rmax)))
+	{
+	  kd_free(kd);
+	  return ERROR_BUG;
+	}
+
+      bool isect = false;
+
+      while ((! isect) && (! kd_res_end(res)))
+	{
+	  particle_t *b = kd_res_item_data(res);
+
+	  isect = (contact_mt(vsub(b->v, q->v), q->M, b->M) <
+		   CLEAN_RADIUS*CLEAN_RADIUS);
+	  kd_res_next(res);
+	}
+
+      kd_res_free(res);
+
+      if (! isect) n2++;
+    }
+
+  kd_free(kd);
+
+  *pn2 = n2;
+
+  return ERROR_OK;
+}
+
 /* utility struct for kinetic energy drop -k option */
 
 typedef struct {
@@ -384,11 +473,19 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 
   double dt = opt->v.place.adaptive.timestep;
 
+  /*
+    the number of arrows for a warm start, and the
+    corresponding start time of the schedule
+  */
+
+  size_t nwarm = opt->v.place.adaptive.warm.n;
+  double T0 = (nwarm > 0 ? WARM_T0 : 0.0);
+
   /* initialise schedules */
 
   schedule_t schedB, schedI;
 
-  schedule(0.0, &schedB, &schedI);
+  schedule(T0, &schedB, &schedI);
 
   /*
     n1 number of dim 0/1 arrows
@@ -401,13 +498,15 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
   n2 = 0;
   n1 = na = *nA;
 
-  /* domain dimensions */
+  /* domain (or tile) dimensions */
+
+  bbox_t bb = (opt->tile ? *(opt->tile) : opt->v.bbox);
 
   double
-    w  = bbox_width(opt->v.bbox),
-    h  = bbox_height(opt->v.bbox),
-    x0 = opt->v.bbox.x.min,
-    y0 = opt->v.bbox.y.min;
+    w  = bbox_width(bb),
+    h  = bbox_height(bb),
+    x0 = bb.x.min,
+    y0 = bb.y.min;
 
   /*
     darea is supposed to be the area of the domain which
@@ -420,7 +519,15 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 
   double darea;
 
-  if (bilinear_defarea(opt->mt.a, &darea) != 0) return ERROR_BUG;
+  if (metric_tensor_defarea(opt->mt, &darea) != 0) return ERROR_BUG;
+
+  /*
+    for a tile we take the proportional area, so that the
+    density of the initial grid is that of the whole domain
+  */
+
+  if (opt->tile)
+    darea *= bbox_volume(bb)/bbox_volume(opt->v.bbox);
 
   /*
     estimate number we can fit in, the density of the optimal
@@ -436,7 +543,10 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 
   if (opt->v.verbose) status("estimate", no);
 
-  ni *= opt->v.place.adaptive.overfill;
+  if (nwarm > 0)
+    ni = nwarm;
+  else
+    ni *= opt->v.place.adaptive.overfill;
 
   if (ni<1)
     {
@@ -446,19 +556,28 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 
   /* find the grid size */
 
-  double R = w/h;
-  int
-    nx = (int)floor(sqrt(ni*R)),
-    ny = (int)floor(sqrt(ni/R));
+  int nx = 0, ny = 0;
 
-  if ((nx<1) || (ny<1))
+  if (nwarm == 0)
     {
-      fprintf(stderr,
-	      "bad initial dim2 grid is %ix%i, strange domain?\n", nx, ny);
-      return ERROR_NODATA;
-    }
+      double R = w/h;
 
-  if (opt->v.verbose) status("fill grid", nx*ny);
+      nx = (int)floor(sqrt(ni*R));
+      ny = (int)floor(sqrt(ni/R));
+
+      if ((nx<1) || (ny<1))
+	{
+	  fprintf(stderr,
+		  "bad initial dim2 grid is %ix%i, strange domain?\n", nx, ny);
+	  return ERROR_NODATA;
+	}
+
+      if (opt->v.verbose) status("fill grid", nx*ny);
+    }
+  else
+    {
+      if (opt->v.verbose) status("warm start", nwarm);
+    }
 
   /*
      allocate for ni > nx.ny, we will probably be
@@ -478,7 +597,7 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 
       /* FIXME - use mt instead */
 
-      arrow_ellipse((*pA)+i, &(E));
+      arrow_ellipse_r(&(opt->ctx->margin), (*pA)+i, &(E));
 
       p[i].M     = ellipse_mt(E);
       p[i].major = E.major;
@@ -504,21 +623,6 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 
   size_t nt = 1;
 
-#endif
-
-#ifdef HAVE_SIGNAL_H
-
-  static struct sigaction act, oldact;
-
-  act.sa_handler = setexitflag;
-  act.sa_flags   = 0;
-  sigemptyset(&act.sa_mask);
-
-  if (sigaction(SIGINT, &act, &oldact) == -1)
-    {
-      fprintf(stderr, "failed to install signal handler\n");
-    }
-
 #endif
 
   /* ratio of total ellipse area to domain area */
@@ -542,50 +646,86 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
       break;
     }
 
-  /* generate an initial dim2 particle set on a regular grid */
-
-  double dx = w/(nx+2);
-  double dy = h/(ny+2);
+  if (nwarm > 0)
+    {
+      /* seed the dim2 particle set from the given arrows */
 
-  for (int i = 0 ; i < nx ; i++)
+      if ((err = warm_start(opt, p, n1, &n2)) != ERROR_OK)
+	return err;
+    }
+  else
     {
-      double x = x0 + (i+1.5)*dx;
+      /* generate an initial dim2 particle set on a regular grid */
 
-      for (int j = 0 ; j < ny ; j++)
-        {
-          double y = y0 + (j+1.5)*dy;
-          vector_t v = {x, y};
+      double dx = w/(nx+2);
+      double dy = h/(ny+2);
 
-          if (! domain_inside(v, opt->dom)) continue;
+      /*
+	the grid is the interior of the lattice of centres
+	of an (nx+2) x (ny+2) grid on the bounding box
+      */
 
-	  arrow_t A;
+      unsigned char *mask;
 
-          A.centre = v;
+      if ((mask = malloc((nx+2)*(ny+2))) == NULL)
+	return ERROR_MALLOC;
 
-          err = evaluate(&A);
+      if (domain_mask_grid(opt->dom, bb, nx+2, ny+2, mask) != 0)
+	{
+	  free(mask);
+	  return ERROR_MALLOC;
+	}
 
-          switch (err)
-            {
-	      ellipse_t E;
+      for (int i = 0 ; i < nx ; i++)
+	{
+	  double x = x0 + (i+1.5)*dx;
 
-            case ERROR_OK :
-	      arrow_ellipse(&A, &E);
-	      p[n1+n2].v     = E.centre;
-	      p[n1+n2].dv    = zero;
-	      p[n1+n2].M     = ellipse_mt(E);
-	      p[n1+n2].major = E.major;
-	      p[n1+n2].minor = E.minor;
-	      p[n1+n2].flag  = 0;
-	      n2++ ;
-	      break;
-            case ERROR_NODATA: break;
-            default: return err;
-            }
-        }
+	  for (int j = 0 ; j < ny ; j++)
+	    {
+	      double y = y0 + (j+1.5)*dy;
+	      vector_t v = {x, y};
+
+	      if (! mask[(j+1)*(nx+2) + (i+1)]) continue;
+
+	      arrow_t A;
+
+	      A.centre = v;
+
+	      err = evaluate_r(&(opt->ctx->evaluate), &A);
+
+	      switch (err)
+		{
+		case ERROR_OK :
+		  set_particle(opt, &A, p+n1+n2);
+		  n2++ ;
+		  break;
+		case ERROR_NODATA: break;
+		default:
+		  free(mask);
+		  return err;
+		}
+	    }
+	}
+
+      free(mask);
     }
 
   if (opt->v.verbose) status("initial", n1+n2);
 
+  /*
+    the single-precision mirror of the particle array,
+    this is only ever refreshed for the first n1+n2
+    particles and n2 does not increase from here
+  */
+
+  particlef_t *pf = NULL;
+
+  if (opt->v.place.adaptive.single)
+    {
+      if ((pf = malloc((n1+n2)*sizeof(particlef_t))) == NULL)
+	return ERROR_MALLOC;
+    }
+
   /* initial neighbour mesh */
 
   int
@@ -767,7 +907,7 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
   wait_t wait;
 
   wait.drop = opt->v.place.adaptive.kedrop;
-  wait.iter = iter.main * DETRUNC_T1;
+  wait.iter = iter.main * (DETRUNC_T1 - T0)/(1.0 - T0);
   wait.kedB = 0.0;
   wait.done = ! (wait.drop > 0);
 
@@ -861,6 +1001,7 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
       for (int j = 0 ; j < iter.euler ; j++)
 	{
 	  T = ((double)(i*iter.euler + j))/((double)(iter.euler*iter.main));
+	  T = T0 + (1.0 - T0)*T;
 
 	  schedule(T, &schedB, &schedI);
 
@@ -890,7 +1031,7 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 	      for (int k = n1 ; k < n1+n2 ; k++)
 		{
 		  (*pA)[k].centre = p[k].v;
-		  evaluate((*pA)+k);
+		  evaluate_r(&(opt->ctx->evaluate), (*pA)+k);
 		}
 
 	      nbs_t* nbs = nbs_populate(nedge, edge, n1+n2, p);
@@ -944,8 +1085,23 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 		  flag[k] = 0;
 		}
 
+	      if (pf)
+		{
+		  for (int k = 0 ; k < n1+n2 ; k++)
+		    {
+		      pf[k].x      = p[k].v.x;
+		      pf[k].y      = p[k].v.y;
+		      pf[k].M[0]   = M2A(p[k].M);
+		      pf[k].M[1]   = M2B(p[k].M);
+		      pf[k].M[2]   = M2D(p[k].M);
+		      pf[k].charge = p[k].charge;
+		      pf[k].flag   = p[k].flag;
+		    }
+		}
+
 	      tshared.edge = edge;
 	      tshared.p = p;
+	      tshared.pf = pf;
 	      tshared.rd = schedI.rd;
 	      tshared.rt = schedI.rt;
 	      tshared.n1 = n1;
@@ -1187,7 +1343,8 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 	{
 	  if (GET_FLAG(p[j].flag, PARTICLE_STALE)) continue;
 
-	  if (! domain_inside(p[j].v, opt->dom))
+	  if ((! dindex_inside(p[j].v, opt->dix)) ||
+	      (opt->tile && ! bbox_contains(bb, p[j].v)))
 	    {
 	      SET_FLAG(p[j].flag, PARTICLE_STALE);
 	      nesc++;
@@ -1313,18 +1470,14 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
 	  break;
 	}
 
-#ifdef HAVE_SIGNAL_H
+      /* halt requested, by SIGINT or vfplot_context_halt() */
 
-      if (exitflag)
+      if (opt->ctx->halt)
 	{
-	  if (sigaction(SIGINT, &oldact, NULL) == -1)
-	    fprintf(stderr, "failed to restore signal handler\n");
-
+	  if (opt->v.verbose) printf("[halt]\n");
 	  goto output;
 	}
 
-#endif
-
     }
 
   if (opt->v.verbose)
@@ -1406,12 +1559,13 @@ extern int dim2(dim2_opt_t *opt, size_t *nA, arrow_t **pA, size_t *nN, nbs_t **p
   for (int i = n1 ; i < n1+n2 ; i++)
     {
       (*pA)[i].centre = p[i].v;
-      evaluate((*pA)+i);
+      evaluate_r(&(opt->ctx->evaluate), (*pA)+i);
     }
 
   *nA = n1+n2;
 
   free(p);
+  free(pf);
 
 #ifdef PTHREAD_FORCES
 
@@ -1803,6 +1957,8 @@ static void* forces(tdata_t* pt)
   tdata_t t = *pt;
   tshared_t s = *(t.shared);
 
+  if (s.pf) return forcesf(pt);
+
   for (int i = 0 ; i < t.size ; i++)
     {
       int k = i+t.off;
@@ -1860,3 +2016,66 @@ static void* forces(tdata_t* pt)
 
   return NULL;
 }
+
+/*
+  as forces(), but with the pw-distance and force calculated
+  in single precision from the particlef_t mirror, only the
+  accumulation of the forces is in double precision
+*/
+
+static void* forcesf(tdata_t* pt)
+{
+  tdata_t t = *pt;
+  tshared_t s = *(t.shared);
+  float rt = s.rt, rd = s.rd;
+
+  for (int i = 0 ; i < t.size ; i++)
+    {
+      int k = i+t.off;
+      int idA = s.edge[2*k], idB = s.edge[2*k+1];
+      const particlef_t *pA = s.pf + idA, *pB = s.pf + idB;
+      float
+	rx = pB->x - pA->x,
+	ry = pB->y - pA->y,
+	x  = contact_mtf(rx, ry, pA->M, pB->M);
+
+      if (x<0)
+	{
+	  vector_t rAB = {rx, ry};
+	  pw_error(rAB, s.p[idA], s.p[idB]);
+	  continue;
+	}
+
+      float
+	d  = sqrtf(x),
+	r  = sqrtf(rx*rx + ry*ry),
+	f  = forcef(d, rt, DETRUNC_R0) * pA->charge * pB->charge * 60;
+      vector_t
+	fAB = {f*rx/r, f*ry/r};
+
+      if (GET_FLAG(pA->flag, PARTICLE_FIXED))
+	{
+	  if (! GET_FLAG(pB->flag, PARTICLE_FIXED))
+	    {
+	      t.F[idB-s.n1] = vadd(t.F[idB-s.n1], fAB);
+
+	      if (d < rd)
+		SET_FLAG(t.flag[idB-s.n1], PARTICLE_STALE);
+	    }
+	}
+      else
+	{
+	  t.F[idA-s.n1] = vsub(t.F[idA-s.n1], fAB);
+
+	  if (GET_FLAG(pB->flag, PARTICLE_FIXED))
+	    {
+	      if (d < rd)
+		SET_FLAG(t.flag[idA-s.n1], PARTICLE_STALE);
+	    }
+	  else
+	    t.F[idB-s.n1] = vadd(t.F[idB-s.n1], fAB);
+	}
+    }
+
+  return NULL;
+}
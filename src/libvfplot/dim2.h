@@ -8,10 +8,13 @@
 #define DIM2_H
 
 #include "domain.h"
+#include "dindex.h"
 #include "ellipse.h"
 #include "arrow.h"
 #include "nbs.h"
 #include "mt.h"
+#include "context.h"
+#include "bbox.h"
 
 #include "vfplot.h"
 
@@ -20,9 +23,21 @@ typedef struct
   vfp_opt_t v;
   double area;
   const domain_t* dom;
+  const dindex_t* dix;
   mt_t mt;
+  vfp_context_t *ctx;
+  const bbox_t *tile;
 } dim2_opt_t;
 
+/*
+  the index dix of the domain is used for the tests of
+  whether particles are inside it.
+
+  if the tile is non-NULL then the dynamics are restricted
+  to it: the initial grid covers the tile rather than the
+  bounding box, and particles leaving it are discarded
+*/
+
 extern int dim2(dim2_opt_t*, size_t*, arrow_t**, size_t*, nbs_t**);
 
 #endif
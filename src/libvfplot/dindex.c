@@ -0,0 +1,358 @@
+/*
+  dindex.c
+  an index of a domain for fast point-in-domain tests
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "dindex.h"
+#include "macros.h"
+
+/*
+  the grid has about as many cells as there are edges,
+  with at most DINDEX_MAX cells on each side
+*/
+
+#define DINDEX_MAX 1024
+
+/*
+  the cells are extended by this (relative) amount when
+  listing the edges which meet them, so that rounding in
+  the calculation of a crossing cannot put it in a cell
+  which does not list the edge
+*/
+
+#define DINDEX_PAD 1e-9
+
+typedef struct
+{
+  vector_t a, b;
+} dedge_t;
+
+struct dindex_t
+{
+  size_t ne;
+  dedge_t *edge;
+  bbox_t bb;
+  double dx, dy, pad;
+  int nx, ny;
+  size_t *start, *list;
+  unsigned char *inside;
+};
+
+/*
+  the domain edges, as in polyline_inside(); a horizontal
+  edge never crosses a horizontal line, but it does mark
+  the cells it meets as being on the boundary
+*/
+
+typedef struct
+{
+  size_t n;
+  dedge_t *edge;
+} dedges_t;
+
+static int edges_add(const domain_t *dom, dedges_t *E, int level)
+{
+  polyline_t p = dom->p;
+
+  for (int i = 0, j = p.n-1 ; i < p.n ; j = i++)
+    {
+      if (E->edge)
+	{
+	  E->edge[E->n].a = p.v[i];
+	  E->edge[E->n].b = p.v[j];
+	}
+
+      E->n++;
+    }
+
+  return 0;
+}
+
+/* the cell of t, clamped to the grid */
+
+static int cell_of(double t, double t0, double d, int n)
+{
+  double k = floor((t - t0)/d);
+
+  if (!(k > 0)) return 0;
+  if (k > n-1) return n-1;
+
+  return (int)k;
+}
+
+/*
+  whether the edge crosses the horizontal line at y, and
+  if so the x-value of the crossing, evaluated exactly as
+  in polyline_inside()
+*/
+
+static int edge_crossing(const dedge_t *e, double y, double *x)
+{
+  vector_t a = e->a, b = e->b;
+
+  if (((a.y <= y) && (y < b.y)) || ((b.y <= y) && (y < a.y)))
+    {
+      *x = (b.x - a.x) * (y - a.y) / (b.y - a.y) + a.x;
+      return 1;
+    }
+
+  return 0;
+}
+
+/*
+  the range of cells in row r which the edge e meets,
+  returns zero if it does not meet the row
+*/
+
+static int edge_cells(const dindex_t *ix, const dedge_t *e, int r,
+		      int *k0, int *k1)
+{
+  vector_t a = e->a, b = e->b;
+  double
+    lo = ix->bb.y.min + r*ix->dy - ix->pad,
+    hi = ix->bb.y.min + (r+1)*ix->dy + ix->pad,
+    y0 = MAX(MIN(a.y, b.y), lo),
+    y1 = MIN(MAX(a.y, b.y), hi);
+
+  if (y0 > y1) return 0;
+
+  double x0 = a.x, x1 = b.x;
+
+  if (a.y != b.y)
+    {
+      x0 = a.x + (b.x - a.x) * (y0 - a.y) / (b.y - a.y);
+      x1 = a.x + (b.x - a.x) * (y1 - a.y) / (b.y - a.y);
+    }
+
+  *k0 = cell_of(MIN(x0, x1) - ix->pad, ix->bb.x.min, ix->dx, ix->nx);
+  *k1 = cell_of(MAX(x0, x1) + ix->pad, ix->bb.x.min, ix->dx, ix->nx);
+
+  return 1;
+}
+
+/*
+  list the edges in each cell, with a counting pass, then
+  a filling pass (CSR)
+*/
+
+static int dindex_fill(dindex_t *ix)
+{
+  size_t nc = (size_t)ix->nx * ix->ny;
+
+  if (!(ix->start = calloc(nc+1, sizeof(size_t))))
+    return 1;
+
+  for (int pass = 0 ; pass < 2 ; pass++)
+    {
+      for (size_t i = 0 ; i < ix->ne ; i++)
+	{
+	  const dedge_t *e = ix->edge + i;
+	  int
+	    r0 = cell_of(MIN(e->a.y, e->b.y) - ix->pad,
+			 ix->bb.y.min, ix->dy, ix->ny),
+	    r1 = cell_of(MAX(e->a.y, e->b.y) + ix->pad,
+			 ix->bb.y.min, ix->dy, ix->ny);
+
+	  for (int r = r0 ; r <= r1 ; r++)
+	    {
+	      int k0, k1;
+
+	      if (! edge_cells(ix, e, r, &k0, &k1)) continue;
+
+	      for (int k = k0 ; k <= k1 ; k++)
+		{
+		  size_t c = (size_t)r * ix->nx + k;
+
+		  if (pass == 0)
+		    ix->start[c+1]++;
+		  else
+		    ix->list[ix->start[c]++] = i;
+		}
+	    }
+	}
+
+      if (pass == 0)
+	{
+	  for (size_t c = 0 ; c < nc ; c++)
+	    ix->start[c+1] += ix->start[c];
+
+	  size_t nl = ix->start[nc];
+
+	  if (!(ix->list = malloc((nl ? nl : 1)*sizeof(size_t))))
+	    return 1;
+	}
+      else
+	{
+	  /* the fill has moved each start to the next */
+
+	  for (size_t c = nc ; c > 0 ; c--)
+	    ix->start[c] = ix->start[c-1];
+	  ix->start[0] = 0;
+	}
+    }
+
+  return 0;
+}
+
+/*
+  the crossings of the line at y in cell k of row r, that
+  is, those whose x-value is in the cell and greater than x
+*/
+
+static int cell_crossings(const dindex_t *ix, int r, int k,
+			  double x, double y)
+{
+  size_t c = (size_t)r * ix->nx + k;
+  int n = 0;
+
+  for (size_t l = ix->start[c] ; l < ix->start[c+1] ; l++)
+    {
+      double xc;
+
+      if (edge_crossing(ix->edge + ix->list[l], y, &xc) &&
+	  (x < xc) &&
+	  (cell_of(xc, ix->bb.x.min, ix->dx, ix->nx) == k))
+	n++;
+    }
+
+  return n;
+}
+
+/*
+  a cell with no edges is inside if the line through it
+  has an odd number of crossings to its right, this does
+  not depend on the height of the line in the row (else
+  an edge would meet the cell), so we sweep along the
+  line through the middle of the row from the right
+*/
+
+static void dindex_classify(dindex_t *ix)
+{
+  for (int r = 0 ; r < ix->ny ; r++)
+    {
+      double y = ix->bb.y.min + (r + 0.5)*ix->dy;
+      int odd = 0;
+
+      for (int k = ix->nx-1 ; k >= 0 ; k--)
+	{
+	  size_t c = (size_t)r * ix->nx + k;
+
+	  if (ix->start[c] == ix->start[c+1])
+	    ix->inside[c] = odd;
+	  else
+	    odd ^= (cell_crossings(ix, r, k, -INFINITY, y) & 1);
+	}
+    }
+}
+
+extern dindex_t* dindex_new(const domain_t *dom)
+{
+  dindex_t *ix;
+
+  if (!(ix = malloc(sizeof(dindex_t))))
+    return NULL;
+
+  ix->ne = 0;
+  ix->edge = NULL;
+  ix->nx = ix->ny = 0;
+  ix->start = ix->list = NULL;
+  ix->inside = NULL;
+
+  dedges_t E = {0, NULL};
+
+  domain_iterate(dom, (difun_t)edges_add, &E);
+
+  if (E.n == 0) return ix;
+
+  if (!(E.edge = malloc(E.n * sizeof(dedge_t))))
+    goto failed;
+
+  ix->edge = E.edge;
+  E.n = 0;
+
+  domain_iterate(dom, (difun_t)edges_add, &E);
+
+  ix->ne = E.n;
+  ix->bb = domain_bbox(dom);
+  ix->pad = DINDEX_PAD *
+    (fabs(ix->bb.x.min) + fabs(ix->bb.x.max) +
+     fabs(ix->bb.y.min) + fabs(ix->bb.y.max) +
+     bbox_width(ix->bb) + bbox_height(ix->bb));
+
+  if (!(ix->pad > 0)) ix->pad = DINDEX_PAD;
+
+  ix->bb.x.min -= ix->pad;
+  ix->bb.x.max += ix->pad;
+  ix->bb.y.min -= ix->pad;
+  ix->bb.y.max += ix->pad;
+
+  int n = (int)ceil(sqrt(ix->ne));
+
+  ix->nx = ix->ny = MAX(1, MIN(n, DINDEX_MAX));
+  ix->dx = bbox_width(ix->bb)/ix->nx;
+  ix->dy = bbox_height(ix->bb)/ix->ny;
+
+  if (dindex_fill(ix) != 0)
+    goto failed;
+
+  if (!(ix->inside = malloc((size_t)ix->nx * ix->ny)))
+    goto failed;
+
+  dindex_classify(ix);
+
+  return ix;
+
+ failed:
+
+  dindex_destroy(ix);
+
+  return NULL;
+}
+
+extern void dindex_destroy(dindex_t *ix)
+{
+  if (!ix) return;
+
+  free(ix->edge);
+  free(ix->start);
+  free(ix->list);
+  free(ix->inside);
+  free(ix);
+}
+
+/*
+  the parity of the crossings to the right of v, the
+  crossings in each cell being counted until we reach
+  one with no edges, whose parity we know; outside the
+  bounding box there are an even number
+*/
+
+extern int dindex_inside(vector_t v, const dindex_t *ix)
+{
+  if ((ix->ne == 0) || ! bbox_contains(ix->bb, v))
+    return 0;
+
+  int
+    r = cell_of(v.y, ix->bb.y.min, ix->dy, ix->ny),
+    k = cell_of(v.x, ix->bb.x.min, ix->dx, ix->nx),
+    odd = 0;
+
+  for ( ; k < ix->nx ; k++)
+    {
+      size_t c = (size_t)r * ix->nx + k;
+
+      if (ix->start[c] == ix->start[c+1])
+	return odd ^ ix->inside[c];
+
+      odd ^= (cell_crossings(ix, r, k, v.x, v.y) & 1);
+    }
+
+  return odd;
+}
@@ -0,0 +1,34 @@
+/*
+  dindex.h
+  an index of a domain for fast point-in-domain tests
+*/
+
+#ifndef DINDEX_H
+#define DINDEX_H
+
+#include "domain.h"
+#include "vector.h"
+
+/*
+  a uniform grid over the domain bounding box, each cell
+  holding the list of the edges of the domain which may
+  cross a horizontal line through it.  A cell with no edges
+  is entirely inside or outside, and that is recorded, so
+  dindex_inside() only needs to test the edges of the cells
+  between the point and the next such cell along the line
+  to its right.
+
+  The result is that of the crossing test of polyline_inside()
+  applied to all of the edges of the domain at once, which is
+  the same as domain_inside() since the peers of a domain are
+  disjoint and the children contained in their parent.
+*/
+
+typedef struct dindex_t dindex_t;
+
+extern dindex_t* dindex_new(const domain_t*);
+extern void dindex_destroy(dindex_t*);
+
+extern int dindex_inside(vector_t, const dindex_t*);
+
+#endif
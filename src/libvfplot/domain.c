@@ -259,6 +259,100 @@ extern int domain_inside(const vector_t v, const domain_t *dom)
   return domain_inside(v, dom->peer);
 }
 
+/*
+  the inside mask of the lattice of the centres of an
+  nx x ny grid on the bounding box bb, mask[j*nx+i] for
+  the i-th centre in x and the j-th in y.
+
+  for each row we find the crossings of the horizontal
+  line through it with all of the edges (evaluated as in
+  polyline_inside), and sort them, then the point is
+  inside if there are an odd number to its right. As for
+  domain_inside(), this relies on the peers of a domain
+  being disjoint and the children in their parent.
+*/
+
+typedef struct
+{
+  double y;
+  size_t n, alloc;
+  double *x;
+} mask_row_t;
+
+static int mask_row_add(const domain_t *dom, mask_row_t *R, int level)
+{
+  polyline_t p = dom->p;
+  double y = R->y;
+
+  for (int i = 0, j = p.n-1 ; i < p.n ; j = i++)
+    {
+      if (((p.v[i].y <= y) && (y < p.v[j].y)) ||
+	  ((p.v[j].y <= y) && (y < p.v[i].y)))
+	{
+	  if (R->n == R->alloc)
+	    {
+	      size_t alloc = (R->alloc ? 2*R->alloc : 64);
+	      double *x;
+
+	      if ((x = realloc(R->x, alloc*sizeof(double))) == NULL)
+		return 1;
+
+	      R->x = x;
+	      R->alloc = alloc;
+	    }
+
+	  R->x[R->n++] = (p.v[j].x - p.v[i].x) * (y - p.v[i].y) /
+	    (p.v[j].y - p.v[i].y) + p.v[i].x;
+	}
+    }
+
+  return 0;
+}
+
+static int dcmp(const double *a, const double *b)
+{
+  return (*a > *b) - (*a < *b);
+}
+
+extern int domain_mask_grid(const domain_t *dom, bbox_t bb,
+			    int nx, int ny, unsigned char *mask)
+{
+  double
+    dx = bbox_width(bb)/nx,
+    dy = bbox_height(bb)/ny;
+  mask_row_t R = {0.0, 0, 0, NULL};
+
+  for (int j = 0 ; j < ny ; j++)
+    {
+      R.y = bb.y.min + (j + 0.5)*dy;
+      R.n = 0;
+
+      if (domain_iterate(dom, (difun_t)mask_row_add, &R) != 0)
+	{
+	  free(R.x);
+	  return 1;
+	}
+
+      qsort(R.x, R.n, sizeof(double),
+	    (int (*)(const void*, const void*))dcmp);
+
+      size_t k = 0;
+
+      for (int i = 0 ; i < nx ; i++)
+	{
+	  double x = bb.x.min + (i + 0.5)*dx;
+
+	  while ((k < R.n) && (R.x[k] <= x)) k++;
+
+	  mask[j*nx + i] = (R.n - k) & 1;
+	}
+    }
+
+  free(R.x);
+
+  return 0;
+}
+
 /*
   file write routines
 
@@ -42,6 +42,7 @@ extern domain_t* domain_insert(domain_t*, const polyline_t*);
 extern int domain_orientate(domain_t*);
 
 extern int domain_inside(vector_t, const domain_t*);
+extern int domain_mask_grid(const domain_t*, bbox_t, int, int, unsigned char*);
 extern bbox_t domain_bbox(const domain_t*);
 extern int domain_scale(domain_t*, double, double, double);
 
@@ -16,6 +16,7 @@
 #endif
 
 #include <math.h>
+#include <stdlib.h>
 
 #include "evaluate.h"
 
@@ -25,50 +26,75 @@
 #include "error.h"
 
 
-static vfun_t fv;
-static cfun_t fc;
-static void *field;
-static double aspect;
+/*
+  the registered field, used by evaluate(); callers which
+  need to be reentrant should use their own evaluate_t and
+  evaluate_r() instead
+*/
+
+static evaluate_t registered = {NULL, NULL, NULL, NULL, NULL, NULL, 0.0};
 
 /* this must be called before the first evaluate() call */
 
 extern int evaluate_register(vfun_t nfv,cfun_t nfc,void* nfld,double nasp)
 {
-  fv     = nfv;
-  fc     = nfc;
-  field  = nfld;
-  aspect = nasp;
+  registered.fv     = nfv;
+  registered.fc     = nfc;
+  registered.field  = nfld;
+  registered.aspect = nasp;
 
   return ERROR_OK;
 }
 
 extern int evaluate(arrow_t* A)
 {
+  return evaluate_r(&registered, A);
+}
+
+/*
+  complete the arrow A given the field direction theta and
+  magnitude mag at its centre, and the curvature if kappa is
+  not NULL
+*/
+
+static int evaluate_complete(const evaluate_t *E, arrow_t* A,
+			     double theta, double mag,
+			     const double *kappa)
+{
+  cfun_t fc = E->fc;
+  void *field = E->field;
+  double aspect = E->aspect;
   double x = A->centre.x, y = A->centre.y;
-  double theta, mag, curv;
+  double curv;
   bend_t bend;
 
-  if (fv(field, x, y, &theta, &mag) != 0)
+  if (kappa)
     {
-#ifdef DEBUG
-      printf("(%.0f,%.0f) fails fv\n", x, y);
-#endif
-      return ERROR_NODATA;
+      if (isnan(curv = *kappa)) return ERROR_NODATA;
     }
-
-  if (fc)
+  else if (fc)
     {
       if (fc(field, x, y, &curv) != 0)
 	{
 #ifdef DEBUG
 	  printf("(%.0f,%.0f) fails fc\n",x, y);
+#endif
+	  return ERROR_NODATA;
+	}
+    }
+  else if (E->fj)
+    {
+      if (curvature_jacobian(E->fj, field, x, y, &curv) != 0)
+	{
+#ifdef DEBUG
+	  printf("(%.0f,%.0f) fails fj\n",x, y);
 #endif
 	  return ERROR_NODATA;
 	}
     }
   else
     {
-      if (curvature(fv, field, x, y, aspect, &curv) != 0)
+      if (curvature(E->fv, field, x, y, aspect, &curv) != 0)
 	{
 #ifdef DEBUG
 	  printf("(%.0f,%.0f) fails curvature\n",x,y);
@@ -94,3 +120,137 @@ extern int evaluate(arrow_t* A)
 
   return ERROR_OK;
 }
+
+static int evaluate_field(const evaluate_t *E, arrow_t* A)
+{
+  double x = A->centre.x, y = A->centre.y;
+  double theta, mag;
+
+  if (E->fv(E->field, x, y, &theta, &mag) != 0)
+    {
+#ifdef DEBUG
+      printf("(%.0f,%.0f) fails fv\n", x, y);
+#endif
+      return ERROR_NODATA;
+    }
+
+  return evaluate_complete(E, A, theta, mag, NULL);
+}
+
+extern int evaluate_r(const evaluate_t *E, arrow_t* A)
+{
+  if (! E->cache) return evaluate_field(E, A);
+
+  int err;
+
+  if (evcache_lookup(E->cache, A, &err)) return err;
+
+  err = evaluate_field(E, A);
+
+  switch (err)
+    {
+    case ERROR_OK:
+    case ERROR_NODATA:
+      evcache_store(E->cache, A, err);
+      break;
+    }
+
+  return err;
+}
+
+/*
+  evaluate the n arrows A (given their centres) with the
+  batch field function if there is one, the status of each
+  (ERROR_OK or ERROR_NODATA) is written to err, the return
+  value is not ERROR_OK only on failure.  If the curvature
+  is found numerically then the streamlines of all of the
+  arrows are traced together with curvature_batch().
+
+  The vfplot program always registers a curvature function
+  (or a Jacobian) with its batch function, so the batched
+  numeric curvature is only used by library callers which
+  register just fv and fvb.
+*/
+
+extern int evaluate_batch_r(const evaluate_t *E, size_t n,
+			    arrow_t *A, int *err)
+{
+  if (! E->fvb)
+    {
+      for (size_t k = 0 ; k < n ; k++)
+	{
+	  switch (err[k] = evaluate_r(E, A + k))
+	    {
+	    case ERROR_OK:
+	    case ERROR_NODATA:
+	      break;
+	    default:
+	      return err[k];
+	    }
+	}
+
+      return ERROR_OK;
+    }
+
+  if (n == 0) return ERROR_OK;
+
+  bool numeric = !(E->fc || E->fj);
+  double *v;
+
+  if ((v = malloc((numeric ? 6 : 4)*n*sizeof(double))) == NULL)
+    return ERROR_MALLOC;
+
+  double
+    *x = v,
+    *y = v + n,
+    *theta = v + 2*n,
+    *mag = v + 3*n;
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      x[k] = A[k].centre.x;
+      y[k] = A[k].centre.y;
+    }
+
+  if (E->fvb(E->field, n, x, y, theta, mag) != 0)
+    {
+      free(v);
+      return ERROR_BUG;
+    }
+
+  double *curv = NULL;
+
+  if (numeric)
+    {
+      double *len = v + 4*n, wdt;
+
+      curv = v + 5*n;
+
+      for (size_t k = 0 ; k < n ; k++)
+	{
+	  if (isnan(theta[k]) ||
+	      (aspect_fixed(E->aspect, mag[k], len + k, &wdt) != 0))
+	    len[k] = NAN;
+	}
+
+      int cerr = curvature_batch(E->fvb, E->field, n, x, y, len, curv);
+
+      if (cerr != ERROR_OK)
+	{
+	  free(v);
+	  return cerr;
+	}
+    }
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      err[k] = (isnan(theta[k]) ?
+		ERROR_NODATA :
+		evaluate_complete(E, A + k, theta[k], mag[k],
+				  (curv ? curv + k : NULL)));
+    }
+
+  free(v);
+
+  return ERROR_OK;
+}
@@ -8,9 +8,34 @@
 #define EVALUATE_H
 
 #include "arrow.h"
+#include "evcache.h"
 #include "vfplot.h"
 
+/*
+  the field functions and aspect needed to evaluate an
+  arrow, fc may be NULL in which case the curvature is
+  found from fj if that is not NULL, otherwise numerically
+  from fv (see curvature.h), and fvb may be NULL in which
+  case evaluate_batch_r() calls fv for each arrow; if
+  cache is not NULL then evaluate_r() looks up the arrow
+  in it before evaluating, and stores the result after
+  (see evcache.h)
+*/
+
+typedef struct
+{
+  vfun_t fv;
+  cfun_t fc;
+  vfun_batch_t fvb;
+  jfun_t fj;
+  evcache_t *cache;
+  void *field;
+  double aspect;
+} evaluate_t;
+
 extern int evaluate_register(vfun_t,cfun_t,void*,double);
 extern int evaluate(arrow_t*);
+extern int evaluate_r(const evaluate_t*, arrow_t*);
+extern int evaluate_batch_r(const evaluate_t*, size_t, arrow_t*, int*);
 
 #endif
@@ -0,0 +1,271 @@
+/*
+  evcache.c
+  memoisation of arrow evaluations by position
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "evcache.h"
+
+typedef struct
+{
+  uint64_t kx, ky;
+  arrow_t A;
+  int used, err;
+} evc_entry_t;
+
+typedef struct
+{
+  evcache_t *cache;
+  size_t hit, miss;
+  evc_entry_t entry[];
+} evc_table_t;
+
+struct evcache_t
+{
+  size_t n;
+  unsigned shift;
+  double quantum;
+  size_t hit, miss;
+#ifdef HAVE_PTHREAD_H
+  pthread_key_t key;
+  pthread_mutex_t mutex;
+#else
+  evc_table_t *table;
+#endif
+};
+
+/* add the counts of a table to the totals */
+
+static void evc_table_harvest(evc_table_t *T)
+{
+  evcache_t *C = T->cache;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(C->mutex));
+#endif
+
+  C->hit  += T->hit;
+  C->miss += T->miss;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(C->mutex));
+#endif
+
+  T->hit = T->miss = 0;
+}
+
+static void evc_table_free(evc_table_t *T)
+{
+  evc_table_harvest(T);
+  free(T);
+}
+
+#ifdef HAVE_PTHREAD_H
+
+static void evc_table_destructor(void *T)
+{
+  evc_table_free(T);
+}
+
+#endif
+
+/* the size is rounded up to a power of 2 */
+
+extern evcache_t* evcache_new(size_t n, double quantum)
+{
+  evcache_t *C;
+
+  if ((C = malloc(sizeof(evcache_t))) == NULL)
+    return NULL;
+
+  unsigned bits = 1;
+
+  while (((size_t)1 << bits) < n) bits++;
+
+  C->n       = (size_t)1 << bits;
+  C->shift   = 64 - bits;
+  C->quantum = quantum;
+  C->hit     = 0;
+  C->miss    = 0;
+
+#ifdef HAVE_PTHREAD_H
+
+  if (pthread_key_create(&(C->key), evc_table_destructor) != 0)
+    {
+      free(C);
+      return NULL;
+    }
+
+  if (pthread_mutex_init(&(C->mutex), NULL) != 0)
+    {
+      pthread_key_delete(C->key);
+      free(C);
+      return NULL;
+    }
+
+#else
+
+  C->table = NULL;
+
+#endif
+
+  return C;
+}
+
+/*
+  only the table of the calling thread (if any) is freed
+  here, those of other threads are freed when they exit,
+  so this must be called after the threads using the cache
+  have been joined
+*/
+
+extern void evcache_destroy(evcache_t *C)
+{
+  if (!C) return;
+
+#ifdef HAVE_PTHREAD_H
+
+  evc_table_t *T = pthread_getspecific(C->key);
+
+  if (T) free(T);
+
+  pthread_key_delete(C->key);
+  pthread_mutex_destroy(&(C->mutex));
+
+#else
+
+  free(C->table);
+
+#endif
+
+  free(C);
+}
+
+extern void evcache_stats(evcache_t *C, size_t *hit, size_t *miss)
+{
+#ifdef HAVE_PTHREAD_H
+  evc_table_t *T = pthread_getspecific(C->key);
+#else
+  evc_table_t *T = C->table;
+#endif
+
+  if (T) evc_table_harvest(T);
+
+  *hit  = C->hit;
+  *miss = C->miss;
+}
+
+/* the table of the calling thread, allocated on first use */
+
+static evc_table_t* evc_table(evcache_t *C)
+{
+#ifdef HAVE_PTHREAD_H
+  evc_table_t *T = pthread_getspecific(C->key);
+#else
+  evc_table_t *T = C->table;
+#endif
+
+  if (T) return T;
+
+  if ((T = calloc(1, sizeof(evc_table_t) + C->n*sizeof(evc_entry_t))) == NULL)
+    return NULL;
+
+  T->cache = C;
+
+#ifdef HAVE_PTHREAD_H
+  if (pthread_setspecific(C->key, T) != 0)
+    {
+      free(T);
+      return NULL;
+    }
+#else
+  C->table = T;
+#endif
+
+  return T;
+}
+
+/* the key of a coordinate, and the slot of a pair of keys */
+
+static uint64_t evc_key(const evcache_t *C, double x)
+{
+  uint64_t k;
+
+  if (C->quantum > 0)
+    k = (uint64_t)(int64_t)floor(x/C->quantum);
+  else
+    memcpy(&k, &x, sizeof(k));
+
+  return k;
+}
+
+static size_t evc_slot(const evcache_t *C, uint64_t kx, uint64_t ky)
+{
+  uint64_t h = (kx * 0x9E3779B97F4A7C15ULL) ^ (ky * 0xC2B2AE3D27D4EB4FULL);
+
+  return (h ^ (h >> 29)) * 0xBF58476D1CE4E5B9ULL >> C->shift;
+}
+
+/*
+  if the evaluation of the arrow with the centre of A is in
+  the cache then complete A, set the status of the evaluation
+  in err and return nonzero, otherwise return zero
+*/
+
+extern int evcache_lookup(evcache_t *C, arrow_t *A, int *err)
+{
+  evc_table_t *T;
+
+  if ((T = evc_table(C)) == NULL) return 0;
+
+  uint64_t
+    kx = evc_key(C, A->centre.x),
+    ky = evc_key(C, A->centre.y);
+  evc_entry_t *e = T->entry + evc_slot(C, kx, ky);
+
+  if (e->used && (e->kx == kx) && (e->ky == ky))
+    {
+      vector_t centre = A->centre;
+
+      *A = e->A;
+      A->centre = centre;
+      *err = e->err;
+      T->hit++;
+
+      return 1;
+    }
+
+  T->miss++;
+
+  return 0;
+}
+
+extern void evcache_store(evcache_t *C, const arrow_t *A, int err)
+{
+  evc_table_t *T;
+
+  if ((T = evc_table(C)) == NULL) return;
+
+  uint64_t
+    kx = evc_key(C, A->centre.x),
+    ky = evc_key(C, A->centre.y);
+  evc_entry_t *e = T->entry + evc_slot(C, kx, ky);
+
+  e->kx   = kx;
+  e->ky   = ky;
+  e->A    = *A;
+  e->err  = err;
+  e->used = 1;
+}
@@ -0,0 +1,40 @@
+/*
+  evcache.h
+  memoisation of arrow evaluations by position
+*/
+
+#ifndef EVCACHE_H
+#define EVCACHE_H
+
+#include <stdlib.h>
+
+#include "arrow.h"
+
+/*
+  a bounded hash table of the results of evaluate_r()
+  keyed on the arrow centre; if the quantum is positive
+  then the centre is rounded to a grid of that spacing
+  (so that a hit may return the evaluation at a nearby
+  point), otherwise only identical centres match.  The
+  table is direct-mapped, a new entry replacing any old
+  one in its slot.
+
+  Each thread using the cache gets its own table of the
+  given number of entries, so that no locking is needed
+  on lookup.  The hit and miss counts of a thread's table
+  are added to the totals (see evcache_stats) when the
+  thread exits, or for the calling thread, when the stats
+  are requested.
+*/
+
+typedef struct evcache_t evcache_t;
+
+extern evcache_t* evcache_new(size_t, double);
+extern void evcache_destroy(evcache_t*);
+
+extern int evcache_lookup(evcache_t*, arrow_t*, int*);
+extern void evcache_store(evcache_t*, const arrow_t*, int);
+
+extern void evcache_stats(evcache_t*, size_t*, size_t*);
+
+#endif
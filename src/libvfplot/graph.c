@@ -5,17 +5,36 @@
   J.J.Green 2007
 */
 
+#include <stdint.h>
+
 #include "graph.h"
 
+/* the initial size of the edge arena */
+
+#define EDGES_INIT 64
+
+struct graph_edges_t
+{
+  size_t n, alloc, (*pair)[2];
+  size_t *start, *adj;
+  int compiled;
+};
+
 extern int graph_init(size_t n,graph_t* G)
 {
   node_t *node;
+  graph_edges_t *edges;
+
+  G->n = 0;
+  G->node = NULL;
+  G->edges = NULL;
+
+  if (!(edges = malloc(sizeof(graph_edges_t))))
+    return 1;
 
   if (!(node = malloc(n*sizeof(node_t))))
     {
-      G->n = 0;
-      G->node = NULL;
-
+      free(edges);
       return 1;
     }
 
@@ -26,26 +45,40 @@ extern int graph_init(size_t n,graph_t* G)
       node[i].flag   = 0;
       node[i].weight = 0.0;
       node[i].n      = 0;
-      node[i].edge   = NULL;
     }
 
+  edges->n        = 0;
+  edges->alloc    = 0;
+  edges->pair     = NULL;
+  edges->start    = NULL;
+  edges->adj      = NULL;
+  edges->compiled = 0;
+
   G->n = n;
   G->node = node;
+  G->edges = edges;
 
   return 0;
 }
 
 extern void graph_clean(graph_t *G)
 {
-  if (G->n)
+  if (G->edges)
     {
-      if (G->node)
-	{
-	  free(G->node);
-	  G->node = NULL;
-	}
-      G->n=0;
+      free(G->edges->pair);
+      free(G->edges->start);
+      free(G->edges->adj);
+      free(G->edges);
+      G->edges = NULL;
     }
+
+  if (G->node)
+    {
+      free(G->node);
+      G->node = NULL;
+    }
+
+  G->n = 0;
 }
 
 /* weight access function */
@@ -101,35 +134,103 @@ extern int graph_node_flag(graph_t G,size_t i,unsigned char flag)
   return GET_FLAG(G.node[i].flag,flag);
 }
 
-static int node_add_edge(node_t* src,node_t* dst)
+/* add an edge to the arena, the rows are then out of date */
+
+extern int graph_add_edge(graph_t G,size_t i,size_t j)
 {
-  edge_t *e = malloc(sizeof(edge_t));
+  if (GET_FLAG(G.node[i].flag,NODE_STALE) ||
+      GET_FLAG(G.node[j].flag,NODE_STALE)) return 1;
+
+  graph_edges_t *E = G.edges;
+
+  if (E->n == E->alloc)
+    {
+      size_t alloc = (E->alloc ? 2*E->alloc : EDGES_INIT);
+      size_t (*pair)[2] = realloc(E->pair, alloc*sizeof(size_t[2]));
+
+      if (!pair) return 1;
+
+      E->pair  = pair;
+      E->alloc = alloc;
+    }
 
-  if (!e) return 1;
+  E->pair[E->n][0] = i;
+  E->pair[E->n][1] = j;
+  E->n++;
+  E->compiled = 0;
 
-  e->node   = dst;
-  e->next   = src->edge;
-  src->edge = e;
-  src->n++;
+  G.node[i].n++;
+  G.node[j].n++;
 
   return 0;
 }
 
-/* add an edge*/
+/*
+  compile the arena to rows by a counting sort, edges
+  with a stale end (added before a deletion) are dropped
+*/
 
-extern int graph_add_edge(graph_t G,size_t i,size_t j)
+static int graph_compile(graph_t G)
 {
-  if (GET_FLAG(G.node[i].flag,NODE_STALE) ||
-      GET_FLAG(G.node[j].flag,NODE_STALE)) return 1;
+  graph_edges_t *E = G.edges;
+
+  if (E->compiled) return 0;
+
+  size_t n = G.n, *start, *adj;
+
+  if (!(start = calloc(n+1, sizeof(size_t))))
+    return 1;
+
+  for (size_t k=0 ; k<E->n ; k++)
+    {
+      size_t i = E->pair[k][0], j = E->pair[k][1];
+
+      if (GET_FLAG(G.node[i].flag,NODE_STALE) ||
+	  GET_FLAG(G.node[j].flag,NODE_STALE)) continue;
+
+      start[i+1]++;
+      start[j+1]++;
+    }
+
+  for (size_t i=0 ; i<n ; i++)
+    start[i+1] += start[i];
+
+  if (!(adj = malloc((start[n] ? start[n] : 1)*sizeof(size_t))))
+    {
+      free(start);
+      return 1;
+    }
+
+  for (size_t k=0 ; k<E->n ; k++)
+    {
+      size_t i = E->pair[k][0], j = E->pair[k][1];
+
+      if (GET_FLAG(G.node[i].flag,NODE_STALE) ||
+	  GET_FLAG(G.node[j].flag,NODE_STALE)) continue;
+
+      adj[start[i]++] = j;
+      adj[start[j]++] = i;
+    }
+
+  /* the fill has moved each start to the next */
+
+  for (size_t i=n ; i>0 ; i--)
+    start[i] = start[i-1];
+  start[0] = 0;
+
+  free(E->start);
+  free(E->adj);
+
+  E->start    = start;
+  E->adj      = adj;
+  E->compiled = 1;
 
-  return
-    node_add_edge(G.node+i,G.node+j) ||
-    node_add_edge(G.node+j,G.node+i);
+  return 0;
 }
 
 /*
-   delete node i, including removing and
-   freeing the edges (both in and out).
+   delete node i, decrementing the edge count of
+   its (non-stale) neighbours
 */
 
 extern int graph_del_node(graph_t G,size_t i)
@@ -140,59 +241,217 @@ extern int graph_del_node(graph_t G,size_t i)
 
   if (GET_FLAG(src->flag,NODE_STALE)) return 0;
 
-  edge_t *e1;
+  if (graph_compile(G) != 0) return 1;
+
+  graph_edges_t *E = G.edges;
 
-  for (e1=src->edge ; e1 ; e1=e1->next)
+  SET_FLAG(src->flag,NODE_STALE);
+
+  for (size_t k=E->start[i] ; k<E->start[i+1] ; k++)
     {
-      node_t *dst = e1->node;
+      node_t *dst = G.node + E->adj[k];
 
-      if (GET_FLAG(dst->flag,NODE_STALE)) return 1;
+      if (GET_FLAG(dst->flag,NODE_STALE)) continue;
 
-      /*
-	perform a linear search of the destination
-	node's edges to find the one that points
-	to src, when found excise it from the list
-	and decrement the dst's edge counter. note
-	that there must be at least one edge or the
-	graph is corrupt
-      */
+      /* a node with an edge has a positive count, else corrupt */
 
-      edge_t *e2 = dst->edge;
+      if (dst->n == 0) return 1;
 
-      if (!e2) return 1;
+      (dst->n)--;
+    }
 
-      if (e2->node == src)
-	{
-	  dst->edge = e2->next;
-	  free(e2);
-	  goto deleted;
-	}
-      else
+  src->n = 0;
+
+  return 0;
+}
+
+/*
+  the bucket queue for graph_decimate(), the priority of
+  node i is the pair (edges, rank) where the rank is the
+  position of i when sorted by decreasing weight then
+  decreasing index, so that the maximum has the most
+  edges, then the smallest weight, then the smallest index.
+
+  the nodes with e edges are held in an intrusive doubly
+  linked list (the arrays next and prev, NIL terminated)
+  with head head[e].  the edges of a node only decrease,
+  so once the list of e edges is the highest non-empty one
+  nodes only leave it: we then take its nodes sorted by
+  decreasing rank and delete those which are still in it,
+  this gives the same order as a scan for the maximum of
+  the priorities.  A node is sorted at most once for each
+  of its edges, so the decimation is O((n + m) log n) for
+  m edges, and takes O(n + emax) memory.
+*/
+
+#define NIL SIZE_MAX
+
+typedef struct
+{
+  float w;
+  size_t i;
+} rank_t;
+
+static int rank_cmp(const void *va, const void *vb)
+{
+  const rank_t *a = va, *b = vb;
+
+  if (a->w != b->w) return (a->w > b->w) ? -1 : 1;
+  if (a->i != b->i) return (a->i > b->i) ? -1 : 1;
+
+  return 0;
+}
+
+static int rank_desc(const void *va, const void *vb)
+{
+  size_t a = *(const size_t*)va, b = *(const size_t*)vb;
+
+  return (a < b) - (a > b);
+}
+
+/*
+  a node which is in no list has next and prev equal to
+  itself, and linking or unlinking is then idempotent, as
+  needed since an edge may be added more than once
+*/
+
+typedef struct
+{
+  size_t *head, *next, *prev;
+} bq_t;
+
+static void bq_link(bq_t *Q, size_t e, size_t i)
+{
+  if (Q->prev[i] != i) return;
+
+  Q->prev[i] = NIL;
+  Q->next[i] = Q->head[e];
+
+  if (Q->head[e] != NIL) Q->prev[Q->head[e]] = i;
+
+  Q->head[e] = i;
+}
+
+static void bq_unlink(bq_t *Q, size_t e, size_t i)
+{
+  if (Q->prev[i] == i) return;
+
+  if (Q->prev[i] != NIL)
+    Q->next[Q->prev[i]] = Q->next[i];
+  else
+    Q->head[e] = Q->next[i];
+
+  if (Q->next[i] != NIL) Q->prev[Q->next[i]] = Q->prev[i];
+
+  Q->next[i] = Q->prev[i] = i;
+}
+
+extern int graph_decimate(graph_t G)
+{
+  size_t n = G.n, emax = 0;
+
+  for (size_t i=0 ; i<n ; i++)
+    if (G.node[i].n > emax) emax = G.node[i].n;
+
+  if (emax == 0) return 0;
+
+  if (graph_compile(G) != 0) return 1;
+
+  int err = 1;
+  size_t *rank, *node, *top;
+  rank_t *R;
+  bq_t Q;
+
+  if (!(R = malloc(n*sizeof(rank_t))))
+    return 1;
+
+  for (size_t i=0 ; i<n ; i++)
+    {
+      R[i].w = G.node[i].weight;
+      R[i].i = i;
+    }
+
+  qsort(R, n, sizeof(rank_t), rank_cmp);
+
+  if (!(rank = malloc(5*n*sizeof(size_t))))
+    goto cleanup_R;
+
+  node   = rank + n;
+  top    = rank + 2*n;
+  Q.next = rank + 3*n;
+  Q.prev = rank + 4*n;
+
+  for (size_t r=0 ; r<n ; r++)
+    {
+      node[r] = R[r].i;
+      rank[R[r].i] = r;
+      Q.next[r] = Q.prev[r] = r;
+    }
+
+  if (!(Q.head = malloc((emax+1)*sizeof(size_t))))
+    goto cleanup_rank;
+
+  for (size_t e=0 ; e<=emax ; e++)
+    Q.head[e] = NIL;
+
+  for (size_t i=0 ; i<n ; i++)
+    if (G.node[i].n > 0)
+      bq_link(&Q, G.node[i].n, i);
+
+  graph_edges_t *E = G.edges;
+
+  for (size_t e=emax ; e>0 ; e--)
+    {
+      size_t nt = 0;
+
+      for (size_t i=Q.head[e] ; i!=NIL ; i=Q.next[i])
+	top[nt++] = rank[i];
+
+      qsort(top, nt, sizeof(size_t), rank_desc);
+
+      for (size_t t=0 ; t<nt ; t++)
 	{
-	  edge_t *e3;
+	  size_t i = node[top[t]];
+
+	  /* moved to a lower list by an earlier deletion */
 
-	  for (e3=e2->next ; e3 ; e2=e3,e3=e3->next)
+	  if (G.node[i].n != e) continue;
+
+	  bq_unlink(&Q, e, i);
+
+	  /* the neighbours are requeued with one less edge */
+
+	  for (size_t k=E->start[i] ; k<E->start[i+1] ; k++)
 	    {
-	      if (e3->node == src)
-		{
-		  e2->next = e3->next;
-		  free(e3);
-		  goto deleted;
-		}
-	    }
-	}
+	      size_t j = E->adj[k];
 
-      /* edge not found, graph corrupt */
+	      if ((j != i) && !GET_FLAG(G.node[j].flag,NODE_STALE))
+		bq_unlink(&Q, G.node[j].n, j);
+	    }
 
-      return 1;
+	  if (graph_del_node(G, i) != 0)
+	    goto cleanup_Q;
 
-    deleted:
+	  for (size_t k=E->start[i] ; k<E->start[i+1] ; k++)
+	    {
+	      size_t j = E->adj[k];
 
-      (dst->n)--;
+	      if ((G.node[j].n > 0) && !GET_FLAG(G.node[j].flag,NODE_STALE))
+		bq_link(&Q, G.node[j].n, j);
+	    }
+	}
     }
 
-  src->n = 0;
-  SET_FLAG(src->flag,NODE_STALE);
+  err = 0;
 
-  return 0;
+ cleanup_Q:
+  free(Q.head);
+
+ cleanup_rank:
+  free(rank);
+
+ cleanup_R:
+  free(R);
+
+  return err;
 }
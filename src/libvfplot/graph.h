@@ -4,17 +4,18 @@
   undirected graphs for the dimension-0
   decimation in vfplot, but could be generalised.
 
-  this is an array of nodes (vertices) each of
-  which has a linked list of edges, an edge is
-  a pointer to a node.
+  this is an array of nodes (vertices) and an arena
+  of edges, each undirected edge is a pair of node
+  indices appended to the arena. before the edges are
+  traversed they are compiled to compressed sparse
+  rows (CSR), the neighbours of node i being
 
-  the representation of an undirected edge is with
-  two directed edges between nodes.
+    adj[start[i]] ... adj[start[i+1]-1]
 
-    node - edge -> edge -> edge->null
-            |       |       |
-            v       v       v
-	   node    node    node
+  deletion of a node does not modify the rows, it
+  marks the node stale and decrements the edge count
+  of its neighbours, so stale entries in a row are
+  skipped on traversal
 
   J.J.Green 2007
 */
@@ -28,27 +29,20 @@
 
 #define NODE_STALE FLAG(0)
 
-typedef struct edge_t edge_t;
-typedef struct node_t node_t;
+typedef struct graph_edges_t graph_edges_t;
 
-struct node_t
+typedef struct
 {
   unsigned char flag;
   float weight;
   size_t n;
-  edge_t* edge;
-};
-
-struct edge_t
-{
-  node_t* node;
-  edge_t* next;
-};
+} node_t;
 
 typedef struct
 {
   size_t n;
   node_t* node;
+  graph_edges_t* edges;
 } graph_t;
 
 extern int graph_init(size_t,graph_t*);
@@ -62,4 +56,12 @@ extern int graph_del_node(graph_t,size_t);
 extern size_t graph_maxedge(graph_t,size_t*);
 extern int graph_node_flag(graph_t,size_t,unsigned char);
 
+/*
+  delete nodes in the order of graph_maxedge() until
+  there are no edges, but with a bucket queue rather
+  than a scan of the nodes for each deletion
+*/
+
+extern int graph_decimate(graph_t);
+
 #endif
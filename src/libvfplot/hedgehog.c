@@ -20,6 +20,18 @@ extern int vfplot_hedgehog(domain_t *dom,
 			   void *field,
 			   vfp_opt_t *opt,
 			   size_t *K, arrow_t **pA)
+{
+  vfp_context_t ctx;
+
+  vfplot_context_init(&ctx, fv, fc, field, opt->arrow.aspect);
+
+  return vfplot_hedgehog_r(&ctx, dom, opt, K, pA);
+}
+
+extern int vfplot_hedgehog_r(vfp_context_t *ctx,
+			     domain_t *dom,
+			     vfp_opt_t *opt,
+			     size_t *K, arrow_t **pA)
 {
   bbox_t bb = opt->bbox;
   double
@@ -55,9 +67,28 @@ extern int vfplot_hedgehog(domain_t *dom,
   paths = fopen("paths.dat", "w");
 #endif
 
-  /* generate the field */
+  /*
+    generate the field, the arrows at the grid points in
+    the domain are evaluated in a single batch, then those
+    with no data are removed
+  */
+
+  unsigned char *mask;
 
-  evaluate_register(fv, fc, field, opt->arrow.aspect);
+  if ((mask = malloc(n*m)) == NULL)
+    {
+      free(A);
+      *pA = NULL;
+      return ERROR_MALLOC;
+    }
+
+  if (domain_mask_grid(dom, bb, n, m, mask) != 0)
+    {
+      free(mask);
+      free(A);
+      *pA = NULL;
+      return ERROR_MALLOC;
+    }
 
   int i, k=0;
   double dx = w/n;
@@ -73,23 +104,36 @@ extern int vfplot_hedgehog(domain_t *dom,
 	  double y = y0 + (j + 0.5)*dy;
 	  vector_t v = {x, y};
 
-	  if (! domain_inside(v, dom)) continue;
+	  if (! mask[j*n + i]) continue;
 
-	  arrow_t *Ak = A+k;
+	  A[k++].centre = v;
+	}
+    }
 
-	  Ak->centre = v;
+  free(mask);
 
-	  int err = evaluate(Ak);
+  int *E, err;
 
-	  switch (err)
-	    {
-	    case ERROR_OK : k++ ; break;
-	    case ERROR_NODATA: break;
-	    default: return err;
-	    }
-	}
+  if ((E = malloc((k > 0 ? k : 1)*sizeof(int))) == NULL)
+    return ERROR_MALLOC;
+
+  if ((err = evaluate_batch_r(&(ctx->evaluate), k, A, E)) != ERROR_OK)
+    {
+      free(E);
+      return err;
     }
 
+  int l = 0;
+
+  for (i=0 ; i<k ; i++)
+    {
+      if (E[i] == ERROR_OK) A[l++] = A[i];
+    }
+
+  free(E);
+
+  k = l;
+
   *K = k;
 
 #ifdef PATHS
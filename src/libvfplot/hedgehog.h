@@ -9,8 +9,11 @@
 #define HEDGEHOG_H
 
 #include "vfplot.h"
+#include "context.h"
 
 extern int vfplot_hedgehog(domain_t*, vfun_t, cfun_t,
 			   void*, vfp_opt_t*, size_t*, arrow_t**);
+extern int vfplot_hedgehog_r(vfp_context_t*, domain_t*,
+			     vfp_opt_t*, size_t*, arrow_t**);
 
 #endif
@@ -9,6 +9,12 @@
 #endif
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "mt.h"
 
@@ -16,90 +22,620 @@
 #include "ellipse.h"
 #include "arrow.h"
 #include "evaluate.h"
+#include "macros.h"
+#include "parallel.h"
 #include "vector.h"
 
-extern int metric_tensor_new(bbox_t bb, int nx, int ny, mt_t *mt)
+/*
+  the sampling of the field is shared between threads in
+  blocks of rows (of nodes for the uniform grid, of root
+  cells for the quadtree), each thread takes the next block
+  when it has finished its current one
+*/
+
+#define MT_ROW_BLOCK 4
+
+/*
+  the adaptive metric tensor is a quadtree on a grid of root
+  cells, refined to at most this depth
+*/
+
+#define MT_QTREE_DEPTH 3
+
+typedef struct mt_cell_t
+{
+  double z[4][MT_GRID_STRIDE];
+  struct mt_cell_t *child;
+} mt_cell_t;
+
+struct mt_qtree_t
+{
+  int nx, ny, depth;
+  bbox_t bb;
+  double tol, *R;
+  mt_cell_t *root;
+};
+
+typedef struct mt_sample_t mt_sample_t;
+
+struct mt_sample_t
+{
+  const vfp_context_t *ctx;
+  int (*rows)(mt_sample_t*, int, int);
+  mt_grid_t *G;
+  mt_qtree_t *Q;
+  int nx, nrow;
+};
+
+/*
+  the (a, b, c, area) values for the arrow A evaluated with
+  status err, these are NaN if there is no data there
+*/
+
+static int mt_arrow(const vfp_context_t *ctx, int err, arrow_t *A, double *z)
+{
+  switch (err)
+    {
+      ellipse_t E;
+      m2_t m2;
+
+    case ERROR_OK:
+
+      arrow_ellipse_r(&(ctx->margin), A, &E);
+      m2 = ellipse_mt(E);
+
+      z[0] = M2A(m2);
+      z[1] = M2B(m2);
+      z[2] = M2D(m2);
+      z[3] = E.major*E.minor*M_PI;
+
+      break;
+
+    case ERROR_NODATA:
+
+      for (int k = 0 ; k < MT_GRID_STRIDE ; k++)
+	z[k] = NAN;
+
+      break;
+
+    default:
+      return err;
+    }
+
+  return ERROR_OK;
+}
+
+/* evaluate the (a, b, c, area) values at a point */
+
+static int mt_eval(const vfp_context_t *ctx, double x, double y, double *z)
+{
+  arrow_t A;
+
+  A.centre.x = x;
+  A.centre.y = y;
+
+  return mt_arrow(ctx, evaluate_r(&(ctx->evaluate), &A), &A, z);
+}
+
+/* the coordinates of the node (i, j) of the uniform grid */
+
+static void mt_grid_xy(const mt_grid_t *G, int i, int j, double *x, double *y)
+{
+  bbox_t bb = G->bb;
+
+  *x = (i*bb.x.max + (G->nx-1-i)*bb.x.min)/(G->nx - 1);
+  *y = (j*bb.y.max + (G->ny-1-j)*bb.y.min)/(G->ny - 1);
+}
+
+/*
+  sample the field on rows [j0, j1) of the uniform grid, each
+  row is evaluated with a single (batch) query of the field
+*/
+
+static int mt_sample_rows(mt_sample_t *S, int j0, int j1)
+{
+  int nx = S->nx, err = ERROR_OK;
+  arrow_t *A;
+  int *E;
+
+  if ((A = malloc(nx*sizeof(arrow_t))) == NULL)
+    return ERROR_MALLOC;
+
+  if ((E = malloc(nx*sizeof(int))) == NULL)
+    {
+      free(A);
+      return ERROR_MALLOC;
+    }
+
+  for (int j = j0 ; j < j1 ; j++)
+    {
+      for (int i = 0 ; i < nx ; i++)
+	mt_grid_xy(S->G, i, j, &(A[i].centre.x), &(A[i].centre.y));
+
+      if ((err = evaluate_batch_r(&(S->ctx->evaluate), nx, A, E)) != ERROR_OK)
+	break;
+
+      for (int i = 0 ; i < nx ; i++)
+	{
+	  double *g = S->G->v + ((size_t)j*nx + i)*MT_GRID_STRIDE;
+
+	  if ((err = mt_arrow(S->ctx, E[i], A + i, g)) != ERROR_OK)
+	    break;
+	}
+
+      if (err != ERROR_OK) break;
+    }
+
+  free(E);
+  free(A);
+
+  return err;
+}
+
+/* a block of rows is a job for parallel_for() */
+
+static int mt_sample_block(size_t k, mt_sample_t *S)
+{
+  int j0 = k*MT_ROW_BLOCK;
+
+  return S->rows(S, j0, MIN(j0 + MT_ROW_BLOCK, S->nrow));
+}
+
+static int mt_sample(mt_sample_t *S, int nt)
+{
+  size_t nb = (S->nrow + MT_ROW_BLOCK - 1)/MT_ROW_BLOCK;
+
+  return parallel_for(nb, nt, (pfun_t)mt_sample_block, S);
+}
+
+/*
+  sample the field on an nx x ny grid on the bounding box,
+  using nt threads (the evaluation in the context must then
+  be reentrant, which it is for the fields in vfplot)
+*/
+
+extern int metric_tensor_new(const vfp_context_t *ctx,
+			     bbox_t bb, int nx, int ny, int nt,
+			     mt_t *mt)
 {
   int err;
-  bilinear_t* B[4];
 
-  for (int k = 0 ; k < 4 ; k++)
+  if ((nx < 2) || (ny < 2))
+    return ERROR_BUG;
+
+  double *G;
+  size_t ng = (size_t)nx*ny*MT_GRID_STRIDE;
+
+  if (!(G = malloc(ng*sizeof(double))))
+    return ERROR_MALLOC;
+
+  mt->grid.nx = nx;
+  mt->grid.ny = ny;
+  mt->grid.bb = bb;
+  mt->grid.v  = G;
+  mt->grid.map.addr = NULL;
+  mt->grid.map.size = 0;
+
+  mt->qtree = NULL;
+
+  mt_sample_t S = { .ctx = ctx, .rows = mt_sample_rows,
+		    .G = &(mt->grid), .Q = NULL,
+		    .nx = nx, .nrow = ny };
+
+  if ((err = mt_sample(&S, nt)) != ERROR_OK)
     {
-      if (!(B[k] = bilinear_new()))
-	return ERROR_MALLOC;
-      if ((err = bilinear_dimension(nx,ny,bb,B[k])) != ERROR_OK)
+      free(G);
+      mt->grid.v = NULL;
+      return err;
+    }
+
+  return ERROR_OK;
+}
+
+/*
+  build the uniform metric tensor from a fused grid of node
+  values (as held in mt_grid_t), for example one read from a
+  cache file. On success the mt_t takes ownership of G.
+*/
+
+extern int metric_tensor_new_grid(bbox_t bb, int nx, int ny, double *G,
+				  mt_t *mt)
+{
+  if ((nx < 2) || (ny < 2))
+    return ERROR_BUG;
+
+  mt->grid.nx = nx;
+  mt->grid.ny = ny;
+  mt->grid.bb = bb;
+  mt->grid.v  = G;
+  mt->grid.map.addr = NULL;
+  mt->grid.map.size = 0;
+
+  mt->qtree = NULL;
+
+  return ERROR_OK;
+}
+
+/*
+  the adaptive metric tensor -- the bounding box is divided
+  into a grid of root cells, each is a quadtree whose leaves
+  carry the (a, b, c, area) values at their corners.
+
+  A cell is split if the values sampled at the midpoints of
+  its edges and at its centre differ from those interpolated
+  from its corners by more than the tolerance (relative to
+  the trace of the tensor for a, b, c and to the area for
+  area), or if some but not all of these nine points have
+  data, so that the edge of the domain is resolved at the
+  finest level. Those new points are the corners of the
+  children, so the splitting needs no extra evaluations.
+*/
+
+static int mt_cell_split(const double (*c)[MT_GRID_STRIDE],
+			 const double (*m)[MT_GRID_STRIDE],
+			 double tol)
+{
+  int nnan = 0;
+
+  for (int k = 0 ; k < 4 ; k++) nnan += isnan(c[k][0]);
+  for (int k = 0 ; k < 5 ; k++) nnan += isnan(m[k][0]);
+
+  if (nnan == 9) return 0;
+  if (nnan > 0) return 1;
+
+  /*
+    interpolated values at the midpoints, in the order
+    bottom, left, centre, right, top
+  */
+
+  for (int k = 0 ; k < MT_GRID_STRIDE ; k++)
+    {
+      double p[5] = {
+	(c[0][k] + c[1][k])/2,
+	(c[0][k] + c[2][k])/2,
+	(c[0][k] + c[1][k] + c[2][k] + c[3][k])/4,
+	(c[1][k] + c[3][k])/2,
+	(c[2][k] + c[3][k])/2
+      };
+
+      for (int l = 0 ; l < 5 ; l++)
+	{
+	  double scale = (k < 3 ?
+			  fabs(m[l][0]) + fabs(m[l][2]) :
+			  fabs(m[l][3]));
+
+	  if (fabs(p[l] - m[l][k]) > tol*scale) return 1;
+	}
+    }
+
+  return 0;
+}
+
+static void mt_cell_free(mt_cell_t *c)
+{
+  if (c->child)
+    {
+      for (int q = 0 ; q < 4 ; q++)
+	mt_cell_free(c->child + q);
+
+      free(c->child);
+      c->child = NULL;
+    }
+}
+
+static int mt_cell_refine(const vfp_context_t *ctx, const mt_qtree_t *Q,
+			  mt_cell_t *c, bbox_t bb, int level)
+{
+  if (level >= Q->depth) return ERROR_OK;
+
+  double
+    x0 = bb.x.min, x1 = bb.x.max, xm = (x0 + x1)/2,
+    y0 = bb.y.min, y1 = bb.y.max, ym = (y0 + y1)/2,
+    m[5][MT_GRID_STRIDE],
+    pt[5][2] = {{xm, y0}, {x0, ym}, {xm, ym}, {x1, ym}, {xm, y1}};
+  int err;
+
+  for (int l = 0 ; l < 5 ; l++)
+    if ((err = mt_eval(ctx, pt[l][0], pt[l][1], m[l])) != ERROR_OK)
+      return err;
+
+  if (! mt_cell_split((const double (*)[MT_GRID_STRIDE])c->z,
+		      (const double (*)[MT_GRID_STRIDE])m,
+		      Q->tol))
+    return ERROR_OK;
+
+  if ((c->child = malloc(4*sizeof(mt_cell_t))) == NULL)
+    return ERROR_MALLOC;
+
+  /*
+    the corners of the children (in the order 00, 10, 01, 11)
+    as pointers into the parent corners and midpoints
+  */
+
+  const double *cz[4][4] = {
+    {c->z[0], m[0], m[1], m[2]},
+    {m[0], c->z[1], m[2], m[3]},
+    {m[1], m[2], c->z[2], m[4]},
+    {m[2], m[3], m[4], c->z[3]}
+  };
+
+  for (int q = 0 ; q < 4 ; q++)
+    {
+      mt_cell_t *d = c->child + q;
+
+      for (int k = 0 ; k < 4 ; k++)
+	memcpy(d->z[k], cz[q][k], MT_GRID_STRIDE*sizeof(double));
+
+      d->child = NULL;
+    }
+
+  for (int q = 0 ; q < 4 ; q++)
+    {
+      int qx = q % 2, qy = q / 2;
+      bbox_t cbb = BBOX((qx ? xm : x0), (qx ? x1 : xm),
+			(qy ? ym : y0), (qy ? y1 : ym));
+
+      if ((err = mt_cell_refine(ctx, Q, c->child + q, cbb, level+1)) != ERROR_OK)
 	return err;
     }
 
-  for (int i = 0 ; i < nx ; i++)
+  return ERROR_OK;
+}
+
+static bbox_t mt_root_bbox(const mt_qtree_t *Q, int i, int j)
+{
+  double
+    dx = bbox_width(Q->bb)/Q->nx,
+    dy = bbox_height(Q->bb)/Q->ny;
+  bbox_t bb = BBOX(Q->bb.x.min + i*dx, Q->bb.x.min + (i+1)*dx,
+		   Q->bb.y.min + j*dy, Q->bb.y.min + (j+1)*dy);
+
+  return bb;
+}
+
+/* sample the root nodes on rows [j0, j1) */
+
+static int mt_root_rows(mt_sample_t *S, int j0, int j1)
+{
+  const mt_qtree_t *Q = S->Q;
+  int nx = Q->nx + 1;
+  double
+    dx = bbox_width(Q->bb)/Q->nx,
+    dy = bbox_height(Q->bb)/Q->ny;
+
+  for (int j = j0 ; j < j1 ; j++)
     {
-      for (int j = 0 ; j < ny ; j++)
+      for (int i = 0 ; i < nx ; i++)
 	{
-	  arrow_t A;
+	  double
+	    x = Q->bb.x.min + i*dx,
+	    y = Q->bb.y.min + j*dy,
+	    *z = Q->R + (j*nx + i)*MT_GRID_STRIDE;
+	  int err;
 
-	  bilinear_getxy(i, j, B[0], &(A.centre.x), &(A.centre.y));
+	  if ((err = mt_eval(S->ctx, x, y, z)) != ERROR_OK)
+	    return err;
+	}
+    }
 
-	  err = evaluate(&A);
+  return ERROR_OK;
+}
 
-	  switch (err)
-	    {
-	      ellipse_t E;
-	      m2_t m2;
+/* build the quadtrees of the root cells on rows [j0, j1) */
 
-	    case ERROR_OK:
+static int mt_cell_rows(mt_sample_t *S, int j0, int j1)
+{
+  const mt_qtree_t *Q = S->Q;
+  int nx = Q->nx;
 
-	      arrow_ellipse(&A,&E);
-	      m2 = ellipse_mt(E);
+  for (int j = j0 ; j < j1 ; j++)
+    {
+      for (int i = 0 ; i < nx ; i++)
+	{
+	  mt_cell_t *c = Q->root + (j*nx + i);
+	  int
+	    id[4] = {j*(nx+1) + i,     j*(nx+1) + i + 1,
+		     (j+1)*(nx+1) + i, (j+1)*(nx+1) + i + 1},
+	    err;
 
-	      bilinear_setz(i, j, M2A(m2), B[0]);
-	      bilinear_setz(i, j, M2B(m2), B[1]);
-	      bilinear_setz(i, j, M2D(m2), B[2]);
-	      bilinear_setz(i, j, E.major*E.minor*M_PI, B[3]);
+	  for (int k = 0 ; k < 4 ; k++)
+	    memcpy(c->z[k],
+		   Q->R + id[k]*MT_GRID_STRIDE,
+		   MT_GRID_STRIDE*sizeof(double));
 
-	      break;
+	  c->child = NULL;
 
-	    case ERROR_NODATA:
-	      break;
+	  err = mt_cell_refine(S->ctx, Q, c, mt_root_bbox(Q, i, j), 0);
 
-	    default:
-	      return err;
-	    }
+	  if (err != ERROR_OK) return err;
 	}
     }
 
-  mt->a = B[0];
-  mt->b = B[1];
-  mt->c = B[2];
-  mt->area = B[3];
+  return ERROR_OK;
+}
+
+static void mt_qtree_destroy(mt_qtree_t *Q)
+{
+  if (Q)
+    {
+      if (Q->root)
+	{
+	  for (int k = 0 ; k < Q->nx*Q->ny ; k++)
+	    mt_cell_free(Q->root + k);
+
+	  free(Q->root);
+	}
+
+      free(Q->R);
+      free(Q);
+    }
+}
+
+/*
+  as metric_tensor_new() but adaptive, the finest level of
+  the quadtree has (at least) the resolution of the nx x ny
+  uniform grid, tol is the relative tolerance for refinement
+*/
+
+extern int metric_tensor_new_adaptive(const vfp_context_t *ctx,
+				      bbox_t bb, int nx, int ny, int nt,
+				      double tol, mt_t *mt)
+{
+  int err, f = 1 << MT_QTREE_DEPTH;
+  mt_qtree_t *Q;
+
+  if ((Q = malloc(sizeof(mt_qtree_t))) == NULL)
+    return ERROR_MALLOC;
+
+  Q->nx = MAX(1, (nx - 2)/f + 1);
+  Q->ny = MAX(1, (ny - 2)/f + 1);
+  Q->depth = MT_QTREE_DEPTH;
+  Q->bb = bb;
+  Q->tol = tol;
+  Q->R = malloc((Q->nx+1)*(Q->ny+1)*MT_GRID_STRIDE*sizeof(double));
+  Q->root = malloc(Q->nx*Q->ny*sizeof(mt_cell_t));
+
+  if ((Q->R == NULL) || (Q->root == NULL))
+    {
+      free(Q->R);
+      free(Q->root);
+      free(Q);
+      return ERROR_MALLOC;
+    }
+
+  for (int k = 0 ; k < Q->nx*Q->ny ; k++)
+    Q->root[k].child = NULL;
+
+  mt_sample_t S = { .ctx = ctx, .rows = mt_root_rows, .Q = Q,
+		    .nrow = Q->ny + 1 };
+
+  if ((err = mt_sample(&S, nt)) == ERROR_OK)
+    {
+      S.rows = mt_cell_rows;
+      S.nrow = Q->ny;
+      err = mt_sample(&S, nt);
+    }
+
+  free(Q->R);
+  Q->R = NULL;
+
+  if (err != ERROR_OK)
+    {
+      mt_qtree_destroy(Q);
+      return err;
+    }
+
+  mt->grid.nx = mt->grid.ny = 0;
+  mt->grid.bb = bb;
+  mt->grid.v  = NULL;
+  mt->grid.map.addr = NULL;
+  mt->grid.map.size = 0;
+
+  mt->qtree = Q;
 
   return ERROR_OK;
 }
 
 extern void metric_tensor_clean(mt_t mt)
 {
-  bilinear_destroy(mt.a);
-  bilinear_destroy(mt.b);
-  bilinear_destroy(mt.c);
-  bilinear_destroy(mt.area);
+  mt_qtree_destroy(mt.qtree);
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+
+  if (mt.grid.map.addr)
+    {
+      munmap(mt.grid.map.addr, mt.grid.map.size);
+      return;
+    }
+
+#endif
+
+  free(mt.grid.v);
 }
 
-extern int metric_tensor(vector_t v, mt_t mt, m2_t *m2)
+/*
+  the (a, b, c) values of the node (i, j) of the fused grid,
+  or NULL if the node is outside the grid or nodata
+*/
+
+static const double* mt_node(int i, int j, const mt_grid_t *G)
 {
-  double
-    a[3];
-  bilinear_t
-    *B[3] = {mt.a, mt.b, mt.c};
+  if ((i<0) || (i>=G->nx) || (j<0) || (j>=G->ny))
+    return NULL;
+
+  const double *z = G->v + (j*G->nx + i)*MT_GRID_STRIDE;
+
+  return (isnan(z[0]) ? NULL : z);
+}
+
+/*
+  this is bilinear() from bilinear.c applied to the three
+  components at once, with the corners of the cell z00 ..
+  z11 given (NULL for nodata) and local coordinates X, Y;
+  the nodata handling is the same: bilinear interpolation
+  if all four nodes have data, linear on the triangle if
+  three do
+*/
 
-  for (int i = 0 ; i < 3 ; i++)
+static int mt_interpolate(const double *z00, const double *z10,
+			  const double *z01, const double *z11,
+			  double X, double Y, m2_t *m2)
+{
+  double a[3];
+
+  switch ((!z00) + (!z01) + (!z10) + (!z11))
     {
-      int err = bilinear(v.x, v.y, B[i], a+i);
+    case 0 :
+
+      /* 4 points - bilinear */
 
-      switch (err)
+      for (int k = 0 ; k < 3 ; k++)
+	a[k] =
+	  (z00[k]*(1-X) + z10[k]*X)*(1-Y) +
+	  (z01[k]*(1-X) + z11[k]*X)*Y;
+
+      break;
+
+    case 1 :
+
+      /* 3 points, 4 cases - linear */
+
+      if (!z11)
 	{
-	case ERROR_OK: break;
-	case ERROR_NODATA:
-	default: return err;
+	  if (!(X+Y<1)) return ERROR_NODATA;
+
+	  for (int k = 0 ; k < 3 ; k++)
+	    a[k] = (z10[k]-z00[k])*X + (z01[k]-z00[k])*Y + z00[k];
+	}
+      else if (!z01)
+	{
+	  if (!(X>Y)) return ERROR_NODATA;
+
+	  for (int k = 0 ; k < 3 ; k++)
+	    a[k] = (z10[k]-z00[k])*X + (z11[k]-z10[k])*Y + z00[k];
+	}
+      else if (!z10)
+	{
+	  if (!(X<Y)) return ERROR_NODATA;
+
+	  for (int k = 0 ; k < 3 ; k++)
+	    a[k] = (z11[k]-z01[k])*X + (z01[k]-z00[k])*Y + z00[k];
 	}
+      else
+	{
+	  if (!(X+Y>1)) return ERROR_NODATA;
+
+	  for (int k = 0 ; k < 3 ; k++)
+	    a[k] = (z11[k]-z01[k])*X + (z11[k]-z10[k])*Y + z10[k] + z01[k] - z11[k];
+	}
+
+      break;
+
+      /* two or less points, nodata */
+
+    default:
+
+      return ERROR_NODATA;
     }
 
   M2A(*m2) = a[0];
@@ -110,6 +646,226 @@ extern int metric_tensor(vector_t v, mt_t mt, m2_t *m2)
   return ERROR_OK;
 }
 
+/* the corner of a quadtree cell, NULL if nodata */
+
+static const double* mt_corner(const mt_cell_t *c, int k)
+{
+  return (isnan(c->z[k][0]) ? NULL : c->z[k]);
+}
+
+/*
+  find the quadtree leaf containing the point, with the
+  local coordinates in the leaf, NULL if outside the tree
+*/
+
+static const mt_cell_t* mt_qtree_leaf(vector_t v, const mt_qtree_t *Q,
+				      double *pX, double *pY)
+{
+  bbox_t bb = Q->bb;
+  double
+    xn = Q->nx*(v.x - bb.x.min)/(bb.x.max - bb.x.min),
+    yn = Q->ny*(v.y - bb.y.min)/(bb.y.max - bb.y.min);
+  int
+    i = (int)floor(xn),
+    j = (int)floor(yn);
+  double
+    X = xn - i,
+    Y = yn - j;
+
+  /* the top and right edges belong to the last cells */
+
+  if (i == Q->nx) { i--; X = 1.0; }
+  if (j == Q->ny) { j--; Y = 1.0; }
+
+  if ((i<0) || (i>=Q->nx) || (j<0) || (j>=Q->ny))
+    return NULL;
+
+  const mt_cell_t *c = Q->root + (j*Q->nx + i);
+
+  while (c->child)
+    {
+      int
+	qx = (X >= 0.5),
+	qy = (Y >= 0.5);
+
+      X = 2*X - qx;
+      Y = 2*Y - qy;
+
+      c = c->child + (2*qy + qx);
+    }
+
+  *pX = X;
+  *pY = Y;
+
+  return c;
+}
+
+extern int metric_tensor(vector_t v, mt_t mt, m2_t *m2)
+{
+  if (mt.qtree)
+    {
+      double X, Y;
+      const mt_cell_t *c = mt_qtree_leaf(v, mt.qtree, &X, &Y);
+
+      if (!c) return ERROR_NODATA;
+
+      return mt_interpolate(mt_corner(c, 0), mt_corner(c, 1),
+			    mt_corner(c, 2), mt_corner(c, 3),
+			    X, Y, m2);
+    }
+
+  const mt_grid_t *G = &(mt.grid);
+  bbox_t bb = G->bb;
+
+  double
+    xn = (G->nx-1)*(v.x - bb.x.min)/(bb.x.max - bb.x.min),
+    yn = (G->ny-1)*(v.y - bb.y.min)/(bb.y.max - bb.y.min);
+  int
+    i = (int)floor(xn),
+    j = (int)floor(yn);
+
+  return mt_interpolate(mt_node(i, j, G),
+			mt_node(i+1, j, G),
+			mt_node(i, j+1, G),
+			mt_node(i+1, j+1, G),
+			xn - i, yn - j, m2);
+}
+
+/*
+  the integral of the ellipse area, and the area on which
+  the tensor is defined, added up over the cells of the
+  grid or the leaves of the quadtree: a cell with data at
+  all four corners contributes its area and the integral of
+  the bilinear interpolant of the ellipse area over it, one
+  with data at three corners contributes half its area (the
+  triangle on which the tensor is then defined)
+*/
+
+static void mt_cell_area(const double *z[4], double dA, double *I, double *D)
+{
+  int nnan = 0;
+  double sum = 0.0;
+
+  for (int k = 0 ; k < 4 ; k++)
+    {
+      if (isnan(z[k][0]))
+	nnan++;
+      else
+	sum += z[k][3];
+    }
+
+  switch (nnan)
+    {
+    case 0:
+      *I += dA*sum/4;
+      *D += dA;
+      break;
+    case 1:
+      *D += dA/2;
+      break;
+    }
+}
+
+static void mt_cell_areas(const mt_cell_t *c, double dA,
+			  double *I, double *D)
+{
+  if (c->child)
+    {
+      for (int q = 0 ; q < 4 ; q++)
+	mt_cell_areas(c->child + q, dA/4, I, D);
+      return;
+    }
+
+  const double *z[4] = {c->z[0], c->z[1], c->z[2], c->z[3]};
+
+  mt_cell_area(z, dA, I, D);
+}
+
+static void mt_qtree_areas(const mt_qtree_t *Q, double *I, double *D)
+{
+  double dA = bbox_volume(Q->bb)/(Q->nx*Q->ny);
+
+  *I = *D = 0.0;
+
+  for (int k = 0 ; k < Q->nx*Q->ny ; k++)
+    mt_cell_areas(Q->root + k, dA, I, D);
+}
+
+static void mt_grid_areas(const mt_grid_t *G, double *I, double *D)
+{
+  int nx = G->nx, ny = G->ny;
+  double dA = bbox_volume(G->bb)/((nx-1)*(ny-1));
+
+  *I = *D = 0.0;
+
+  for (int j = 0 ; j < ny-1 ; j++)
+    {
+      for (int i = 0 ; i < nx-1 ; i++)
+	{
+	  const double
+	    *z0 = G->v + ((size_t)j*nx + i)*MT_GRID_STRIDE,
+	    *z1 = z0 + nx*MT_GRID_STRIDE,
+	    *z[4] = {z0, z0 + MT_GRID_STRIDE, z1, z1 + MT_GRID_STRIDE};
+
+	  mt_cell_area(z, dA, I, D);
+	}
+    }
+}
+
+extern int metric_tensor_integrate_area(mt_t mt, double *I)
+{
+  double D;
+
+  if (mt.qtree)
+    mt_qtree_areas(mt.qtree, I, &D);
+  else
+    mt_grid_areas(&(mt.grid), I, &D);
+
+  return ERROR_OK;
+}
+
+extern int metric_tensor_defarea(mt_t mt, double *D)
+{
+  double I;
+
+  if (mt.qtree)
+    mt_qtree_areas(mt.qtree, &I, D);
+  else
+    mt_grid_areas(&(mt.grid), &I, D);
+
+  return ERROR_OK;
+}
+
+/* the number of cells (leaves for the quadtree) */
+
+static size_t mt_cell_count(const mt_cell_t *c)
+{
+  if (! c->child) return 1;
+
+  size_t n = 0;
+
+  for (int q = 0 ; q < 4 ; q++)
+    n += mt_cell_count(c->child + q);
+
+  return n;
+}
+
+extern size_t metric_tensor_cells(mt_t mt)
+{
+  if (mt.qtree)
+    {
+      const mt_qtree_t *Q = mt.qtree;
+      size_t n = 0;
+
+      for (int k = 0 ; k < Q->nx*Q->ny ; k++)
+	n += mt_cell_count(Q->root + k);
+
+      return n;
+    }
+
+  return (size_t)(mt.grid.nx - 1)*(mt.grid.ny - 1);
+}
+
 /*
   return the ratio de/dg, where de is the distance
   of the vector v to the edge of the boundng box of
@@ -122,7 +878,7 @@ extern int metric_tensor(vector_t v, mt_t mt, m2_t *m2)
 extern double mt_edge_granular(mt_t mt,vector_t v)
 {
   bbox_t
-    bb = bilinear_bbox(mt.a);
+    bb = mt.grid.bb;
 
   double
     w = bbox_width(bb),
@@ -130,7 +886,18 @@ extern double mt_edge_granular(mt_t mt,vector_t v)
   int
     nx, ny;
 
-  bilinear_nxy(mt.a, &nx, &ny);
+  if (mt.qtree)
+    {
+      /* the finest level of the quadtree */
+
+      nx = mt.qtree->nx << mt.qtree->depth;
+      ny = mt.qtree->ny << mt.qtree->depth;
+    }
+  else
+    {
+      nx = mt.grid.nx;
+      ny = mt.grid.ny;
+    }
 
   double
     R,
@@ -10,6 +10,7 @@
 #include "bilinear.h"
 #include "bbox.h"
 #include "matrix.h"
+#include "context.h"
 
 /*
   holds the metric tensor, a function on the rectangle
@@ -19,21 +20,54 @@
       [b,c]
 
   ie, it is symmetric-matrix valued. We represent it with
-  3 bilinear meshes (bilinear.h). In addition we hold a mesh
-  of the area of the corresponding ellipse at that point.
+  a grid (interpolated bilinearly, as in bilinear.h) with
+  the values (a, b, c, area) of each node stored contiguously,
+  area being that of the corresponding ellipse, so that
+  metric_tensor() need only find the cell once and touch
+  one allocation. The nodata (NaN) mask is that of the a
+  component, which is the same as that of the others.
 
-  the struct is open but with utility functions for
-  initialisation and cleaning of the component bilinear
-  meshes.
+  If map.addr is non-NULL then v points into a read-only
+  mapping of map.size bytes at that address (of a cache
+  file, see mtcache.h) which metric_tensor_clean() unmaps,
+  otherwise it frees v.
 */
 
+#define MT_GRID_STRIDE 4
+
+typedef struct
+{
+  int nx, ny;
+  bbox_t bb;
+  double *v;
+  struct {
+    void *addr;
+    size_t size;
+  } map;
+} mt_grid_t;
+
+/*
+  alternatively, the tensor can be held in a quadtree which
+  is refined only where the field varies, in that case the
+  grid is empty (other than its bounding box); in either case
+  the tensor should be accessed with the functions below
+*/
+
+typedef struct mt_qtree_t mt_qtree_t;
+
 typedef struct
 {
-  bilinear_t *a,*b,*c,*area;
+  mt_grid_t grid;
+  mt_qtree_t *qtree;
 } mt_t;
 
-extern int metric_tensor_new(bbox_t,int,int,mt_t*);
+extern int metric_tensor_new(const vfp_context_t*,bbox_t,int,int,int,mt_t*);
+extern int metric_tensor_new_grid(bbox_t,int,int,double*,mt_t*);
+extern int metric_tensor_new_adaptive(const vfp_context_t*,bbox_t,int,int,int,double,mt_t*);
 extern int metric_tensor(vector_t,mt_t,m2_t*);
+extern int metric_tensor_integrate_area(mt_t,double*);
+extern int metric_tensor_defarea(mt_t,double*);
+extern size_t metric_tensor_cells(mt_t);
 extern void metric_tensor_clean(mt_t);
 extern double mt_edge_granular(mt_t,vector_t);
 
@@ -0,0 +1,315 @@
+/*
+  mtcache.c
+  on-disk cache of the metric tensor
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+#define MTCACHE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined HAVE_MKSTEMP && defined HAVE_UNISTD_H && defined HAVE_SYS_STAT_H
+#define MTCACHE_MKSTEMP
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mtcache.h"
+
+#include "error.h"
+
+#define MTCACHE_MAGIC   "vfplotmt"
+#define MTCACHE_VERSION 1
+
+/*
+  the header is 64 bytes, so the grid which follows it
+  is aligned for doubles when the file is mapped
+*/
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version, stride;
+  uint64_t key;
+  int32_t nx, ny;
+  double bb[4];
+} mtcache_header_t;
+
+/* 64-bit FNV-1a */
+
+#define FNV_PRIME 1099511628211ULL
+
+extern uint64_t mtcache_hash(uint64_t h, const void *data, size_t n)
+{
+  const unsigned char *p = data;
+
+  for (size_t i = 0 ; i < n ; i++)
+    {
+      h ^= p[i];
+      h *= FNV_PRIME;
+    }
+
+  return h;
+}
+
+static void mtcache_header(uint64_t key, bbox_t bb, int nx, int ny,
+			   mtcache_header_t *H)
+{
+  memset(H, 0, sizeof(mtcache_header_t));
+  memcpy(H->magic, MTCACHE_MAGIC, 8);
+
+  H->version = MTCACHE_VERSION;
+  H->stride  = MT_GRID_STRIDE;
+  H->key     = key;
+  H->nx      = nx;
+  H->ny      = ny;
+  H->bb[0]   = bb.x.min;
+  H->bb[1]   = bb.x.max;
+  H->bb[2]   = bb.y.min;
+  H->bb[3]   = bb.y.max;
+}
+
+/* whether the file header is that which we would write */
+
+static int mtcache_match(const mtcache_header_t *H,
+			 uint64_t key, bbox_t bb, int nx, int ny)
+{
+  mtcache_header_t E;
+
+  mtcache_header(key, bb, nx, ny, &E);
+
+  return memcmp(H, &E, sizeof(mtcache_header_t)) == 0;
+}
+
+static size_t mtcache_gridsize(int nx, int ny)
+{
+  return (size_t)nx*ny*MT_GRID_STRIDE*sizeof(double);
+}
+
+/*
+  read the nx x ny grid on bb from the cache file, returns
+  ERROR_NODATA if the file is absent or was written for a
+  different key or grid (or is truncated)
+*/
+
+#ifdef MTCACHE_MMAP
+
+extern int mtcache_read(const char *path, uint64_t key,
+			bbox_t bb, int nx, int ny, mt_t *mt)
+{
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) == -1)
+    {
+      if (errno == ENOENT) return ERROR_NODATA;
+
+      fprintf(stderr, "error opening %s : %s\n", path, strerror(errno));
+      return ERROR_READ_OPEN;
+    }
+
+  int err = ERROR_NODATA;
+  size_t
+    nh = sizeof(mtcache_header_t),
+    ng = mtcache_gridsize(nx, ny);
+  struct stat sb;
+
+  if (fstat(fd, &sb) == -1)
+    {
+      fprintf(stderr, "error with %s : %s\n", path, strerror(errno));
+      err = ERROR_READ_OPEN;
+    }
+  else if ((size_t)sb.st_size == nh + ng)
+    {
+      void *m = mmap(NULL, nh + ng, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (m == MAP_FAILED)
+	{
+	  fprintf(stderr, "error mapping %s : %s\n", path, strerror(errno));
+	  err = ERROR_READ_OPEN;
+	}
+      else
+	{
+	  /* the tensor takes ownership of the mapping */
+
+	  if (mtcache_match(m, key, bb, nx, ny) &&
+	      ((err = metric_tensor_new_grid(bb, nx, ny,
+					     (double*)((char*)m + nh),
+					     mt)) == ERROR_OK))
+	    {
+	      mt->grid.map.addr = m;
+	      mt->grid.map.size = nh + ng;
+	    }
+	  else
+	    munmap(m, nh + ng);
+	}
+    }
+
+  close(fd);
+
+  return err;
+}
+
+#else
+
+extern int mtcache_read(const char *path, uint64_t key,
+			bbox_t bb, int nx, int ny, mt_t *mt)
+{
+  FILE *st;
+
+  if ((st = fopen(path, "rb")) == NULL)
+    {
+      if (errno == ENOENT) return ERROR_NODATA;
+
+      fprintf(stderr, "error opening %s : %s\n", path, strerror(errno));
+      return ERROR_READ_OPEN;
+    }
+
+  int err = ERROR_NODATA;
+  size_t ng = mtcache_gridsize(nx, ny);
+  mtcache_header_t H;
+  double *G;
+
+  if ((G = malloc(ng)) == NULL)
+    err = ERROR_MALLOC;
+  else if ((fread(&H, sizeof(mtcache_header_t), 1, st) == 1) &&
+	   mtcache_match(&H, key, bb, nx, ny) &&
+	   (fread(G, 1, ng, st) == ng) &&
+	   (fgetc(st) == EOF))
+    err = metric_tensor_new_grid(bb, nx, ny, G, mt);
+
+  if (err != ERROR_OK) free(G);
+
+  fclose(st);
+
+  return err;
+}
+
+#endif
+
+/*
+  open a temporary file in the same directory as path, into
+  which the cache is written and then renamed over path, so
+  that a reader (which may have the file mapped) only ever
+  sees a complete file; on success the name of the temporary
+  file is in tmp, which the caller frees
+*/
+
+#ifdef MTCACHE_MKSTEMP
+
+static FILE* mtcache_tmpfile(const char *path, char **tmp)
+{
+  if ((*tmp = malloc(strlen(path) + 8)) == NULL)
+    return NULL;
+
+  sprintf(*tmp, "%s.XXXXXX", path);
+
+  int fd;
+
+  if ((fd = mkstemp(*tmp)) == -1)
+    {
+      free(*tmp);
+      return NULL;
+    }
+
+  /* mkstemp() creates the file readable only by its owner */
+
+  FILE *st;
+
+  if ((fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1) ||
+      ((st = fdopen(fd, "wb")) == NULL))
+    {
+      close(fd);
+      unlink(*tmp);
+      free(*tmp);
+      return NULL;
+    }
+
+  return st;
+}
+
+#else
+
+static FILE* mtcache_tmpfile(const char *path, char **tmp)
+{
+  if ((*tmp = malloc(strlen(path) + 5)) == NULL)
+    return NULL;
+
+  sprintf(*tmp, "%s.tmp", path);
+
+  FILE *st;
+
+  if ((st = fopen(*tmp, "wb")) == NULL)
+    free(*tmp);
+
+  return st;
+}
+
+#endif
+
+/* write the uniform grid of the metric tensor */
+
+extern int mtcache_write(const char *path, uint64_t key, mt_t mt)
+{
+  const mt_grid_t *G = &(mt.grid);
+
+  if (G->v == NULL)
+    {
+      fprintf(stderr, "no uniform metric tensor grid to cache\n");
+      return ERROR_BUG;
+    }
+
+  FILE *st;
+  char *tmp;
+
+  if ((st = mtcache_tmpfile(path, &tmp)) == NULL)
+    {
+      fprintf(stderr, "error opening temporary file for %s : %s\n",
+	      path, strerror(errno));
+      return ERROR_WRITE_OPEN;
+    }
+
+  mtcache_header_t H;
+  size_t ng = mtcache_gridsize(G->nx, G->ny);
+
+  mtcache_header(key, G->bb, G->nx, G->ny, &H);
+
+  int err = ERROR_OK;
+
+  if ((fwrite(&H, sizeof(mtcache_header_t), 1, st) != 1) ||
+      (fwrite(G->v, 1, ng, st) != ng))
+    {
+      fprintf(stderr, "error writing %s : %s\n", path, strerror(errno));
+      err = ERROR_WRITE_OPEN;
+    }
+
+  if (fclose(st) != 0)
+    {
+      fprintf(stderr, "error closing %s : %s\n", tmp, strerror(errno));
+      err = ERROR_WRITE_OPEN;
+    }
+
+  if ((err == ERROR_OK) && (rename(tmp, path) != 0))
+    {
+      fprintf(stderr, "error renaming %s to %s : %s\n",
+	      tmp, path, strerror(errno));
+      err = ERROR_WRITE_OPEN;
+    }
+
+  if (err != ERROR_OK) remove(tmp);
+
+  free(tmp);
+
+  return err;
+}
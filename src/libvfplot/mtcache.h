@@ -0,0 +1,41 @@
+/*
+  mtcache.h
+  on-disk cache of the metric tensor
+*/
+
+#ifndef MTCACHE_H
+#define MTCACHE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bbox.h"
+#include "mt.h"
+
+/*
+  the uniform metric tensor grid (mt_grid_t) can be written
+  to a binary file and read back in a later run, so saving
+  the sampling of the field. The file is a fixed-size header
+  followed by the fused grid in native byte-order, so where
+  mmap() is available the tensor read is built directly on
+  the pages of the mapped file, without copying. The file
+  is written to a temporary file which is then renamed over
+  it by mtcache_write(), so a reader only ever sees complete
+  files, and a tensor read from the old file is unaffected.
+
+  The file holds a 64-bit key which the caller computes by
+  hashing (with mtcache_hash) everything on which the tensor
+  depends, the field data and the options; a file whose key,
+  bounding box or grid size do not match those requested is
+  ignored by mtcache_read(), which then returns ERROR_NODATA,
+  as it does if the file does not exist.
+*/
+
+#define MTCACHE_HASH_INIT 14695981039346656037ULL
+
+extern uint64_t mtcache_hash(uint64_t, const void*, size_t);
+
+extern int mtcache_read(const char*, uint64_t, bbox_t, int, int, mt_t*);
+extern int mtcache_write(const char*, uint64_t, mt_t);
+
+#endif
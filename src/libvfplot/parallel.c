@@ -0,0 +1,139 @@
+/*
+  parallel.c
+  run independent jobs on a number of threads
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "parallel.h"
+#include "error.h"
+
+typedef struct
+{
+  size_t n, next;
+  pfun_t f;
+  void *arg;
+  int err;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+#endif
+} parallel_t;
+
+#ifdef HAVE_PTHREAD_H
+
+/*
+  get the next job, returns zero when there are none left
+  (or when another thread has failed)
+*/
+
+static int parallel_next(parallel_t *P, size_t *k)
+{
+  int more = 0;
+
+  pthread_mutex_lock(&(P->mutex));
+
+  if ((P->err == ERROR_OK) && (P->next < P->n))
+    {
+      *k = P->next++;
+      more = 1;
+    }
+
+  pthread_mutex_unlock(&(P->mutex));
+
+  return more;
+}
+
+static void* parallel_worker(parallel_t *P)
+{
+  size_t k;
+
+  while (parallel_next(P, &k))
+    {
+      int err = P->f(k, P->arg);
+
+      if (err != ERROR_OK)
+	{
+	  pthread_mutex_lock(&(P->mutex));
+	  if (P->err == ERROR_OK) P->err = err;
+	  pthread_mutex_unlock(&(P->mutex));
+	}
+    }
+
+  return NULL;
+}
+
+#endif
+
+extern int parallel_for(size_t n, int nt, pfun_t f, void *arg)
+{
+#ifdef HAVE_PTHREAD_H
+
+  if ((nt > 1) && (n > 1))
+    {
+      parallel_t P = { .n = n, .next = 0, .f = f, .arg = arg, .err = ERROR_OK };
+      int err;
+
+      if ((err = pthread_mutex_init(&(P.mutex), NULL)) != 0)
+	{
+	  fprintf(stderr, "failed to init mutex: %s\n", strerror(err));
+	  return ERROR_PTHREAD;
+	}
+
+      if (nt > n) nt = n;
+
+      pthread_t thread[nt];
+      int nc = 0;
+
+      for (int k = 0 ; k < nt ; k++)
+	{
+	  err = pthread_create(thread+k, NULL,
+			       (void* (*)(void*))parallel_worker,
+			       (void*)&P);
+	  if (err)
+	    {
+	      fprintf(stderr, "failed to create thread %i: %s\n",
+		      k, strerror(err));
+	      break;
+	    }
+	  nc++;
+	}
+
+      /* if no threads could be created we do the work here */
+
+      if (nc == 0) parallel_worker(&P);
+
+      for (int k = 0 ; k < nc ; k++)
+	{
+	  if ((err = pthread_join(thread[k], NULL)) != 0)
+	    {
+	      fprintf(stderr, "error joining thread %i: %s\n",
+		      k, strerror(err));
+	      return ERROR_PTHREAD;
+	    }
+	}
+
+      pthread_mutex_destroy(&(P.mutex));
+
+      return P.err;
+    }
+
+#endif
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      int err = f(k, arg);
+
+      if (err != ERROR_OK) return err;
+    }
+
+  return ERROR_OK;
+}
@@ -0,0 +1,25 @@
+/*
+  parallel.h
+  run independent jobs on a number of threads
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdlib.h>
+
+/*
+  parallel_for(n, nt, f, arg) calls f(k, arg) for k in
+  [0, n) on nt threads, the jobs are taken one at a time
+  in order, so that large and small jobs are balanced.
+  The jobs should be independent and write their results
+  to per-job storage, so that the results do not depend
+  on the number of threads.  If a job returns an error
+  then no more are started, and that error is returned.
+*/
+
+typedef int (*pfun_t)(size_t, void*);
+
+extern int parallel_for(size_t, int, pfun_t, void*);
+
+#endif
@@ -6,6 +6,9 @@
 */
 
 #include <math.h>
+#include <stdio.h>
+
+#include <kdtree.h>
 
 #include "paths.h"
 #include "graph.h"
@@ -62,81 +65,129 @@ extern int paths_serialise(gstack_t* paths, size_t* nA, arrow_t** pA)
   Dmin as specified by the user (1.0 by default)
 */
 
-static int path_decimate(gstack_t**, double*);
-
-extern int paths_decimate(gstack_t* paths, double d)
+typedef struct
 {
-  return gstack_foreach(paths, (int(*)(void*,void*))path_decimate, &d);
-}
+  const arrow_margin_t *margin;
+  double Dmin;
+} decimate_opt_t;
 
-/*
-   gstack iterator, acts on a single path
+static int path_decimate(gstack_t**, decimate_opt_t*);
 
-   - dump the corners into the cns array
-
-   - create graph of ellipse intersections with nodes
-     weighted by the maximum length of their edges.
-     thus boundary corner nodes are precious
+extern int paths_decimate(gstack_t* paths, const arrow_margin_t *margin, double d)
+{
+  decimate_opt_t opt = {margin, d};
 
-   - totally disconnect the graph in a greedy manner
-     aimng to keep the weight high
+  return gstack_foreach(paths, (int(*)(void*,void*))path_decimate, &opt);
+}
 
-   - push the non-deleted node ellipses back onto
-     the stack
+/*
+  create the graph of ellipse intersections of the corners
+  cns[], with nodes weighted by the maximum of the contact
+  distances of their edges; if pid is not NULL then only
+  pairs of corners with different pid[] are considered.
 
   here "intersect" means the pw-distance D is less
   than Dmin, and since D = sqrt(x), x = contact(),
   it is the same to check x < xmin = Dmin^2
+
+  Only nearby pairs of ellipses are tested, found from a
+  kd-tree of the centres.  For ellipses with semi-axes at
+  most R and centres r apart, the contact function
+  at its first iterate t = 1/2 is at least |r|^2/4R^2, so
+  if |r| > 2R max(1, Dmin) then contact_mt() returns at
+  once with x > xmin: the pair does not intersect and is
+  not a failure, as if it had been tested.  Each pair is
+  tested from the ellipse with the larger semi-axis (the
+  smaller index if equal), so just once.
 */
 
-static int path_decimate(gstack_t** path, double* Dmin)
+#define DECIMATE_RANGE_EPS 1e-6
+
+static int decimate_graph(size_t n, const corner_t *cns, const size_t *pid,
+			  const decimate_opt_t *opt, graph_t *G)
 {
-  size_t n = gstack_size(*path);
-  double xmin = pow(*Dmin, 2);
-  corner_t cns[n];
+  double xmin = pow(opt->Dmin, 2);
 
-  /*
-    empty the stack into a corners array - we do this
-    in reverse order so the gstack_push below gives us
-    a gstack_t in the same order (needed due to an
-    assumed orientation of the boundaries)
-  */
+  /* cache metric tensor, ellipse centres and largest semi-axes */
 
-  for (int i = 0 ; i < n ; i++)
+  vector_t *e;
+  m2_t *mt;
+  double *a;
+
+  if ((e = malloc(n*sizeof(vector_t))) == NULL)
+    return -1;
+
+  if ((mt = malloc(n*sizeof(m2_t))) == NULL)
     {
-      if (gstack_pop(*path, (void*)(cns+(n-1-i))) != 0)
-	return -1;
+      free(e);
+      return -1;
     }
 
-  /* cache metric tensor and ellipse centres */
-
-  vector_t e[n];
-  m2_t mt[n];
+  if ((a = malloc(n*sizeof(double))) == NULL)
+    {
+      free(mt);
+      free(e);
+      return -1;
+    }
 
-  for (int i = 0 ; i < n ; i++)
+  for (size_t i = 0 ; i < n ; i++)
     {
       ellipse_t E;
 
-      arrow_ellipse(&(cns[i].A), &E);
+      arrow_ellipse_r(opt->margin, &(cns[i].A), &E);
 
       mt[i] = ellipse_mt(E);
       e[i] = E.centre;
+      a[i] = MAX(E.major, E.minor);
     }
 
-  /* create ellipse intersection graph */
+  /* the spatial index */
 
-  graph_t G;
+  struct kdtree *kd;
+  int ret = -1;
 
-  if (graph_init(n,&G) != 0)
-    return -1;
+  if (!(kd = kd_create(2)))
+    goto cleanup;
+
+  for (size_t i = 0 ; i < n ; i++)
+    {
+      double v[2] = {e[i].x, e[i].y};
+
+      if (kd_insert(kd, v, e+i) != 0)
+	goto cleanup;
+    }
+
+  double range = 2.0 * MAX(1.0, opt->Dmin) * (1 + DECIMATE_RANGE_EPS);
+
+  /* create ellipse intersection graph */
+
+  if (graph_init(n, G) != 0)
+    goto cleanup;
 
   size_t err = 0;
 
-  for (int i = 0 ; i < n-1 ; i++)
+  for (size_t i = 0 ; i < n ; i++)
     {
-      for (int j = i+1 ; j < n ; j++)
+      double v[2] = {e[i].x, e[i].y};
+      struct kdres *res;
+
+      if (!(res = kd_nearest_range(kd, v, range * a[i])))
+	goto cleanup_graph;
+
+      for ( ; ! kd_res_end(res) ; kd_res_next(res))
 	{
-	  double x = contact_mt(vsub(e[j], e[i]), mt[i], mt[j]);
+	  size_t j = (vector_t*)kd_res_item_data(res) - e;
+
+	  if ((a[j] > a[i]) || ((a[j] == a[i]) && (j <= i)))
+	    continue;
+
+	  if (pid && (pid[i] == pid[j]))
+	    continue;
+
+	  size_t
+	    i0 = MIN(i, j),
+	    i1 = MAX(i, j);
+	  double x = contact_mt(vsub(e[i1], e[i0]), mt[i0], mt[i1]);
 
 	  /*
 	    failed contact() results in edge not being
@@ -158,28 +209,86 @@ static int path_decimate(gstack_t** path, double* Dmin)
 	  if (x < xmin)
 	    {
 	      double
-		w1 = graph_get_weight(G, i),
-		w2 = graph_get_weight(G, j);
+		w1 = graph_get_weight(*G, i0),
+		w2 = graph_get_weight(*G, i1);
 
-	      graph_set_weight(G, i, MAX(w1, x));
-	      graph_set_weight(G, j, MAX(w2, x));
+	      graph_set_weight(*G, i0, MAX(w1, x));
+	      graph_set_weight(*G, i1, MAX(w2, x));
 
-	      if (graph_add_edge(G, i, j) != 0)
-		return -1;
+	      if (graph_add_edge(*G, i0, i1) != 0)
+		{
+		  kd_res_free(res);
+		  goto cleanup_graph;
+		}
 	    }
 	}
+
+      kd_res_free(res);
     }
 
   if (err)
     fprintf(stderr,"failed contact distance for %i pairs\n", (int)err);
 
-  /* greedy node deletion to obtain non-intersecting subset */
+  ret = 0;
+  goto cleanup;
 
-  size_t maxi;
+ cleanup_graph:
 
-  while (graph_maxedge(G, &maxi) > 0)
-    if (graph_del_node(G, maxi) != 0)
-      return -1;
+  graph_clean(G);
+
+ cleanup:
+
+  if (kd) kd_free(kd);
+  free(a);
+  free(mt);
+  free(e);
+
+  return ret;
+}
+
+/*
+   gstack iterator, acts on a single path
+
+   - dump the corners into the cns array
+
+   - create graph of ellipse intersections with nodes
+     weighted by the maximum length of their edges.
+     thus boundary corner nodes are precious
+
+   - totally disconnect the graph in a greedy manner
+     aimng to keep the weight high
+
+   - push the non-deleted node ellipses back onto
+     the stack
+*/
+
+static int path_decimate(gstack_t** path, decimate_opt_t* opt)
+{
+  size_t n = gstack_size(*path);
+  corner_t cns[n];
+
+  /*
+    empty the stack into a corners array - we do this
+    in reverse order so the gstack_push below gives us
+    a gstack_t in the same order (needed due to an
+    assumed orientation of the boundaries)
+  */
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      if (gstack_pop(*path, (void*)(cns+(n-1-i))) != 0)
+	return -1;
+    }
+
+  graph_t G;
+
+  if (decimate_graph(n, cns, NULL, opt, &G) != 0)
+    return -1;
+
+  /* greedy node deletion to obtain non-intersecting subset */
+
+  if (graph_decimate(G) != 0)
+    return -1;
 
   /* dump back into gstack */
 
@@ -191,3 +300,88 @@ static int path_decimate(gstack_t** path, double* Dmin)
 
   return 1;
 }
+
+/*
+  decimation between the paths: the corners of all of the
+  paths are collected into a single array (each path in its
+  original order) and decimated as above, but with only the
+  intersections of corners on different paths in the graph,
+  since those on the same path have been handled by
+  paths_decimate().  A path which loses all of its corners
+  is left empty.
+*/
+
+static int path_collect(gstack_t **path, gstack_t ***P)
+{
+  *((*P)++) = *path;
+
+  return 1;
+}
+
+extern int paths_decimate_inter(gstack_t* paths, const arrow_margin_t *margin, double d)
+{
+  size_t
+    np = gstack_size(paths),
+    n = paths_count(paths);
+
+  if ((np < 2) || (n < 2)) return 0;
+
+  gstack_t **path, **P;
+
+  if ((path = malloc(np*sizeof(gstack_t*))) == NULL)
+    return 1;
+
+  P = path;
+  gstack_foreach(paths, (int(*)(void*,void*))path_collect, &P);
+
+  corner_t *cns;
+  size_t *pid;
+
+  if ((cns = malloc(n*sizeof(corner_t))) == NULL)
+    {
+      free(path);
+      return 1;
+    }
+
+  if ((pid = malloc(n*sizeof(size_t))) == NULL)
+    {
+      free(cns);
+      free(path);
+      return 1;
+    }
+
+  size_t i0 = 0;
+
+  for (size_t k = 0 ; k < np ; k++)
+    {
+      size_t m = gstack_size(path[k]);
+
+      for (size_t i = 0 ; i < m ; i++)
+	{
+	  gstack_pop(path[k], (void*)(cns + i0 + (m-1-i)));
+	  pid[i0 + i] = k;
+	}
+
+      i0 += m;
+    }
+
+  /* on failure the paths are restored unchanged */
+
+  decimate_opt_t opt = {margin, d};
+  graph_t G;
+  int
+    built = (decimate_graph(n, cns, pid, &opt, &G) == 0),
+    err = (! built) || (graph_decimate(G) != 0);
+
+  for (size_t i = 0 ; i < n ; i++)
+    if ( err || !graph_node_flag(G, i, NODE_STALE) )
+      gstack_push(path[pid[i]], (void*)(cns+i));
+
+  if (built) graph_clean(&G);
+
+  free(pid);
+  free(cns);
+  free(path);
+
+  return err;
+}
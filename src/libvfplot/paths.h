@@ -25,7 +25,8 @@ typedef struct
 } corner_t;
 
 extern size_t paths_count(gstack_t*);
-extern int paths_decimate(gstack_t*, double);
+extern int paths_decimate(gstack_t*, const arrow_margin_t*, double);
+extern int paths_decimate_inter(gstack_t*, const arrow_margin_t*, double);
 extern int paths_serialise(gstack_t*, size_t*, arrow_t**);
 
 #endif
@@ -41,11 +41,23 @@ extern int sagwrite(const char *file,
       return ERROR_BUG;
     }
 
+  unsigned char *mask;
+
+  if ((mask = malloc(n*m)) == NULL)
+    return ERROR_MALLOC;
+
+  if (domain_mask_grid(dom, bb, n, m, mask) != 0)
+    {
+      free(mask);
+      return ERROR_MALLOC;
+    }
+
   FILE* st = fopen(file,"w");
 
   if (!st)
     {
       fprintf(stderr,"failed to open %s\n",file);
+      free(mask);
       return ERROR_WRITE_OPEN;
     }
 
@@ -71,9 +83,8 @@ extern int sagwrite(const char *file,
       for (j=0 ; j<m ; j++)
 	{
 	  double t,m,y = y0 + (j + 0.5)*dy;
-	  vector_t v = {x, y};
 
-	  if (! domain_inside(v, dom)) continue;
+	  if (! mask[j*n + i]) continue;
 
 	  /* fv is non-zero for nodata */
 
@@ -83,6 +94,7 @@ extern int sagwrite(const char *file,
     }
 
   fclose(st);
+  free(mask);
 
   return ERROR_OK;
 }
@@ -0,0 +1,666 @@
+/*
+  tile.c
+  tiled dynamics at dimension 2 for large domains
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tile.h"
+
+#include "error.h"
+#include "macros.h"
+#include "parallel.h"
+#include "status.h"
+
+/*
+  the width of the overlap of the tiles (and of the band
+  either side of a seam which is relaxed in the final pass)
+  in units of the diameter of the circle with the mean
+  ellipse area
+*/
+
+#define TILE_OVERLAP 3.0
+
+/*
+  the width, in the same units, of the ring of interior
+  glyphs just outside the seam band which are held fixed
+  in the seam pass
+*/
+
+#define TILE_RING 2.0
+
+/*
+  the seam pass is run with the main iterations divided
+  by this factor (and starts at the cleaning phase)
+*/
+
+#define TILE_SEAM_ITER 4
+
+/*
+  sample points on each axis of a tile used to check
+  whether it meets the domain at all
+*/
+
+#define TILE_SAMPLES 16
+
+/*
+  the result of the dynamics on a tile is reduced to the
+  glyphs in its core, the nI interior glyphs (away from the
+  seams) then the nS in the seam band, with ring[i] set for
+  the interior glyphs in the ring.  The nE network edges
+  between the interior glyphs, or between an interior and a
+  boundary glyph, are kept with the id of an interior glyph
+  being its index in A, that of boundary glyph j being -1-j.
+*/
+
+typedef struct
+{
+  bbox_t ext;
+  size_t nI, nS, nE;
+  arrow_t *A;
+  unsigned char *ring;
+  nbs_t *E;
+} tile_t;
+
+typedef struct
+{
+  const dim2_opt_t *opt;
+  bbox_t bb;
+  int tx, ty;
+  double ovlp, ring;
+  size_t nB;
+  const arrow_t *B;
+  size_t n;
+  tile_t *tile;
+} tiles_t;
+
+/*
+  copy those arrows with centres in the bounding box
+  into a newly allocated array, if id is non-NULL then
+  it is also allocated and given the indices of the
+  arrows copied
+*/
+
+static int arrows_in(bbox_t bb, size_t n, const arrow_t *A,
+		     size_t *pm, arrow_t **pB, size_t **pid)
+{
+  arrow_t *B = NULL;
+  size_t m = 0, *id = NULL;
+
+  if (n > 0)
+    {
+      if ((B = malloc(n*sizeof(arrow_t))) == NULL)
+	return ERROR_MALLOC;
+
+      if (pid && ((id = malloc(n*sizeof(size_t))) == NULL))
+	{
+	  free(B);
+	  return ERROR_MALLOC;
+	}
+
+      for (size_t i = 0 ; i < n ; i++)
+	{
+	  if (! bbox_contains(bb, A[i].centre)) continue;
+	  if (id) id[m] = i;
+	  B[m++] = A[i];
+	}
+    }
+
+  *pm = m;
+  *pB = B;
+
+  if (pid) *pid = id;
+
+  return ERROR_OK;
+}
+
+/*
+  whether the tile meets the domain, we check the
+  boundary arrows first then sample a grid
+*/
+
+static int tile_live(const tiles_t *T, const tile_t *t)
+{
+  for (size_t i = 0 ; i < T->nB ; i++)
+    if (bbox_contains(t->ext, T->B[i].centre)) return 1;
+
+  double
+    dx = bbox_width(t->ext)/TILE_SAMPLES,
+    dy = bbox_height(t->ext)/TILE_SAMPLES;
+
+  for (int i = 0 ; i < TILE_SAMPLES ; i++)
+    {
+      for (int j = 0 ; j < TILE_SAMPLES ; j++)
+	{
+	  vector_t v = {t->ext.x.min + (i+0.5)*dx,
+			t->ext.y.min + (j+0.5)*dy};
+
+	  if (dindex_inside(v, T->opt->dix)) return 1;
+	}
+    }
+
+  return 0;
+}
+
+/*
+  whether a point is within distance d of one of the
+  internal edges of the tx x ty tiling of the bbox
+*/
+
+static int in_seam(vector_t v, bbox_t bb, int tx, int ty, double d)
+{
+  double
+    dx = bbox_width(bb)/tx,
+    dy = bbox_height(bb)/ty;
+  int
+    i = (int)round((v.x - bb.x.min)/dx),
+    j = (int)round((v.y - bb.y.min)/dy);
+
+  if ((i > 0) && (i < tx) && (fabs(v.x - (bb.x.min + i*dx)) < d))
+    return 1;
+
+  if ((j > 0) && (j < ty) && (fabs(v.y - (bb.y.min + j*dy)) < d))
+    return 1;
+
+  return 0;
+}
+
+/*
+  the index of the tile whose core contains the point,
+  the cores being half-open so that each point is in
+  exactly one
+*/
+
+static size_t tile_index(vector_t v, bbox_t bb, int tx, int ty)
+{
+  int
+    i = (int)floor(tx*(v.x - bb.x.min)/bbox_width(bb)),
+    j = (int)floor(ty*(v.y - bb.y.min)/bbox_height(bb));
+
+  i = MAX(0, MIN(tx-1, i));
+  j = MAX(0, MIN(ty-1, j));
+
+  return (size_t)i*ty + j;
+}
+
+/*
+  reduce the result of the dynamics on the tile, the nF
+  fixed arrows at the start of A being the boundary arrows
+  with indices bid, to the tile_t form above
+*/
+
+#define TILE_FOREIGN -1
+#define TILE_SEAM    -2
+
+static int tile_reduce(const tiles_t *T, tile_t *t,
+		       size_t nF, const size_t *bid,
+		       size_t nA, const arrow_t *A,
+		       size_t nN, const nbs_t *N)
+{
+  size_t k = t - T->tile, nI = 0, nS = 0, nE = 0;
+  long *id;
+
+  if ((id = malloc(MAX(nA, 1)*sizeof(long))) == NULL)
+    return ERROR_MALLOC;
+
+  for (size_t m = 0 ; m < nF ; m++)
+    id[m] = -1 - (long)bid[m];
+
+  for (size_t m = nF ; m < nA ; m++)
+    {
+      vector_t v = A[m].centre;
+
+      if (tile_index(v, T->bb, T->tx, T->ty) != k)
+	id[m] = TILE_FOREIGN;
+      else if (in_seam(v, T->bb, T->tx, T->ty, T->ovlp))
+	{
+	  id[m] = TILE_SEAM;
+	  nS++;
+	}
+      else
+	id[m] = nI++;
+    }
+
+  for (size_t e = 0 ; e < nN ; e++)
+    {
+      long a = id[N[e].a.id], b = id[N[e].b.id];
+
+      if ((a == TILE_FOREIGN) || (a == TILE_SEAM) ||
+	  (b == TILE_FOREIGN) || (b == TILE_SEAM))
+	continue;
+
+      nE++;
+    }
+
+  size_t nC = nI + nS;
+
+  t->A    = malloc(MAX(nC, 1)*sizeof(arrow_t));
+  t->ring = malloc(MAX(nI, 1));
+  t->E    = malloc(MAX(nE, 1)*sizeof(nbs_t));
+
+  if (!(t->A && t->ring && t->E))
+    {
+      free(id);
+      return ERROR_MALLOC;
+    }
+
+  size_t iS = nI;
+
+  for (size_t m = nF ; m < nA ; m++)
+    {
+      switch (id[m])
+	{
+	case TILE_FOREIGN:
+	  break;
+
+	case TILE_SEAM:
+	  t->A[iS++] = A[m];
+	  break;
+
+	default:
+	  t->A[id[m]] = A[m];
+	  t->ring[id[m]] = in_seam(A[m].centre, T->bb, T->tx, T->ty,
+				   T->ovlp + T->ring);
+	}
+    }
+
+  nE = 0;
+
+  for (size_t e = 0 ; e < nN ; e++)
+    {
+      long a = id[N[e].a.id], b = id[N[e].b.id];
+
+      if ((a == TILE_FOREIGN) || (a == TILE_SEAM) ||
+	  (b == TILE_FOREIGN) || (b == TILE_SEAM))
+	continue;
+
+      t->E[nE] = N[e];
+      t->E[nE].a.id = a;
+      t->E[nE].b.id = b;
+      nE++;
+    }
+
+  free(id);
+
+  t->nI = nI;
+  t->nS = nS;
+  t->nE = nE;
+
+  return ERROR_OK;
+}
+
+/*
+  run the dynamics on a single tile, the fixed particles
+  are the boundary arrows in the extended tile and any
+  warm start is likewise restricted; the result is reduced
+  as soon as the dynamics complete, so that only the tiles
+  in progress hold their full particle sets; a job for
+  parallel_for()
+*/
+
+static int tile_dim2(size_t k, const tiles_t *T)
+{
+  tile_t *t = T->tile + k;
+  int err;
+  dim2_opt_t opt = *(T->opt);
+
+  if (! tile_live(T, t)) return ERROR_OK;
+
+  opt.tile = &(t->ext);
+  opt.v.verbose = false;
+  opt.v.threads = 1;
+  opt.v.place.adaptive.animate = false;
+  opt.v.place.adaptive.histogram = NULL;
+
+  size_t nW = 0;
+  arrow_t *W = NULL;
+
+  if ((err = arrows_in(t->ext,
+		       T->opt->v.place.adaptive.warm.n,
+		       T->opt->v.place.adaptive.warm.A,
+		       &nW, &W, NULL)) != ERROR_OK)
+    return err;
+
+  opt.v.place.adaptive.warm.n = nW;
+  opt.v.place.adaptive.warm.A = W;
+
+  size_t nA, nF, nN = 0, *bid;
+  arrow_t *A;
+  nbs_t *N = NULL;
+
+  if ((err = arrows_in(t->ext, T->nB, T->B, &nA, &A, &bid)) != ERROR_OK)
+    {
+      free(W);
+      return err;
+    }
+
+  nF = nA;
+
+  err = dim2(&opt, &nA, &A, &nN, &N);
+
+  free(W);
+
+  switch (err)
+    {
+    case ERROR_OK:
+      err = tile_reduce(T, t, nF, bid, nA, A, nN, N);
+      break;
+
+    case ERROR_NODATA:
+
+      /*
+	the dynamics found nothing to place in the tile,
+	typically when it barely meets the domain
+      */
+
+      err = ERROR_OK;
+      break;
+    }
+
+  free(bid);
+  free(A);
+  free(N);
+
+  return err;
+}
+
+/*
+  the seam pass: the dynamics are run with the nS seam
+  glyphs free and, held fixed, the boundary arrows and the
+  ring glyphs near the seams (so that the seam glyphs do not
+  escape into the interiors, which are not included).  On
+  return the nF arrows in F are these fixed arrows then the
+  relaxed seam glyphs, fid the output index of each of the
+  first n1 arrows (the fixed ones), and N the network of
+  the seam glyphs
+*/
+
+static int seam_pass(const tiles_t *T, size_t nS,
+		     size_t *n1, size_t *nF, arrow_t **pF, size_t **pfid,
+		     size_t *nN, nbs_t **pN)
+{
+  int err;
+  size_t nR = 0, nB = 0;
+
+  for (size_t k = 0 ; k < T->n ; k++)
+    for (size_t i = 0 ; i < T->tile[k].nI ; i++)
+      nR += T->tile[k].ring[i];
+
+  for (size_t i = 0 ; i < T->nB ; i++)
+    nB += in_seam(T->B[i].centre, T->bb, T->tx, T->ty, T->ovlp + T->ring);
+
+  arrow_t *F, *W;
+  size_t *fid;
+
+  F   = malloc(MAX(nB + nR, 1)*sizeof(arrow_t));
+  fid = malloc(MAX(nB + nR, 1)*sizeof(size_t));
+  W   = malloc(MAX(nS, 1)*sizeof(arrow_t));
+
+  if (!(F && fid && W))
+    {
+      free(F);
+      free(fid);
+      free(W);
+      return ERROR_MALLOC;
+    }
+
+  size_t iF = 0, iW = 0, off = T->nB;
+
+  for (size_t i = 0 ; i < T->nB ; i++)
+    {
+      if (! in_seam(T->B[i].centre, T->bb, T->tx, T->ty, T->ovlp + T->ring))
+	continue;
+
+      fid[iF] = i;
+      F[iF++] = T->B[i];
+    }
+
+  for (size_t k = 0 ; k < T->n ; k++)
+    {
+      const tile_t *t = T->tile + k;
+
+      for (size_t i = 0 ; i < t->nI ; i++)
+	{
+	  if (! t->ring[i]) continue;
+
+	  fid[iF] = off + i;
+	  F[iF++] = t->A[i];
+	}
+
+      for (size_t i = 0 ; i < t->nS ; i++)
+	W[iW++] = t->A[t->nI + i];
+
+      off += t->nI;
+    }
+
+  dim2_opt_t sopt = *(T->opt);
+
+  sopt.tile = NULL;
+  sopt.v.place.adaptive.warm.n = nS;
+  sopt.v.place.adaptive.warm.A = W;
+  sopt.v.place.adaptive.iter.main =
+    MAX(1, T->opt->v.place.adaptive.iter.main/TILE_SEAM_ITER);
+
+  if (T->opt->v.verbose)
+    {
+      printf("seam relaxation\n");
+      status("fixed", iF);
+    }
+
+  *n1 = *nF = iF;
+
+  err = dim2(&sopt, nF, &F, nN, pN);
+
+  free(W);
+
+  if (err != ERROR_OK)
+    {
+      free(F);
+      free(fid);
+      return err;
+    }
+
+  *pF = F;
+  *pfid = fid;
+
+  return ERROR_OK;
+}
+
+/*
+  the domain's bounding box is split into tx x ty tiles,
+  each is extended by an overlap and the dynamics run on
+  the tiles concurrently, with the boundary arrows (those
+  passed in nA, pA as for dim2) falling in the extended
+  tile held fixed.  Each tile contributes the arrows in
+  its (unextended) core.
+
+  The seams are then stitched by a final short run of the
+  dynamics on the glyphs in the bands around the seams,
+  walled in by a fixed ring of the interior glyphs, see
+  seam_pass() above.  The interior glyphs are output as
+  they are, and the network is that of the tiles' interiors
+  and of the seam pass.
+*/
+
+extern int dim2_tiled(dim2_opt_t *opt, int tx, int ty,
+		      size_t *nA, arrow_t **pA,
+		      size_t *nN, nbs_t **pN)
+{
+  int err = ERROR_OK;
+  bbox_t bb = opt->v.bbox;
+  double
+    dx = bbox_width(bb)/tx,
+    dy = bbox_height(bb)/ty,
+    diam = 2.0 * sqrt(opt->area/M_PI),
+    ovlp = TILE_OVERLAP * diam;
+  size_t n = (size_t)tx*ty;
+  tile_t *tile;
+
+  if ((tile = malloc(n*sizeof(tile_t))) == NULL)
+    return ERROR_MALLOC;
+
+  for (int i = 0 ; i < tx ; i++)
+    {
+      for (int j = 0 ; j < ty ; j++)
+	{
+	  tile_t *t = tile + ((size_t)i*ty + j);
+	  bbox_t
+	    core = BBOX(bb.x.min + i*dx, bb.x.min + (i+1)*dx,
+			bb.y.min + j*dy, bb.y.min + (j+1)*dy),
+	    ext = BBOX(MAX(core.x.min - ovlp, bb.x.min),
+		       MIN(core.x.max + ovlp, bb.x.max),
+		       MAX(core.y.min - ovlp, bb.y.min),
+		       MIN(core.y.max + ovlp, bb.y.max));
+
+	  t->ext  = ext;
+	  t->nI   = t->nS = t->nE = 0;
+	  t->A    = NULL;
+	  t->ring = NULL;
+	  t->E    = NULL;
+	}
+    }
+
+  if (opt->v.verbose)
+    printf("tiling %i x %i, overlap %.3g\n", tx, ty, ovlp);
+
+  tiles_t T = { .opt = opt,
+		.bb = bb, .tx = tx, .ty = ty,
+		.ovlp = ovlp, .ring = TILE_RING * diam,
+		.nB = *nA, .B = *pA,
+		.n = n, .tile = tile };
+
+  if ((err = parallel_for(n, opt->v.threads, (pfun_t)tile_dim2, &T)) != ERROR_OK)
+    {
+      fprintf(stderr, "failed dynamics on tile\n");
+      goto cleanup;
+    }
+
+  size_t nI = 0, nS = 0, nE = 0;
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      nI += tile[k].nI;
+      nS += tile[k].nS;
+      nE += tile[k].nE;
+    }
+
+  if (opt->v.verbose)
+    {
+      status("tiles", nI + nS);
+      status("seams", nS);
+    }
+
+  /* the seam pass, if there is anything to relax */
+
+  size_t n1 = 0, nF = 0, nNs = 0, *fid = NULL;
+  arrow_t *F = NULL;
+  nbs_t *Ns = NULL;
+
+  if (nS > 0)
+    {
+      switch (err = seam_pass(&T, nS, &n1, &nF, &F, &fid, &nNs, &Ns))
+	{
+	case ERROR_OK:
+	  break;
+
+	case ERROR_NODATA:
+	  n1 = nF = nNs = 0;
+	  err = ERROR_OK;
+	  break;
+
+	default:
+	  fprintf(stderr, "failed seam relaxation\n");
+	  goto cleanup;
+	}
+    }
+
+  /*
+    the output is the boundary arrows, the interior glyphs
+    of each tile in turn (so that the ring glyphs are at the
+    output indices given in fid), then the seam glyphs; the
+    tile results are freed as they are transferred
+  */
+
+  size_t
+    nB = *nA,
+    nO = nB + nI + (nF - n1);
+  arrow_t *A = NULL;
+  nbs_t *N = NULL;
+
+  if (((A = realloc(*pA, nO*sizeof(arrow_t))) == NULL) ||
+      ((N = malloc(MAX(nE + nNs, 1)*sizeof(nbs_t))) == NULL))
+    {
+      if (A) *pA = A;
+      err = ERROR_MALLOC;
+      goto seam_cleanup;
+    }
+
+  *pA = A;
+
+  size_t iA = nB, iN = 0;
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      tile_t *t = tile + k;
+
+      for (size_t e = 0 ; e < t->nE ; e++, iN++)
+	{
+	  N[iN] = t->E[e];
+	  N[iN].a.id = (N[iN].a.id < 0 ? -1 - N[iN].a.id : iA + N[iN].a.id);
+	  N[iN].b.id = (N[iN].b.id < 0 ? -1 - N[iN].b.id : iA + N[iN].b.id);
+	}
+
+      if (t->nI > 0)
+	memcpy(A + iA, t->A, t->nI*sizeof(arrow_t));
+
+      iA += t->nI;
+
+      free(t->A);
+      free(t->ring);
+      free(t->E);
+
+      t->A    = NULL;
+      t->ring = NULL;
+      t->E    = NULL;
+    }
+
+  for (size_t i = n1 ; i < nF ; i++)
+    A[iA++] = F[i];
+
+  for (size_t e = 0 ; e < nNs ; e++, iN++)
+    {
+      N[iN] = Ns[e];
+      N[iN].a.id = ((size_t)Ns[e].a.id < n1 ? fid[Ns[e].a.id] : nB + nI + Ns[e].a.id - n1);
+      N[iN].b.id = ((size_t)Ns[e].b.id < n1 ? fid[Ns[e].b.id] : nB + nI + Ns[e].b.id - n1);
+    }
+
+  *nA = nO;
+  *nN = iN;
+  *pN = N;
+
+ seam_cleanup:
+
+  free(F);
+  free(fid);
+  free(Ns);
+
+ cleanup:
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      free(tile[k].A);
+      free(tile[k].ring);
+      free(tile[k].E);
+    }
+
+  free(tile);
+
+  return err;
+}
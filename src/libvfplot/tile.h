@@ -0,0 +1,15 @@
+/*
+  tile.h
+  tiled dynamics at dimension 2 for large domains
+*/
+
+#ifndef TILE_H
+#define TILE_H
+
+#include "dim2.h"
+
+extern int dim2_tiled(dim2_opt_t*, int, int,
+		      size_t*, arrow_t**,
+		      size_t*, nbs_t**);
+
+#endif
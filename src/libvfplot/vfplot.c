@@ -329,10 +329,13 @@ static int vfplot_scaled(FILE *st,
 
   /* this needed if we draw the ellipses */
 
-  arrow_register(opt->place.adaptive.margin.rate,
-		 opt->place.adaptive.margin.major,
-		 opt->place.adaptive.margin.minor,
-		 1.0);
+  arrow_margin_t emargin =
+    {
+      opt->place.adaptive.margin.rate,
+      opt->place.adaptive.margin.major,
+      opt->place.adaptive.margin.minor,
+      1.0
+    };
 
   /*
      file header
@@ -1222,7 +1225,7 @@ static int vfplot_scaled(FILE *st,
 	    {
 	      ellipse_t e;
 
-	      arrow_ellipse(A+i, &e);
+	      arrow_ellipse_r(&emargin, A+i, &e);
 
 	      fprintf(st, "%.2f %.2f %.2f %.2f %.2f E\n",
 		      e.theta*DEG_PER_RAD + 180.0,
@@ -1246,7 +1249,7 @@ static int vfplot_scaled(FILE *st,
 	    {
 	      ellipse_t e;
 
-	      arrow_ellipse(A+i, &e);
+	      arrow_ellipse_r(&emargin, A+i, &e);
 
 	      fprintf(st, "E(%.2f, %.2f, %.2f, %.2f, %.2f)\n",
 		      e.centre.x,
@@ -1287,7 +1290,7 @@ static int vfplot_scaled(FILE *st,
                   fprintf(st, "fill=ellipse_fill");
                 }
 
-	      arrow_ellipse(A+i, &e);
+	      arrow_ellipse_r(&emargin, A+i, &e);
               fprintf(st, "] (0, 0) ellipse (%f and %f);\n\\end{scope}\n",
                   e.major,
                   e.minor);
@@ -10,6 +10,7 @@
 #define VFPLOT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef bool bool_t;
 
@@ -92,6 +93,8 @@ typedef struct
 {
   bool_t verbose;
 
+  /* if more than one, see the note on f, g below */
+
   int threads;
 
   /* placement specific options */
@@ -104,13 +107,30 @@ typedef struct
       break_t breakout;
       iterations_t iter;
       int mtcache;
+      double mttol;
+
+      struct {
+	const char *file;
+	uint64_t key;
+      } mtfile;
+
       double overfill;
       double timestep;
       double kedrop;
       char* histogram;
+      bool_t single;
+
+      struct {
+	size_t n;
+	const arrow_t *A;
+      } warm;
 
       struct {
-	bool_t late;
+	int x, y;
+      } tiles;
+
+      struct {
+	bool_t late, inter;
 	double contact;
       } decimate;
 
@@ -220,11 +240,56 @@ extern int vfplot_iniopt(bbox_t, vfp_opt_t*);
 
   The constructor should be passed an array of arrows
   which will be used to store the result
+
+  Each constructor also has a reentrant version vfplot_<type>_r
+  which takes a context (see context.h) in place of f, g and
+  field, so that several plots can be made concurrently.
 */
 
 typedef int (*vfun_t)(void*, double, double, double*, double*);
 typedef int (*cfun_t)(void*, double, double, double*);
 
+/*
+  a field may also provide a batch version of f
+
+  fb     : int fb(field,n,x,y,theta,magnitude)
+
+  which evaluates the field at the n points (x[k], y[k]),
+  setting theta[k] and magnitude[k] to NaN where the field
+  has no data, and returns nonzero only on failure. This is
+  registered with a context (see context.h) and is then used
+  where vfplot queries the field at many points at once.
+*/
+
+typedef int (*vfun_batch_t)(void*, size_t, const double*, const double*,
+			    double*, double*);
+
+/*
+  and a field without a curvature function may provide its
+  Jacobian
+
+  fj     : int fj(field,x,y,u,v,J)
+
+  which sets u, v to the Cartesian components of the field
+  at (x, y), or of any positive multiple of it, and J to the
+  Jacobian of (u, v), the array du/dx, du/dy, dv/dx, dv/dy,
+  returning nonzero where the field has no data.  This is
+  registered with a context and the curvature is then found
+  in closed form, rather than by tracing streamlines.
+*/
+
+typedef int (*jfun_t)(void*, double, double, double*, double*, double*);
+
+/*
+  when the threads option is more than one, the constructors
+  (including the non-reentrant vfplot_<type>) sample the field
+  and place glyphs in several threads, so f, g, fb and fj may
+  be called concurrently on the same field; they must then be
+  thread-safe (read-only access to the field is enough).  With
+  one thread they are only called serially, from the calling
+  thread.
+*/
+
 /* the constructors are defined in seperate files */
 
 /*
@@ -0,0 +1,295 @@
+/*
+  bench.c
+  timing of bilinear() on the u component of sag files
+  or on synthetic grids, in Mq/s, see README.md
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <vfplot/error.h>
+#include <vfplot/bilinear.h>
+#include <vfplot/sagread.h>
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static bilinear_t* read_sag(const char *file)
+{
+  sagread_t S;
+
+  if (sagread_open(file, &S) != SAGREAD_OK)
+    {
+      fprintf(stderr, "failed open of %s\n", file);
+      return NULL;
+    }
+
+  if ((S.grid.dim != 2) || (S.vector.dim != 2))
+    {
+      fprintf(stderr, "%s is not a 2-d vector grid\n", file);
+      return NULL;
+    }
+
+  bbox_t bb =
+    {{S.grid.bnd[0].min, S.grid.bnd[0].max},
+     {S.grid.bnd[1].min, S.grid.bnd[1].max}};
+  bilinear_t *B;
+
+  if (((B = bilinear_new()) == NULL) ||
+      (bilinear_dimension(S.grid.n[0], S.grid.n[1], bb, B) != ERROR_OK))
+    return NULL;
+
+  int err;
+
+  do
+    {
+      size_t n[2];
+      double x[2];
+
+      if ((err = sagread_line(S, n, x)) == SAGREAD_OK)
+	bilinear_setz(n[0], n[1], x[0], B);
+      else if (err == SAGREAD_ERROR)
+	{
+	  fprintf(stderr, "error reading %s\n", file);
+	  return NULL;
+	}
+    }
+  while (err != SAGREAD_EOF);
+
+  sagread_close(S);
+
+  return B;
+}
+
+/* a smooth field with a nodata hole */
+
+static int hole(double x, double y, void *arg, double *z)
+{
+  double dx = x - 0.5, dy = y - 0.5;
+
+  if (dx*dx + dy*dy < 0.04) return ERROR_NODATA;
+
+  *z = sin(7*x) * cos(5*y);
+
+  return ERROR_OK;
+}
+
+static bilinear_t* synthetic(int n)
+{
+  bbox_t bb = {{0, 1}, {0, 1}};
+  bilinear_t *B;
+
+  if (((B = bilinear_new()) == NULL) ||
+      (bilinear_dimension(n, n, bb, B) != ERROR_OK) ||
+      (bilinear_sample(hole, NULL, B) != ERROR_OK))
+    return NULL;
+
+  return B;
+}
+
+/*
+  time nq queries (the same points for each call) returning
+  the rate in millions of queries per second, and the sum of
+  the values as a check.  The points are either uniformly
+  random in the bbox; or a random walk with steps of about
+  a tenth of a grid cell (as the queries from the dynamics
+  or from streamline tracing would be); or random in the
+  cells on the last row or column of cells of a tile, for
+  which the corners are on the edges of the tile, so shared
+  with its neighbours
+*/
+
+enum { POINTS_RANDOM, POINTS_WALK, POINTS_EDGE, POINTS_N };
+
+static const char *points_name[POINTS_N] = {"random", "walk", "edge"};
+
+static double timing(bilinear_t *B, size_t nq, int points, double *sum)
+{
+  bbox_t bb = bilinear_bbox(B);
+  double w = bbox_width(bb), h = bbox_height(bb);
+  int nx, ny, m = (1 << BILINEAR_TILE) - 1;
+
+  bilinear_nxy(B, &nx, &ny);
+
+  double
+    sx = 0.1*w/nx,
+    sy = 0.1*h/ny,
+    x = bb.x.min + w/2,
+    y = bb.y.min + h/2;
+
+  srand48(1);
+
+  double t0 = now();
+
+  *sum = 0.0;
+
+  for (size_t k = 0 ; k < nq ; k++)
+    {
+      double z;
+
+      switch (points)
+	{
+	case POINTS_WALK:
+
+	  x += sx*(drand48() - 0.5);
+	  y += sy*(drand48() - 0.5);
+
+	  if ((x < bb.x.min) || (x > bb.x.max)) x = bb.x.min + w/2;
+	  if ((y < bb.y.min) || (y > bb.y.max)) y = bb.y.min + h/2;
+
+	  break;
+
+	case POINTS_EDGE:
+	  {
+	    int
+	      i = (nx - 1)*drand48(),
+	      j = (ny - 1)*drand48();
+
+	    if (k & 1)
+	      i = MIN(i | m, nx - 2);
+	    else
+	      j = MIN(j | m, ny - 2);
+
+	    x = bb.x.min + w*(i + drand48())/(nx - 1);
+	    y = bb.y.min + h*(j + drand48())/(ny - 1);
+	  }
+	  break;
+
+	default:
+
+	  x = bb.x.min + w*drand48();
+	  y = bb.y.min + h*drand48();
+	}
+
+      if (bilinear(x, y, B, &z) == ERROR_OK)
+	*sum += z;
+    }
+
+  double t1 = now();
+
+  return nq/(t1 - t0)/1e6;
+}
+
+/*
+  the query rate for the plain grid, then after converting
+  to tiled storage, then after compiling (which is skipped
+  for grids larger than those compiled by vfplot, since the
+  compiled form is four times the size)
+*/
+
+#define FORMS 3
+#define COMPILE_MAX (1 << 22)
+
+static int bench(const char *name, bilinear_t *B, size_t nq)
+{
+  double r[FORMS][POINTS_N], s[FORMS][POINTS_N];
+  int nx, ny, nf = FORMS;
+
+  bilinear_nxy(B, &nx, &ny);
+
+  if ((size_t)nx*ny > COMPILE_MAX) nf--;
+
+  for (int f = 0 ; f < nf ; f++)
+    {
+      int err = ERROR_OK;
+
+      switch (f)
+	{
+	case 1: err = bilinear_tile(B); break;
+	case 2: err = bilinear_compile(B); break;
+	}
+
+      if (err != ERROR_OK)
+	{
+	  fprintf(stderr, "failed conversion\n");
+	  return 1;
+	}
+
+      for (int p = 0 ; p < POINTS_N ; p++)
+	r[f][p] = timing(B, nq, p, s[f] + p);
+    }
+
+  for (int p = 0 ; p < POINTS_N ; p++)
+    {
+      int ok = 1;
+
+      for (int f = 1 ; f < nf ; f++)
+	if (fabs(s[f][p] - s[0][p]) > 1e-9*(fabs(s[0][p]) + 1))
+	  ok = 0;
+
+      printf("%-24s %-6s", name, points_name[p]);
+
+      for (int f = 0 ; f < FORMS ; f++)
+	{
+	  if (f < nf)
+	    printf(" %8.2f", r[f][p]);
+	  else
+	    printf(" %8s", "-");
+	}
+
+      printf("  %s\n", (ok ? "ok" : "MISMATCH"));
+    }
+
+  bilinear_destroy(B);
+
+  return 0;
+}
+
+#define GRIDS_MAX 8
+
+int main(int argc, char **argv)
+{
+  size_t nq = 10000000;
+  int c, ng[GRIDS_MAX], m = 0;
+
+  while ((c = getopt(argc, argv, "g:n:")) != -1)
+    {
+      switch (c)
+	{
+	case 'g':
+	  if (m < GRIDS_MAX) ng[m++] = atoi(optarg);
+	  break;
+	case 'n': nq = atol(optarg); break;
+	default:
+	  fprintf(stderr, "usage: bench [-n queries] [-g grid] [file.sag ...]\n");
+	  return EXIT_FAILURE;
+	}
+    }
+
+  printf("%-24s %-6s %8s %8s %8s\n",
+	 "grid", "points", "plain", "tiled", "compiled");
+
+  for (int i = 0 ; i < m ; i++)
+    {
+      char name[32];
+      bilinear_t *B;
+
+      snprintf(name, 32, "synthetic %i x %i", ng[i], ng[i]);
+
+      if (((B = synthetic(ng[i])) == NULL) || bench(name, B, nq))
+	return EXIT_FAILURE;
+    }
+
+  for (int i = optind ; i < argc ; i++)
+    {
+      bilinear_t *B;
+
+      if (((B = read_sag(argv[i])) == NULL) || bench(argv[i], B, nq))
+	return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -14,6 +14,7 @@ CU_TestInfo tests_bbox[] =
     {"volume", test_bbox_volume},
     {"join", test_bbox_join},
     {"intersect", test_bbox_intersect},
+    {"contains", test_bbox_contains},
     CU_TEST_INFO_NULL,
   };
 
@@ -67,3 +68,16 @@ extern void test_bbox_intersect(void)
   CU_ASSERT_FALSE(bbox_intersect(a, b));
   CU_ASSERT_FALSE(bbox_intersect(b, a));
 }
+
+extern void test_bbox_contains(void)
+{
+  bbox_t a = BBOX(0, 2, 0, 1);
+  vector_t
+    u = {1, 0.5},
+    v = {2, 1},
+    w = {1, 1.5};
+
+  CU_ASSERT(bbox_contains(a, u));
+  CU_ASSERT(bbox_contains(a, v));
+  CU_ASSERT_FALSE(bbox_contains(a, w));
+}
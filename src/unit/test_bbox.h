@@ -7,3 +7,4 @@ extern void test_bbox_height(void);
 extern void test_bbox_volume(void);
 extern void test_bbox_join(void);
 extern void test_bbox_intersect(void);
+extern void test_bbox_contains(void);
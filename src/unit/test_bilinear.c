@@ -3,6 +3,8 @@
   J.J.Green 2007, 2011
 */
 
+#include <math.h>
+
 #include <vfplot/error.h>
 #include <vfplot/bilinear.h>
 #include "test_bilinear.h"
@@ -13,6 +15,12 @@ CU_TestInfo tests_bilinear[] =
     {"nodata", test_bilinear_nodata},
     {"integrate", test_bilinear_integrate},
     {"domain", test_bilinear_domain},
+    {"compiled", test_bilinear_compiled},
+    {"batch", test_bilinear_batch},
+    {"tiled", test_bilinear_tiled},
+    {"store", test_bilinear_store},
+    {"decimate", test_bilinear_decimate},
+    {"curvature", test_bilinear_curvature},
     CU_TEST_INFO_NULL,
   };
 
@@ -39,6 +47,29 @@ static int h(double x, double y, void* opt, double *z)
   return ERROR_OK;
 }
 
+static int cu(double x, double y, void* opt, double *z)
+{
+  *z = -y;
+
+  return ERROR_OK;
+}
+
+static int cv(double x, double y, void* opt, double *z)
+{
+  *z = x;
+
+  return ERROR_OK;
+}
+
+static int hn(double x, double y, void* opt, double *z)
+{
+  if ((x-1)*(x-1) + (y-1)*(y-1) < 0.1) return ERROR_NODATA;
+
+  *z = x + y;
+
+  return ERROR_OK;
+}
+
 /* accuracy check for quadratic, full data */
 
 extern void test_bilinear_quadratic(void)
@@ -343,3 +374,410 @@ extern void test_bilinear_integrate(void)
   test_bi_03();
   test_bi_04();
 }
+
+/*
+  the compiled interpolant gives the same values and
+  nodata as the uncompiled, including in the cells with
+  one nodata corner and outside the grid, and it is
+  discarded when the grid is modified
+*/
+
+extern void test_bilinear_compiled(void)
+{
+  bilinear_t
+    *B0 = bilinear_new(),
+    *B1 = bilinear_new();
+  bbox_t bb = {{0, 2}, {0, 2}};
+
+  CU_ASSERT_FATAL((B0 != NULL) && (B1 != NULL));
+  CU_ASSERT(bilinear_dimension(7, 9, bb, B0) == ERROR_OK);
+  CU_ASSERT(bilinear_dimension(7, 9, bb, B1) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, B0) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, B1) == ERROR_OK);
+  CU_ASSERT(bilinear_compile(B1) == ERROR_OK);
+
+  int n = 101, nodata = 0;
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  double
+	    x = -0.1 + 2.2*(i + 0.37)/n,
+	    y = -0.1 + 2.2*(j + 0.71)/n,
+	    z0, z1;
+	  int
+	    err0 = bilinear(x, y, B0, &z0),
+	    err1 = bilinear(x, y, B1, &z1);
+
+	  CU_ASSERT(err0 == err1);
+
+	  if (err0 == ERROR_OK)
+	    {
+	      CU_ASSERT_DOUBLE_EQUAL(z0, z1, 1e-12);
+	    }
+	  else
+	    nodata++;
+	}
+    }
+
+  CU_ASSERT(nodata > 0);
+  CU_ASSERT(nodata < n*n);
+
+  double z;
+
+  bilinear_setz(0, 0, 7.0, B1);
+
+  CU_ASSERT(bilinear(0, 0, B1, &z) == ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(z, 7.0, 1e-12);
+
+  bilinear_destroy(B0);
+  bilinear_destroy(B1);
+}
+
+/*
+  the batch interpolation gives the same values as bilinear()
+  and NaN for nodata, for the compiled and uncompiled grid,
+  and the polar form gives the direction and magnitude
+*/
+
+static void test_bilinear_batch_grid(bilinear_t *U, bilinear_t *V)
+{
+  size_t n = 150;
+  double x[n], y[n], z[n], t[n], m[n];
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      x[k] = -0.1 + 2.2*((k*37) % n + 0.5)/n;
+      y[k] = -0.1 + 2.2*((k*59) % n + 0.5)/n;
+    }
+
+  CU_ASSERT(bilinear_batch(n, x, y, U, z) == ERROR_OK);
+  CU_ASSERT(bilinear_batch_polar(n, x, y, U, V, t, m) == ERROR_OK);
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      double u, v;
+
+      if (bilinear(x[k], y[k], U, &u) == ERROR_OK)
+	{
+	  CU_ASSERT(z[k] == u);
+	  CU_ASSERT(bilinear(x[k], y[k], V, &v) == ERROR_OK);
+	  CU_ASSERT(t[k] == atan2(v, u));
+	  CU_ASSERT(m[k] == hypot(v, u));
+	}
+      else
+	{
+	  CU_ASSERT(isnan(z[k]));
+	  CU_ASSERT(isnan(t[k]));
+	  CU_ASSERT(isnan(m[k]));
+	}
+    }
+}
+
+extern void test_bilinear_batch(void)
+{
+  bilinear_t
+    *U = bilinear_new(),
+    *V = bilinear_new();
+  bbox_t bb = {{0, 2}, {0, 2}};
+
+  CU_ASSERT_FATAL((U != NULL) && (V != NULL));
+  CU_ASSERT(bilinear_dimension(7, 9, bb, U) == ERROR_OK);
+  CU_ASSERT(bilinear_dimension(7, 9, bb, V) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, U) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(h, NULL, V) == ERROR_OK);
+
+  test_bilinear_batch_grid(U, V);
+
+  CU_ASSERT(bilinear_compile(U) == ERROR_OK);
+  CU_ASSERT(bilinear_compile(V) == ERROR_OK);
+
+  test_bilinear_batch_grid(U, V);
+
+  bilinear_destroy(U);
+  bilinear_destroy(V);
+}
+
+/*
+  the tiled storage gives the same values and nodata, the
+  same integral and defined area, and bilinear_setz() and
+  bilinear_compile() work on the tiled grid, including on a
+  node shared by four tiles; the grid spans several tiles and
+  is not a multiple of the tile size so the padding is hit
+*/
+
+extern void test_bilinear_tiled(void)
+{
+  bilinear_t
+    *B0 = bilinear_new(),
+    *B1 = bilinear_new();
+  bbox_t bb = {{0, 2}, {0, 2}};
+  int
+    T = 1 << BILINEAR_TILE,
+    nx = 2*T + 9,
+    ny = 2*T + 5;
+
+  CU_ASSERT_FATAL((B0 != NULL) && (B1 != NULL));
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, B0) == ERROR_OK);
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, B1) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, B0) == ERROR_OK);
+  CU_ASSERT(bilinear_tile(B1) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, B1) == ERROR_OK);
+
+  int n = 301;
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  double
+	    x = -0.1 + 2.2*(i + 0.37)/n,
+	    y = -0.1 + 2.2*(j + 0.71)/n,
+	    z0, z1;
+	  int
+	    err0 = bilinear(x, y, B0, &z0),
+	    err1 = bilinear(x, y, B1, &z1);
+
+	  CU_ASSERT(err0 == err1);
+
+	  if (err0 == ERROR_OK)
+	    {
+	      CU_ASSERT(z0 == z1);
+	    }
+	}
+    }
+
+  double I0, I1, A0, A1;
+
+  CU_ASSERT(bilinear_integrate(bb, B0, &I0) == ERROR_OK);
+  CU_ASSERT(bilinear_integrate(bb, B1, &I1) == ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(I0, I1, 1e-12);
+
+  CU_ASSERT(bilinear_defarea(B0, &A0) == ERROR_OK);
+  CU_ASSERT(bilinear_defarea(B1, &A1) == ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(A0, A1, 1e-12);
+
+  double x, y, z;
+
+  bilinear_getxy(5, 7, B1, &x, &y);
+  bilinear_setz(5, 7, 7.0, B1);
+
+  CU_ASSERT(bilinear(x, y, B1, &z) == ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(z, 7.0, 1e-9);
+
+  /* approach the node (2T, T) from each of its four cells */
+
+  double dx = 2.0/(nx - 1), dy = 2.0/(ny - 1);
+
+  bilinear_getxy(2*T, T, B1, &x, &y);
+  bilinear_setz(2*T, T, 7.0, B1);
+
+  for (int i = 0 ; i < 4 ; i++)
+    {
+      double
+	xi = x + ((i & 1) ? 1e-9 : -1e-9)*dx,
+	yi = y + ((i & 2) ? 1e-9 : -1e-9)*dy;
+
+      CU_ASSERT(bilinear(xi, yi, B1, &z) == ERROR_OK);
+      CU_ASSERT_DOUBLE_EQUAL(z, 7.0, 1e-6);
+    }
+
+  bilinear_setz(5, 7, 0.0, B0);
+  bilinear_setz(5, 7, 0.0, B1);
+  bilinear_setz(2*T, T, 0.0, B0);
+  bilinear_setz(2*T, T, 0.0, B1);
+
+  CU_ASSERT(bilinear_compile(B1) == ERROR_OK);
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      double
+	x = 2.0*(i + 0.5)/n,
+	y = 2.0*(n - i - 0.5)/n,
+	z0, z1;
+      int
+	err0 = bilinear(x, y, B0, &z0),
+	err1 = bilinear(x, y, B1, &z1);
+
+      CU_ASSERT(err0 == err1);
+
+      if (err0 == ERROR_OK)
+	{
+	  CU_ASSERT_DOUBLE_EQUAL(z0, z1, 1e-12);
+	}
+    }
+
+  bilinear_destroy(B0);
+  bilinear_destroy(B1);
+}
+
+/*
+  reduced-precision storage gives values close to those of
+  the double grid, with the same nodata, for float and int16
+  storage and the latter tiled, scaled and after bilinear_setz()
+*/
+
+static void test_bilinear_store_type(bilinear_store_t store, double eps)
+{
+  bilinear_t
+    *B0 = bilinear_new(),
+    *B1 = bilinear_new();
+  bbox_t bb = {{0, 2}, {0, 2}};
+  int
+    T = 1 << BILINEAR_TILE,
+    nx = T + 7,
+    ny = T + 3;
+
+  CU_ASSERT_FATAL((B0 != NULL) && (B1 != NULL));
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, B0) == ERROR_OK);
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, B1) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, B0) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(g, NULL, B1) == ERROR_OK);
+  CU_ASSERT(bilinear_store(B1, store) == ERROR_OK);
+  CU_ASSERT(bilinear_tile(B1) == ERROR_OK);
+
+  bilinear_scale(B0, 2.0);
+  bilinear_scale(B1, 2.0);
+
+  bilinear_setz(2, 3, 3.0, B0);
+  bilinear_setz(2, 3, 3.0, B1);
+  bilinear_setz(T, 3, 3.0, B0);
+  bilinear_setz(T, 3, 3.0, B1);
+
+  int n = 101;
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  double
+	    x = -0.1 + 2.2*(i + 0.37)/n,
+	    y = -0.1 + 2.2*(j + 0.71)/n,
+	    z0, z1;
+	  int
+	    err0 = bilinear(x, y, B0, &z0),
+	    err1 = bilinear(x, y, B1, &z1);
+
+	  CU_ASSERT(err0 == err1);
+
+	  if (err0 == ERROR_OK)
+	    {
+	      CU_ASSERT_DOUBLE_EQUAL(z0, z1, eps);
+	    }
+	}
+    }
+
+  bilinear_destroy(B0);
+  bilinear_destroy(B1);
+}
+
+extern void test_bilinear_store(void)
+{
+  test_bilinear_store_type(bilinear_double, 1e-12);
+  test_bilinear_store_type(bilinear_float, 1e-5);
+  test_bilinear_store_type(bilinear_int16, 1e-3);
+}
+
+/*
+  the decimated grid has half the resolution, reproduces a
+  linear function at its interior nodes, has nodata where the
+  grid does, and is not made from a grid which is too small
+*/
+
+extern void test_bilinear_decimate(void)
+{
+  bilinear_t *B = bilinear_new(), *D;
+  bbox_t bb = {{0, 2}, {0, 2}};
+
+  CU_ASSERT_FATAL(B != NULL);
+  CU_ASSERT(bilinear_dimension(9, 10, bb, B) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(hn, NULL, B) == ERROR_OK);
+
+  D = bilinear_decimate(B);
+
+  CU_ASSERT_FATAL(D != NULL);
+
+  int nx, ny;
+
+  bilinear_nxy(D, &nx, &ny);
+
+  CU_ASSERT(nx == 5);
+  CU_ASSERT(ny == 5);
+
+  bbox_t dbb = bilinear_bbox(D);
+
+  CU_ASSERT_DOUBLE_EQUAL(dbb.x.max, 2.0, 1e-12);
+  CU_ASSERT_DOUBLE_EQUAL(dbb.y.max, 16.0/9.0, 1e-12);
+
+  double x, y, z;
+
+  bilinear_getxy(3, 1, D, &x, &y);
+  CU_ASSERT(bilinear(x, y, D, &z) == ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(z, x + y, 1e-12);
+
+  bilinear_getxy(2, 2, D, &x, &y);
+  CU_ASSERT(bilinear(x, y, D, &z) != ERROR_OK);
+
+  bilinear_destroy(D);
+  bilinear_destroy(B);
+
+  CU_ASSERT_FATAL((B = bilinear_new()) != NULL);
+  CU_ASSERT(bilinear_dimension(2, 5, bb, B) == ERROR_OK);
+  CU_ASSERT(bilinear_decimate(B) == NULL);
+
+  bilinear_destroy(B);
+}
+
+/*
+  the curvature of the circular field (-y, x) has modulus
+  1/r, and is the same whether calculated over several
+  threads (in several blocks of rows) or filled piecewise
+*/
+
+extern void test_bilinear_curvature(void)
+{
+  bilinear_t
+    *U = bilinear_new(),
+    *V = bilinear_new(),
+    *K0, *K1, *K2 = bilinear_new();
+  bbox_t bb = {{1, 3}, {1, 3}};
+  int nx = 41, ny = 157;
+
+  CU_ASSERT_FATAL((U != NULL) && (V != NULL) && (K2 != NULL));
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, U) == ERROR_OK);
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, V) == ERROR_OK);
+  CU_ASSERT(bilinear_dimension(nx, ny, bb, K2) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(cu, NULL, U) == ERROR_OK);
+  CU_ASSERT(bilinear_sample(cv, NULL, V) == ERROR_OK);
+
+  K0 = bilinear_curvature(U, V, 1);
+  K1 = bilinear_curvature(U, V, 3);
+
+  CU_ASSERT_FATAL((K0 != NULL) && (K1 != NULL));
+
+  for (int i = 0 ; i < nx ; i += 8)
+    for (int j = 0 ; j < ny ; j += 8)
+      CU_ASSERT(bilinear_curvature_fill(U, V, i, i+8, j, j+8, K2) == ERROR_OK);
+
+  for (int i = 0 ; i < 50 ; i++)
+    {
+      double
+	x = 1.1 + 1.8*(i + 0.3)/50,
+	y = 2.9 - 1.8*(i + 0.7)/50,
+	k0, k1, k2;
+
+      CU_ASSERT(bilinear(x, y, K0, &k0) == ERROR_OK);
+      CU_ASSERT(bilinear(x, y, K1, &k1) == ERROR_OK);
+      CU_ASSERT(bilinear(x, y, K2, &k2) == ERROR_OK);
+      CU_ASSERT(k0 == k1);
+      CU_ASSERT(k0 == k2);
+      CU_ASSERT_DOUBLE_EQUAL(fabs(k0), 1/hypot(x, y), 0.01);
+    }
+
+  bilinear_destroy(K0);
+  bilinear_destroy(K1);
+  bilinear_destroy(K2);
+  bilinear_destroy(U);
+  bilinear_destroy(V);
+}
@@ -10,3 +10,9 @@ extern void test_bilinear_quadratic(void);
 extern void test_bilinear_nodata(void);
 extern void test_bilinear_integrate(void);
 extern void test_bilinear_domain(void);
+extern void test_bilinear_compiled(void);
+extern void test_bilinear_batch(void);
+extern void test_bilinear_tiled(void);
+extern void test_bilinear_store(void);
+extern void test_bilinear_decimate(void);
+extern void test_bilinear_curvature(void);
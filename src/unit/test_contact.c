@@ -12,6 +12,7 @@ CU_TestInfo tests_contact[] =
     {"evaluate", test_contact_evaluate},
     {"intersect", test_contact_intersect},
     {"degenerate", test_contact_degenerate},
+    {"single precision", test_contact_single},
     CU_TEST_INFO_NULL,
   };
 
@@ -122,3 +123,43 @@ extern void test_contact_degenerate(void)
       }
   }
 }
+
+/* the single-precision variant agrees with the double */
+
+extern void test_contact_single(void)
+{
+  ellipse_t A, B;
+  int i;
+
+  A.centre.x = 0.0;
+  A.centre.y = 0.0;
+  A.major = 3.0;
+  A.minor = 1.0;
+  A.theta = M_PI/4;
+
+  B.centre.y = 0.5;
+  B.major = 2.0;
+  B.minor = 1.0;
+  B.theta = M_PI/3;
+
+  m2_t MA = ellipse_mt(A), MB = ellipse_mt(B);
+  float
+    fA[3] = {M2A(MA), M2B(MA), M2D(MA)},
+    fB[3] = {M2A(MB), M2B(MB), M2D(MB)};
+
+  for (i=0 ; i<100 ; i++)
+    {
+      B.centre.x = 4.0*i/99.0;
+
+      vector_t rAB = vsub(B.centre, A.centre);
+      double z = contact_mt(rAB, MA, MB);
+      float zf = contact_mtf(rAB.x, rAB.y, fA, fB);
+
+      CU_ASSERT( zf >= 0 );
+
+      if (z < 1.0)
+	CU_ASSERT_DOUBLE_EQUAL(zf, z, 1e-4);
+      else
+	CU_ASSERT( zf > 1.0 - 1e-4 );
+    }
+}
@@ -9,3 +9,4 @@ extern CU_TestInfo tests_contact[];
 extern void test_contact_evaluate(void);
 extern void test_contact_intersect(void);
 extern void test_contact_degenerate(void);
+extern void test_contact_single(void);
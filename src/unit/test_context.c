@@ -0,0 +1,97 @@
+/*
+  cunit tests for context.c
+*/
+
+#include <vfplot/context.h>
+#include "test_context.h"
+
+CU_TestInfo tests_context[] =
+  {
+    {"initialisation", test_context_init},
+    {"independence",   test_context_independent},
+    {"halt",           test_context_halt},
+    CU_TEST_INFO_NULL,
+  };
+
+/*
+  a constant field, the direction of which is given
+  by the field data, and a zero curvature
+*/
+
+static int fv_const(void *field, double x, double y, double *t, double *m)
+{
+  *t = *(double*)field;
+  *m = 1.0;
+
+  return 0;
+}
+
+static int fc_zero(void *field, double x, double y, double *k)
+{
+  *k = 0.0;
+
+  return 0;
+}
+
+extern void test_context_init(void)
+{
+  double t = 0.0;
+  vfp_context_t ctx;
+
+  vfplot_context_init(&ctx, fv_const, fc_zero, &t, 1.0);
+
+  CU_ASSERT(ctx.evaluate.fv == fv_const);
+  CU_ASSERT(ctx.evaluate.fc == fc_zero);
+  CU_ASSERT(ctx.evaluate.fvb == NULL);
+  CU_ASSERT(ctx.evaluate.fj == NULL);
+  CU_ASSERT(ctx.evaluate.cache == NULL);
+  CU_ASSERT(ctx.evaluate.field == &t);
+  CU_ASSERT_DOUBLE_EQUAL(ctx.evaluate.aspect, 1.0, 1e-10);
+  CU_ASSERT_DOUBLE_EQUAL(ctx.margin.scale, 1.0, 1e-10);
+  CU_ASSERT_EQUAL(ctx.halt, 0);
+}
+
+/*
+  two contexts with different fields evaluate
+  independently of each other (and of the file-static
+  state used by evaluate())
+*/
+
+extern void test_context_independent(void)
+{
+  double eps = 1e-10, t1 = 0.0, t2 = M_PI/2;
+  vfp_context_t ctx1, ctx2;
+
+  vfplot_context_init(&ctx1, fv_const, fc_zero, &t1, 1.0);
+  vfplot_context_init(&ctx2, fv_const, fc_zero, &t2, 1.0);
+
+  arrow_t A1 = {{0, 0}}, A2 = {{0, 0}};
+
+  CU_ASSERT_EQUAL(evaluate_r(&(ctx1.evaluate), &A1), ERROR_OK);
+  CU_ASSERT_EQUAL(evaluate_r(&(ctx2.evaluate), &A2), ERROR_OK);
+
+  CU_ASSERT_DOUBLE_EQUAL(A1.theta, t1, eps);
+  CU_ASSERT_DOUBLE_EQUAL(A2.theta, t2, eps);
+
+  ellipse_t E1, E2;
+
+  ctx2.margin.major = 1.0;
+  ctx2.margin.minor = 1.0;
+
+  arrow_ellipse_r(&(ctx1.margin), &A1, &E1);
+  arrow_ellipse_r(&(ctx2.margin), &A2, &E2);
+
+  CU_ASSERT_DOUBLE_EQUAL(E2.major - E1.major, 1.0, eps);
+  CU_ASSERT_DOUBLE_EQUAL(E2.minor - E1.minor, 1.0, eps);
+}
+
+extern void test_context_halt(void)
+{
+  double t = 0.0;
+  vfp_context_t ctx;
+
+  vfplot_context_init(&ctx, fv_const, fc_zero, &t, 1.0);
+  vfplot_context_halt(&ctx);
+
+  CU_ASSERT_NOT_EQUAL(ctx.halt, 0);
+}
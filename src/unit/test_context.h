@@ -0,0 +1,11 @@
+/*
+  test_context.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_context[];
+
+extern void test_context_init(void);
+extern void test_context_independent(void);
+extern void test_context_halt(void);
@@ -4,12 +4,17 @@
 */
 
 #include <vfplot/curvature.h>
+#include <vfplot/aspect.h>
+#include <vfplot/error.h>
 #include "test_curvature.h"
 
 CU_TestInfo tests_curvature[] =
   {
     {"uniform",  test_curvature_uniform},
     {"circular", test_curvature_circular},
+    {"jacobian", test_curvature_jacobian},
+    {"batch",    test_curvature_batch},
+    {"boundary", test_curvature_boundary},
     CU_TEST_INFO_NULL,
   };
 
@@ -73,3 +78,188 @@ extern void test_curvature_circular(void)
   check_circular_at(1, 1);
   check_circular_at(0, 1);
 }
+
+/*
+  the closed form from the Jacobian, for the circular field
+  (and a positive multiple of it, which has the same curvature)
+  and a uniform field
+*/
+
+static int circular_jacobian(void *unused, double x, double y,
+			     double *u, double *v, double *J)
+{
+  *u = y;
+  *v = -x;
+
+  J[0] = 0; J[1] = 1;
+  J[2] = -1; J[3] = 0;
+
+  return 0;
+}
+
+static int scaled_jacobian(void *unused, double x, double y,
+			   double *u, double *v, double *J)
+{
+  double s = 1 + x*x;
+
+  *u = s*y;
+  *v = -s*x;
+
+  J[0] = 2*x*y; J[1] = s;
+  J[2] = -s - 2*x*x; J[3] = 0;
+
+  return 0;
+}
+
+static int uniform_jacobian(void *unused, double x, double y,
+			    double *u, double *v, double *J)
+{
+  *u = 1;
+  *v = 1;
+
+  J[0] = J[1] = J[2] = J[3] = 0;
+
+  return 0;
+}
+
+static void check_jacobian_at(double x, double y)
+{
+  double curv;
+
+  CU_ASSERT_EQUAL_FATAL(curvature_jacobian(circular_jacobian, NULL, x, y, &curv), 0);
+  CU_ASSERT_DOUBLE_EQUAL(curv, 1/hypot(x, y), eps);
+
+  CU_ASSERT_EQUAL_FATAL(curvature_jacobian(scaled_jacobian, NULL, x, y, &curv), 0);
+  CU_ASSERT_DOUBLE_EQUAL(curv, 1/hypot(x, y), eps);
+
+  CU_ASSERT_EQUAL_FATAL(curvature_jacobian(uniform_jacobian, NULL, x, y, &curv), 0);
+  CU_ASSERT_DOUBLE_EQUAL(curv, 0, eps);
+}
+
+extern void test_curvature_jacobian(void)
+{
+  check_jacobian_at(1, 0);
+  check_jacobian_at(1, 1);
+  check_jacobian_at(0, 1);
+  check_jacobian_at(-2, 0.5);
+}
+
+/*
+  the batch curvature should be the same as that found by
+  curvature() for each point, for a batch field function
+  which gives the same values as the scalar; and NaN where
+  the length is NaN.  In the field with a hole of nodata the
+  streamlines which meet the hole stop there, so we just
+  check for a finite curvature here, see the boundary test
+  for the comparison with curvature()
+*/
+
+static int circular_batch(void *unused, size_t n,
+			  const double *x, const double *y,
+			  double *theta, double *mag)
+{
+  for (size_t k = 0 ; k < n ; k++)
+    circular(unused, x[k], y[k], theta + k, mag + k);
+
+  return 0;
+}
+
+static int holed(void *unused, double x, double y,
+		 double *theta, double *mag)
+{
+  if (hypot(x, y - 1) < 0.2) return 1;
+
+  return circular(unused, x, y, theta, mag);
+}
+
+static int holed_batch(void *unused, size_t n,
+		       const double *x, const double *y,
+		       double *theta, double *mag)
+{
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      if (holed(unused, x[k], y[k], theta + k, mag + k) != 0)
+	theta[k] = mag[k] = NAN;
+    }
+
+  return 0;
+}
+
+extern void test_curvature_batch(void)
+{
+  size_t n = 5;
+  double
+    x[] = {1, 1, 0, -2, 0.5},
+    y[] = {0, 1, 1, 0.5, -3},
+    asp = 5,
+    len[n], curv[n];
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      double wdt;
+
+      CU_ASSERT_EQUAL_FATAL(aspect_fixed(asp, 1, len + k, &wdt), 0);
+    }
+
+  len[4] = NAN;
+
+  CU_ASSERT_EQUAL_FATAL(curvature_batch(circular_batch, NULL, n,
+					x, y, len, curv), ERROR_OK);
+
+  for (size_t k = 0 ; k < n-1 ; k++)
+    {
+      double c;
+
+      CU_ASSERT_EQUAL_FATAL(curvature(circular, NULL, x[k], y[k], asp, &c), 0);
+      CU_ASSERT_DOUBLE_EQUAL(curv[k], c, 1e-12);
+    }
+
+  CU_ASSERT(isnan(curv[4]));
+
+  CU_ASSERT_EQUAL_FATAL(curvature_batch(holed_batch, NULL, n,
+					x, y, len, curv), ERROR_OK);
+
+  for (size_t k = 0 ; k < n-1 ; k++)
+    CU_ASSERT(isfinite(curv[k]));
+}
+
+/*
+  near nodata both curvature() and curvature_batch() stop the
+  streamlines at their last point, so give the same curvature:
+  here the streamlines of the points on the unit circle near
+  the hole (at (0, 1)) run into it, in one or both directions
+*/
+
+extern void test_curvature_boundary(void)
+{
+  size_t n = 6;
+  double
+    x[] = {0.3, -0.3, 0.6, -0.6, 0.9, 0.21},
+    y[] = {0.954, 0.954, 0.8, 0.8, 0.436, 0.978},
+    asp = 5,
+    len[n], curv[n];
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      double wdt;
+
+      CU_ASSERT_EQUAL_FATAL(aspect_fixed(asp, 1, len + k, &wdt), 0);
+    }
+
+  CU_ASSERT_EQUAL_FATAL(curvature_batch(holed_batch, NULL, n,
+					x, y, len, curv), ERROR_OK);
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      double c;
+
+      CU_ASSERT_EQUAL_FATAL(curvature(holed, NULL, x[k], y[k], asp, &c), 0);
+      CU_ASSERT_DOUBLE_EQUAL(curv[k], c, 1e-12);
+    }
+
+  /* nodata at the centre */
+
+  double c;
+
+  CU_ASSERT_NOT_EQUAL(curvature(holed, NULL, 0, 1, asp, &c), 0);
+}
@@ -9,3 +9,6 @@ extern CU_TestInfo tests_curvature[];
 
 extern void test_curvature_uniform(void);
 extern void test_curvature_circular(void);
+extern void test_curvature_jacobian(void);
+extern void test_curvature_batch(void);
+extern void test_curvature_boundary(void);
@@ -0,0 +1,163 @@
+/*
+  cunit tests for dindex.c
+*/
+
+#include <math.h>
+
+#include <vfplot/dindex.h>
+#include <vfplot/bilinear.h>
+#include <vfplot/error.h>
+
+#include "fixture.h"
+#include "test_dindex.h"
+
+CU_TestInfo tests_dindex[] =
+  {
+    {"fixtures", test_dindex_fixtures},
+    {"mask",     test_dindex_mask},
+    {"empty",    test_dindex_empty},
+    CU_TEST_INFO_NULL,
+  };
+
+/*
+  the index agrees with domain_inside() on a lattice over
+  (and beyond) the bounding box, on random points and on
+  the vertices of the domain and the midpoints of its edges,
+  the last being the most likely to disagree
+*/
+
+typedef struct
+{
+  const domain_t *dom;
+  const dindex_t *ix;
+} vcheck_t;
+
+static int vertex_check_root(const domain_t *node, vcheck_t *vc, int level)
+{
+  polyline_t p = node->p;
+
+  for (int i = 0, j = p.n-1 ; i < p.n ; j = i++)
+    {
+      vector_t
+	v = p.v[i],
+	m = {(p.v[i].x + p.v[j].x)/2, (p.v[i].y + p.v[j].y)/2};
+
+      CU_ASSERT_EQUAL(dindex_inside(v, vc->ix), domain_inside(v, vc->dom));
+      CU_ASSERT_EQUAL(dindex_inside(m, vc->ix), domain_inside(m, vc->dom));
+    }
+
+  return 0;
+}
+
+static size_t check_agree(const domain_t *dom, int n)
+{
+  dindex_t *ix = dindex_new(dom);
+
+  CU_ASSERT_FATAL(ix != NULL);
+
+  bbox_t bb = domain_bbox(dom);
+  double
+    w = bbox_width(bb),
+    h = bbox_height(bb);
+  size_t inside = 0;
+
+  for (int i = -2 ; i <= n+2 ; i++)
+    {
+      for (int j = -2 ; j <= n+2 ; j++)
+	{
+	  vector_t v = {bb.x.min + i*w/n, bb.y.min + j*h/n};
+	  int d = domain_inside(v, dom);
+
+	  CU_ASSERT_EQUAL(dindex_inside(v, ix), d);
+	  inside += d;
+	}
+    }
+
+  unsigned int seed = 3;
+
+  for (int k = 0 ; k < 10000 ; k++)
+    {
+      vector_t v = {
+	bb.x.min + w*(1.2*rand_r(&seed)/RAND_MAX - 0.1),
+	bb.y.min + h*(1.2*rand_r(&seed)/RAND_MAX - 0.1)
+      };
+
+      CU_ASSERT_EQUAL(dindex_inside(v, ix), domain_inside(v, dom));
+    }
+
+  vcheck_t vc = {dom, ix};
+
+  domain_iterate(dom, (difun_t)vertex_check_root, &vc);
+
+  dindex_destroy(ix);
+
+  return inside;
+}
+
+extern void test_dindex_fixtures(void)
+{
+  const char *files[] = {
+    "simple.dom", "conventional.dom", "house.dom", "circular.dom"
+  };
+
+  for (size_t k = 0 ; k < 4 ; k++)
+    {
+      domain_t *dom = domain_read(fixture(files[k]));
+
+      CU_ASSERT_NOT_EQUAL_FATAL(dom, NULL);
+      CU_ASSERT(check_agree(dom, 97) > 0);
+
+      domain_destroy(dom);
+    }
+}
+
+/*
+  a domain traced from a mask of discs, with many edges
+  through the points of the lattice
+*/
+
+extern void test_dindex_mask(void)
+{
+  int n = 128;
+  bbox_t bb = {{0, n-1}, {0, n-1}};
+  bilinear_t *B = bilinear_new();
+
+  CU_ASSERT_FATAL(B != NULL);
+  CU_ASSERT_FATAL(bilinear_dimension(n, n, bb, B) == ERROR_OK);
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  double
+	    x = fmod(i, 32) - 16,
+	    y = fmod(j, 32) - 16,
+	    r = hypot(x, y);
+
+	  if ((r > 5) || (r < 2.5))
+	    bilinear_setz(i, j, 1.0, B);
+	}
+    }
+
+  domain_t *dom = bilinear_domain(B);
+
+  CU_ASSERT_FATAL(dom != NULL);
+  CU_ASSERT(check_agree(dom, n-1) > 0);
+  CU_ASSERT(check_agree(dom, 3*n) > 0);
+
+  domain_destroy(dom);
+  bilinear_destroy(B);
+}
+
+/* nothing is inside an empty domain */
+
+extern void test_dindex_empty(void)
+{
+  dindex_t *ix = dindex_new(NULL);
+  vector_t v = {0, 0};
+
+  CU_ASSERT_FATAL(ix != NULL);
+  CU_ASSERT_EQUAL(dindex_inside(v, ix), 0);
+
+  dindex_destroy(ix);
+}
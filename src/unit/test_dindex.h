@@ -0,0 +1,11 @@
+/*
+  test_dindex.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_dindex[];
+
+extern void test_dindex_fixtures(void);
+extern void test_dindex_mask(void);
+extern void test_dindex_empty(void);
@@ -3,6 +3,7 @@
   J.J.Green 2015
 */
 
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <vfplot/domain.h>
@@ -19,6 +20,7 @@ CU_TestInfo tests_domain[] =
     {"bbox", test_domain_bbox},
     {"coerce orientation", test_domain_orientate},
     {"inside", test_domain_inside},
+    {"mask grid", test_domain_mask_grid},
     {"scale", test_domain_scale},
     {"iterate", test_domain_iterate},
     {"insert", test_domain_insert},
@@ -139,6 +141,59 @@ extern void test_domain_inside(void)
   domain_destroy(dom);
 }
 
+/*
+  the mask agrees with domain_inside() at the lattice
+  points, including those on the edges of the domain
+  (the third bounding box, for simple.dom)
+*/
+
+static void check_domain_mask_grid(const char *file, bbox_t bb,
+				   int nx, int ny)
+{
+  domain_t *dom = domain_read(fixture(file));
+
+  CU_ASSERT_NOT_EQUAL_FATAL(dom, NULL);
+
+  unsigned char *mask = malloc(nx*ny);
+
+  CU_ASSERT_NOT_EQUAL_FATAL(mask, NULL);
+  CU_ASSERT_EQUAL_FATAL(domain_mask_grid(dom, bb, nx, ny, mask), 0);
+
+  double
+    dx = bbox_width(bb)/nx,
+    dy = bbox_height(bb)/ny;
+
+  for (int i = 0 ; i < nx ; i++)
+    {
+      for (int j = 0 ; j < ny ; j++)
+	{
+	  vector_t v = {bb.x.min + (i + 0.5)*dx, bb.y.min + (j + 0.5)*dy};
+
+	  CU_ASSERT_EQUAL(mask[j*nx + i], domain_inside(v, dom));
+	}
+    }
+
+  free(mask);
+  domain_destroy(dom);
+}
+
+extern void test_domain_mask_grid(void)
+{
+  bbox_t
+    b0 = BBOX(0, 60, 0, 60),
+    b1 = BBOX(-5, 65, -10, 70),
+    b2 = BBOX(-400, 400, -400, 400),
+    b3 = BBOX(-5, 65, -5, 65);
+
+  check_domain_mask_grid("simple.dom", b0, 60, 60);
+  check_domain_mask_grid("simple.dom", b0, 120, 31);
+  check_domain_mask_grid("simple.dom", b1, 70, 80);
+  check_domain_mask_grid("simple.dom", b3, 7, 14);
+  check_domain_mask_grid("conventional.dom", b0, 47, 53);
+  check_domain_mask_grid("circular.dom", b2, 80, 80);
+  check_domain_mask_grid("circular.dom", b2, 33, 101);
+}
+
 static void check_domain_scale_shift(double x, double y, const domain_t *dom_orig)
 {
   double eps = 1e-10;
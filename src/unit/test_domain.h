@@ -13,6 +13,7 @@ extern void test_domain_write(void);
 extern void test_domain_bbox(void);
 extern void test_domain_orientate(void);
 extern void test_domain_inside(void);
+extern void test_domain_mask_grid(void);
 extern void test_domain_scale(void);
 extern void test_domain_iterate(void);
 extern void test_domain_insert(void);
@@ -0,0 +1,177 @@
+/*
+  cunit tests for evcache.c
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <vfplot/evcache.h>
+#include <vfplot/error.h>
+#include "test_evcache.h"
+
+CU_TestInfo tests_evcache[] =
+  {
+    {"exact", test_evcache_exact},
+    {"quantum", test_evcache_quantum},
+    {"threads", test_evcache_threads},
+    CU_TEST_INFO_NULL,
+  };
+
+static arrow_t arrow_at(double x, double y)
+{
+  arrow_t A;
+
+  A.centre.x = x;
+  A.centre.y = y;
+  A.bend     = rightward;
+  A.theta    = x - y;
+  A.length   = 1.0 + x;
+  A.width    = 0.1 + y;
+  A.curv     = x*y;
+
+  return A;
+}
+
+/* with no quantum only the same centre should hit */
+
+extern void test_evcache_exact(void)
+{
+  evcache_t *C = evcache_new(64, 0.0);
+  size_t hit, miss;
+  int err;
+
+  CU_ASSERT_FATAL(C != NULL);
+
+  arrow_t A = arrow_at(1.0, 2.0), B;
+
+  B.centre = A.centre;
+  CU_ASSERT(evcache_lookup(C, &B, &err) == 0);
+
+  evcache_store(C, &A, ERROR_OK);
+
+  B.centre = A.centre;
+  CU_ASSERT(evcache_lookup(C, &B, &err) != 0);
+  CU_ASSERT(err == ERROR_OK);
+  CU_ASSERT(B.centre.x == A.centre.x);
+  CU_ASSERT(B.centre.y == A.centre.y);
+  CU_ASSERT(B.theta == A.theta);
+  CU_ASSERT(B.length == A.length);
+  CU_ASSERT(B.width == A.width);
+  CU_ASSERT(B.curv == A.curv);
+  CU_ASSERT(B.bend == A.bend);
+
+  B.centre.x = 1.0 + 1e-12;
+  B.centre.y = 2.0;
+  CU_ASSERT(evcache_lookup(C, &B, &err) == 0);
+
+  /* a nodata status is cached too */
+
+  A = arrow_at(3.0, 4.0);
+  evcache_store(C, &A, ERROR_NODATA);
+
+  B.centre = A.centre;
+  CU_ASSERT(evcache_lookup(C, &B, &err) != 0);
+  CU_ASSERT(err == ERROR_NODATA);
+
+  evcache_stats(C, &hit, &miss);
+  CU_ASSERT(hit == 2);
+  CU_ASSERT(miss == 2);
+
+  evcache_destroy(C);
+}
+
+/*
+  with a quantum, points in the same cell share an entry
+  but the returned arrow keeps its own centre
+*/
+
+extern void test_evcache_quantum(void)
+{
+  evcache_t *C = evcache_new(64, 0.5);
+  int err;
+
+  CU_ASSERT_FATAL(C != NULL);
+
+  arrow_t A = arrow_at(1.1, -0.9), B;
+
+  evcache_store(C, &A, ERROR_OK);
+
+  B.centre.x = 1.4;
+  B.centre.y = -0.6;
+  CU_ASSERT(evcache_lookup(C, &B, &err) != 0);
+  CU_ASSERT(B.centre.x == 1.4);
+  CU_ASSERT(B.centre.y == -0.6);
+  CU_ASSERT(B.theta == A.theta);
+
+  B.centre.x = 1.6;
+  B.centre.y = -0.6;
+  CU_ASSERT(evcache_lookup(C, &B, &err) == 0);
+
+  B.centre.x = 1.4;
+  B.centre.y = -1.1;
+  CU_ASSERT(evcache_lookup(C, &B, &err) == 0);
+
+  evcache_destroy(C);
+}
+
+/*
+  each thread has its own table, and its counts are
+  added to the totals when it exits
+*/
+
+#ifdef HAVE_PTHREAD_H
+
+static void* evcache_worker(void *arg)
+{
+  evcache_t *C = arg;
+  int err;
+
+  for (int i = 0 ; i < 10 ; i++)
+    {
+      arrow_t A = arrow_at(i, 0.0);
+
+      if (! evcache_lookup(C, &A, &err))
+	evcache_store(C, &A, ERROR_OK);
+    }
+
+  for (int i = 0 ; i < 10 ; i++)
+    {
+      arrow_t A = arrow_at(i, 0.0);
+
+      evcache_lookup(C, &A, &err);
+    }
+
+  return NULL;
+}
+
+#endif
+
+extern void test_evcache_threads(void)
+{
+#ifdef HAVE_PTHREAD_H
+
+  evcache_t *C = evcache_new(64, 0.0);
+  pthread_t thread[2];
+  size_t hit, miss;
+
+  CU_ASSERT_FATAL(C != NULL);
+
+  for (int i = 0 ; i < 2 ; i++)
+    CU_ASSERT(pthread_create(thread + i, NULL, evcache_worker, C) == 0);
+
+  for (int i = 0 ; i < 2 ; i++)
+    CU_ASSERT(pthread_join(thread[i], NULL) == 0);
+
+  evcache_stats(C, &hit, &miss);
+  CU_ASSERT(hit == 20);
+  CU_ASSERT(miss == 20);
+
+  evcache_destroy(C);
+
+#endif
+}
@@ -0,0 +1,11 @@
+/*
+  test_evcache.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_evcache[];
+
+extern void test_evcache_exact(void);
+extern void test_evcache_quantum(void);
+extern void test_evcache_threads(void);
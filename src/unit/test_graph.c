@@ -0,0 +1,107 @@
+/*
+  cunit tests for graph.c
+*/
+
+#include <vfplot/graph.h>
+#include "test_graph.h"
+
+CU_TestInfo tests_graph[] =
+  {
+    {"delete",   test_graph_delete},
+    {"decimate", test_graph_decimate},
+    CU_TEST_INFO_NULL,
+  };
+
+/*
+  the edge counts follow deletion, and edges added
+  after a deletion are seen by the next one
+*/
+
+extern void test_graph_delete(void)
+{
+  graph_t G;
+
+  CU_ASSERT_FATAL(graph_init(4, &G) == 0);
+
+  CU_ASSERT_EQUAL(graph_add_edge(G, 0, 1), 0);
+  CU_ASSERT_EQUAL(graph_add_edge(G, 0, 2), 0);
+  CU_ASSERT_EQUAL(graph_add_edge(G, 1, 2), 0);
+
+  CU_ASSERT_EQUAL(graph_del_node(G, 0), 0);
+  CU_ASSERT(graph_node_flag(G, 0, NODE_STALE));
+  CU_ASSERT_EQUAL(G.node[1].n, 1);
+  CU_ASSERT_EQUAL(G.node[2].n, 1);
+
+  /* deleting a deleted node is not an error */
+
+  CU_ASSERT_EQUAL(graph_del_node(G, 0), 0);
+
+  /* edges to a deleted node are refused */
+
+  CU_ASSERT_NOT_EQUAL(graph_add_edge(G, 0, 3), 0);
+  CU_ASSERT_EQUAL(graph_add_edge(G, 2, 3), 0);
+
+  CU_ASSERT_EQUAL(graph_del_node(G, 2), 0);
+  CU_ASSERT_EQUAL(G.node[1].n, 0);
+  CU_ASSERT_EQUAL(G.node[3].n, 0);
+  CU_ASSERT_EQUAL(graph_maxedge(G, NULL), 0);
+
+  graph_clean(&G);
+}
+
+/*
+  random graphs with repeated weights, the bucket queue
+  deletes the same nodes as graph_maxedge() would
+*/
+
+#define NODES 300
+
+extern void test_graph_decimate(void)
+{
+  unsigned int seed = 7;
+
+  for (size_t l = 0 ; l < 5 ; l++)
+    {
+      graph_t G[2];
+
+      for (int k = 0 ; k < 2 ; k++)
+	CU_ASSERT_FATAL(graph_init(NODES, G+k) == 0);
+
+      for (size_t i = 0 ; i < NODES ; i++)
+	{
+	  float w = rand_r(&seed) % 8;
+
+	  for (int k = 0 ; k < 2 ; k++)
+	    graph_set_weight(G[k], i, w);
+	}
+
+      for (size_t m = 0 ; m < NODES*(l+1) ; m++)
+	{
+	  size_t
+	    i = rand_r(&seed) % NODES,
+	    j = rand_r(&seed) % NODES;
+
+	  if (i == j) continue;
+
+	  for (int k = 0 ; k < 2 ; k++)
+	    CU_ASSERT_EQUAL(graph_add_edge(G[k], i, j), 0);
+	}
+
+      size_t maxi;
+
+      while (graph_maxedge(G[0], &maxi) > 0)
+	graph_del_node(G[0], maxi);
+
+      CU_ASSERT_EQUAL(graph_decimate(G[1]), 0);
+
+      for (size_t i = 0 ; i < NODES ; i++)
+	{
+	  CU_ASSERT_EQUAL(graph_node_flag(G[0], i, NODE_STALE),
+			  graph_node_flag(G[1], i, NODE_STALE));
+	  CU_ASSERT_EQUAL(G[1].node[i].n, 0);
+	}
+
+      for (int k = 0 ; k < 2 ; k++)
+	graph_clean(G+k);
+    }
+}
@@ -0,0 +1,10 @@
+/*
+  test_graph.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_graph[];
+
+extern void test_graph_delete(void);
+extern void test_graph_decimate(void);
@@ -0,0 +1,347 @@
+/*
+  cunit tests for mt.c
+*/
+
+#include <math.h>
+
+#include <vfplot/mt.h>
+#include "test_mt.h"
+
+CU_TestInfo tests_mt[] =
+  {
+    {"fused lookup", test_mt_fused},
+    {"threaded sampling", test_mt_threads},
+    {"adaptive", test_mt_adaptive},
+    {"batch field", test_mt_batch},
+    {"batch curvature", test_mt_batch_curvature},
+    CU_TEST_INFO_NULL,
+  };
+
+/*
+  a field whose direction and magnitude vary over the
+  unit square, with a hole of nodata in the middle so
+  that the mask handling is exercised
+*/
+
+static int fv_hole(void *field, double x, double y, double *t, double *m)
+{
+  double dx = x - 0.5, dy = y - 0.5;
+
+  if (dx*dx + dy*dy < 0.09) return 1;
+
+  *t = x + 2*y;
+  *m = 1.0 + x*x;
+
+  return 0;
+}
+
+static int fv_hole_batch(void *field, size_t n,
+			 const double *x, const double *y,
+			 double *t, double *m)
+{
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      if (fv_hole(field, x[k], y[k], t + k, m + k) != 0)
+	t[k] = m[k] = NAN;
+    }
+
+  return 0;
+}
+
+static int fc_zero(void *field, double x, double y, double *k)
+{
+  *k = 0.0;
+
+  return 0;
+}
+
+/*
+  the fused lookup metric_tensor() should give the same
+  results (and the same nodata) as interpolating each of
+  the components of the grid separately with bilinear(),
+  likewise for the integrals
+*/
+
+extern void test_mt_fused(void)
+{
+  vfp_context_t ctx;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int nx = 11, ny = 11;
+  mt_t mt;
+
+  vfplot_context_init(&ctx, fv_hole, fc_zero, NULL, 1.0);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 1, &mt), ERROR_OK);
+
+  bilinear_t *B[MT_GRID_STRIDE];
+
+  for (int k = 0 ; k < MT_GRID_STRIDE ; k++)
+    {
+      CU_ASSERT_PTR_NOT_NULL_FATAL(B[k] = bilinear_new());
+      CU_ASSERT_EQUAL_FATAL(bilinear_dimension(nx, ny, bb, B[k]), ERROR_OK);
+
+      for (int i = 0 ; i < nx ; i++)
+	for (int j = 0 ; j < ny ; j++)
+	  bilinear_setz(i, j, mt.grid.v[(j*nx + i)*MT_GRID_STRIDE + k], B[k]);
+    }
+
+  int n = 37, nodata = 0;
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  vector_t v = {(i + 0.3)/n, (j + 0.6)/n};
+	  double a, b, c;
+	  m2_t M;
+	  int
+	    err0 = metric_tensor(v, mt, &M),
+	    err1 = bilinear(v.x, v.y, B[0], &a);
+
+	  CU_ASSERT_EQUAL(err0, err1);
+
+	  if (err0 != ERROR_OK)
+	    {
+	      nodata++;
+	      continue;
+	    }
+
+	  CU_ASSERT_EQUAL(bilinear(v.x, v.y, B[1], &b), ERROR_OK);
+	  CU_ASSERT_EQUAL(bilinear(v.x, v.y, B[2], &c), ERROR_OK);
+
+	  CU_ASSERT_DOUBLE_EQUAL(M2A(M), a, 1e-12);
+	  CU_ASSERT_DOUBLE_EQUAL(M2B(M), b, 1e-12);
+	  CU_ASSERT_DOUBLE_EQUAL(M2C(M), b, 1e-12);
+	  CU_ASSERT_DOUBLE_EQUAL(M2D(M), c, 1e-12);
+	}
+    }
+
+  /* the hole should give some nodata, but not all */
+
+  CU_ASSERT(nodata > 0);
+  CU_ASSERT(nodata < n*n);
+
+  /* as are the integral of the area and the defined area */
+
+  double I0, I1, D0, D1;
+
+  CU_ASSERT_EQUAL(metric_tensor_integrate_area(mt, &I0), ERROR_OK);
+  CU_ASSERT_EQUAL(bilinear_integrate(bb, B[3], &I1), ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(I0, I1, 1e-12);
+
+  CU_ASSERT_EQUAL(metric_tensor_defarea(mt, &D0), ERROR_OK);
+  CU_ASSERT_EQUAL(bilinear_defarea(B[0], &D1), ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(D0, D1, 1e-12);
+
+  for (int k = 0 ; k < MT_GRID_STRIDE ; k++)
+    bilinear_destroy(B[k]);
+
+  metric_tensor_clean(mt);
+}
+
+/*
+  sampling with several threads gives the same tensor as
+  with one, the grid is chosen so that the rows do not
+  divide evenly into blocks or between the threads
+*/
+
+extern void test_mt_threads(void)
+{
+  vfp_context_t ctx;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int nx = 13, ny = 23;
+  mt_t mt1, mt3;
+
+  vfplot_context_init(&ctx, fv_hole, fc_zero, NULL, 1.0);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 1, &mt1), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 3, &mt3), ERROR_OK);
+
+  for (size_t k = 0 ; k < nx*ny*MT_GRID_STRIDE ; k++)
+    {
+      double
+	z1 = mt1.grid.v[k],
+	z3 = mt3.grid.v[k];
+
+      if (isnan(z1))
+	{
+	  CU_ASSERT(isnan(z3));
+	}
+      else
+	{
+	  CU_ASSERT_DOUBLE_EQUAL(z1, z3, 1e-15);
+	}
+    }
+
+  metric_tensor_clean(mt1);
+  metric_tensor_clean(mt3);
+}
+
+/*
+  the adaptive (quadtree) tensor should be close to the
+  uniform one of the same finest resolution, with fewer
+  cells, and with nearly the same defined area
+*/
+
+extern void test_mt_adaptive(void)
+{
+  vfp_context_t ctx;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int ng = 65;
+  mt_t mtu, mta;
+
+  vfplot_context_init(&ctx, fv_hole, fc_zero, NULL, 1.0);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, ng, ng, 1, &mtu), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new_adaptive(&ctx, bb, ng, ng, 2, 1e-3, &mta), ERROR_OK);
+
+  CU_ASSERT(metric_tensor_cells(mta) < metric_tensor_cells(mtu));
+
+  int n = 51, nboth = 0, ndiff = 0;
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  vector_t v = {(i + 0.3)/n, (j + 0.6)/n};
+	  m2_t Mu, Ma;
+	  int
+	    erru = metric_tensor(v, mtu, &Mu),
+	    erra = metric_tensor(v, mta, &Ma);
+
+	  if (erru != erra)
+	    {
+	      ndiff++;
+	      continue;
+	    }
+
+	  if (erru != ERROR_OK) continue;
+
+	  double scale = fabs(M2A(Mu)) + fabs(M2D(Mu));
+
+	  CU_ASSERT_DOUBLE_EQUAL(M2A(Ma), M2A(Mu), 0.01*scale);
+	  CU_ASSERT_DOUBLE_EQUAL(M2B(Ma), M2B(Mu), 0.01*scale);
+	  CU_ASSERT_DOUBLE_EQUAL(M2D(Ma), M2D(Mu), 0.01*scale);
+
+	  nboth++;
+	}
+    }
+
+  /* the masks may differ only close to the edge of the hole */
+
+  CU_ASSERT(nboth > 0);
+  CU_ASSERT(ndiff < n*n/50);
+
+  double Du, Da, Iu, Ia;
+
+  CU_ASSERT_EQUAL(metric_tensor_defarea(mtu, &Du), ERROR_OK);
+  CU_ASSERT_EQUAL(metric_tensor_defarea(mta, &Da), ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(Da, Du, 0.01*Du);
+
+  CU_ASSERT_EQUAL(metric_tensor_integrate_area(mtu, &Iu), ERROR_OK);
+  CU_ASSERT_EQUAL(metric_tensor_integrate_area(mta, &Ia), ERROR_OK);
+  CU_ASSERT_DOUBLE_EQUAL(Ia, Iu, 0.01*Iu);
+
+  metric_tensor_clean(mtu);
+  metric_tensor_clean(mta);
+}
+
+/*
+  sampling with a batch field function registered with the
+  context gives the same tensor as without
+*/
+
+extern void test_mt_batch(void)
+{
+  vfp_context_t ctx;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int nx = 17, ny = 13;
+  mt_t mt0, mt1;
+
+  vfplot_context_init(&ctx, fv_hole, fc_zero, NULL, 1.0);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 1, &mt0), ERROR_OK);
+
+  vfplot_context_batch(&ctx, fv_hole_batch);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 2, &mt1), ERROR_OK);
+
+  for (size_t k = 0 ; k < nx*ny*MT_GRID_STRIDE ; k++)
+    {
+      double
+	z0 = mt0.grid.v[k],
+	z1 = mt1.grid.v[k];
+
+      if (isnan(z0))
+	{
+	  CU_ASSERT(isnan(z1));
+	}
+      else
+	{
+	  CU_ASSERT_EQUAL(z0, z1);
+	}
+    }
+
+  metric_tensor_clean(mt0);
+  metric_tensor_clean(mt1);
+}
+
+/*
+  as above, but without a curvature function, so that the
+  curvature of each row is found by curvature_batch(); the
+  field has no hole since a streamline meeting nodata is
+  handled differently by the scalar and batch integrators
+*/
+
+static int fv_smooth(void *field, double x, double y, double *t, double *m)
+{
+  *t = x + 2*y;
+  *m = 1.0 + x*x;
+
+  return 0;
+}
+
+static int fv_smooth_batch(void *field, size_t n,
+			   const double *x, const double *y,
+			   double *t, double *m)
+{
+  for (size_t k = 0 ; k < n ; k++)
+    fv_smooth(field, x[k], y[k], t + k, m + k);
+
+  return 0;
+}
+
+extern void test_mt_batch_curvature(void)
+{
+  vfp_context_t ctx;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int nx = 17, ny = 13;
+  mt_t mt0, mt1;
+
+  vfplot_context_init(&ctx, fv_smooth, NULL, NULL, 0.2);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 1, &mt0), ERROR_OK);
+
+  vfplot_context_batch(&ctx, fv_smooth_batch);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 2, &mt1), ERROR_OK);
+
+  for (size_t k = 0 ; k < nx*ny*MT_GRID_STRIDE ; k++)
+    {
+      double
+	z0 = mt0.grid.v[k],
+	z1 = mt1.grid.v[k];
+
+      if (isnan(z0))
+	{
+	  CU_ASSERT(isnan(z1));
+	}
+      else
+	{
+	  CU_ASSERT_DOUBLE_EQUAL(z0, z1, 1e-12*(1 + fabs(z0)));
+	}
+    }
+
+  metric_tensor_clean(mt0);
+  metric_tensor_clean(mt1);
+}
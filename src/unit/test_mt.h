@@ -0,0 +1,13 @@
+/*
+  test_mt.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_mt[];
+
+extern void test_mt_fused(void);
+extern void test_mt_threads(void);
+extern void test_mt_adaptive(void);
+extern void test_mt_batch(void);
+extern void test_mt_batch_curvature(void);
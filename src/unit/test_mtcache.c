@@ -0,0 +1,199 @@
+/*
+  cunit tests for mtcache.c
+*/
+
+#include <math.h>
+#include <unistd.h>
+
+#include <vfplot/mtcache.h>
+#include "test_mtcache.h"
+
+CU_TestInfo tests_mtcache[] =
+  {
+    {"round trip", test_mtcache_roundtrip},
+    {"stale file", test_mtcache_stale},
+    {"replaced file", test_mtcache_replace},
+    CU_TEST_INFO_NULL,
+  };
+
+/* as in test_mt.c, a field with a nodata hole */
+
+static int fv_hole(void *field, double x, double y, double *t, double *m)
+{
+  double dx = x - 0.5, dy = y - 0.5;
+
+  if (dx*dx + dy*dy < 0.09) return 1;
+
+  *t = x + 2*y;
+  *m = 1.0 + x*x;
+
+  return 0;
+}
+
+static int fv_ramp(void *field, double x, double y, double *t, double *m)
+{
+  *t = y;
+  *m = 2.0 + x;
+
+  return 0;
+}
+
+static int fc_zero(void *field, double x, double y, double *k)
+{
+  *k = 0.0;
+
+  return 0;
+}
+
+/*
+  a tensor read back from the cache should give the same
+  values and nodata as the one written
+*/
+
+extern void test_mtcache_roundtrip(void)
+{
+  const char path[] = "tmp/mtcache-roundtrip.mtc";
+  vfp_context_t ctx;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int nx = 11, ny = 17;
+  uint64_t key = mtcache_hash(MTCACHE_HASH_INIT, path, sizeof(path));
+  mt_t mt0, mt1;
+
+  vfplot_context_init(&ctx, fv_hole, fc_zero, NULL, 1.0);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, nx, ny, 1, &mt0), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(mtcache_write(path, key, mt0), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(mtcache_read(path, key, bb, nx, ny, &mt1), ERROR_OK);
+
+  int n = 29;
+
+  for (int i = 0 ; i < n ; i++)
+    {
+      for (int j = 0 ; j < n ; j++)
+	{
+	  vector_t v = {(i + 0.3)/n, (j + 0.6)/n};
+	  m2_t M0, M1;
+	  int
+	    err0 = metric_tensor(v, mt0, &M0),
+	    err1 = metric_tensor(v, mt1, &M1);
+
+	  CU_ASSERT_EQUAL(err0, err1);
+
+	  if ((err0 != ERROR_OK) || (err1 != ERROR_OK)) continue;
+
+	  CU_ASSERT_DOUBLE_EQUAL(M2A(M0), M2A(M1), 1e-15);
+	  CU_ASSERT_DOUBLE_EQUAL(M2B(M0), M2B(M1), 1e-15);
+	  CU_ASSERT_DOUBLE_EQUAL(M2D(M0), M2D(M1), 1e-15);
+	}
+    }
+
+  /* the node values, including the areas, are the same */
+
+  for (size_t k = 0 ; k < nx*ny*MT_GRID_STRIDE ; k++)
+    {
+      double
+	z0 = mt0.grid.v[k],
+	z1 = mt1.grid.v[k];
+
+      if (isnan(z0))
+	{
+	  CU_ASSERT(isnan(z1));
+	}
+      else
+	{
+	  CU_ASSERT_DOUBLE_EQUAL(z0, z1, 1e-15);
+	}
+    }
+
+  metric_tensor_clean(mt0);
+  metric_tensor_clean(mt1);
+
+  unlink(path);
+}
+
+/*
+  a file written with a different key or grid, or no file,
+  gives ERROR_NODATA
+*/
+
+extern void test_mtcache_stale(void)
+{
+  const char path[] = "tmp/mtcache-stale.mtc";
+  vfp_context_t ctx;
+  bbox_t
+    bb = BBOX(0, 1, 0, 1),
+    bb2 = BBOX(0, 1, 0, 2);
+  uint64_t key = 42;
+  mt_t mt0, mt1;
+
+  vfplot_context_init(&ctx, fv_hole, fc_zero, NULL, 1.0);
+
+  unlink(path);
+
+  CU_ASSERT_EQUAL(mtcache_read(path, key, bb, 5, 5, &mt1), ERROR_NODATA);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx, bb, 5, 5, 1, &mt0), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(mtcache_write(path, key, mt0), ERROR_OK);
+
+  CU_ASSERT_EQUAL(mtcache_read(path, key+1, bb, 5, 5, &mt1), ERROR_NODATA);
+  CU_ASSERT_EQUAL(mtcache_read(path, key, bb, 5, 6, &mt1), ERROR_NODATA);
+  CU_ASSERT_EQUAL(mtcache_read(path, key, bb2, 5, 5, &mt1), ERROR_NODATA);
+
+  metric_tensor_clean(mt0);
+
+  unlink(path);
+}
+
+/*
+  writing a new key to the file replaces it, while a tensor
+  read from the old file (which may be mapped) is unchanged
+*/
+
+extern void test_mtcache_replace(void)
+{
+  const char path[] = "tmp/mtcache-replace.mtc";
+  vfp_context_t ctx0, ctx2;
+  bbox_t bb = BBOX(0, 1, 0, 1);
+  int nx = 13, ny = 7;
+  uint64_t key0 = 1, key2 = 2;
+  mt_t mt0, mt1, mt2, mt3;
+
+  vfplot_context_init(&ctx0, fv_hole, fc_zero, NULL, 1.0);
+  vfplot_context_init(&ctx2, fv_ramp, fc_zero, NULL, 1.0);
+
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx0, bb, nx, ny, 1, &mt0), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(metric_tensor_new(&ctx2, bb, nx, ny, 1, &mt2), ERROR_OK);
+
+  CU_ASSERT_EQUAL_FATAL(mtcache_write(path, key0, mt0), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(mtcache_read(path, key0, bb, nx, ny, &mt1), ERROR_OK);
+  CU_ASSERT_EQUAL_FATAL(mtcache_write(path, key2, mt2), ERROR_OK);
+
+  for (size_t k = 0 ; k < nx*ny*MT_GRID_STRIDE ; k++)
+    {
+      double
+	z0 = mt0.grid.v[k],
+	z1 = mt1.grid.v[k];
+
+      if (isnan(z0))
+	{
+	  CU_ASSERT(isnan(z1));
+	}
+      else
+	{
+	  CU_ASSERT_DOUBLE_EQUAL(z0, z1, 1e-15);
+	}
+    }
+
+  CU_ASSERT_EQUAL(mtcache_read(path, key0, bb, nx, ny, &mt3), ERROR_NODATA);
+  CU_ASSERT_EQUAL_FATAL(mtcache_read(path, key2, bb, nx, ny, &mt3), ERROR_OK);
+
+  for (size_t k = 0 ; k < nx*ny*MT_GRID_STRIDE ; k++)
+    CU_ASSERT_DOUBLE_EQUAL(mt2.grid.v[k], mt3.grid.v[k], 1e-15);
+
+  metric_tensor_clean(mt0);
+  metric_tensor_clean(mt1);
+  metric_tensor_clean(mt2);
+  metric_tensor_clean(mt3);
+
+  unlink(path);
+}
@@ -0,0 +1,11 @@
+/*
+  test_mtcache.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_mtcache[];
+
+extern void test_mtcache_roundtrip(void);
+extern void test_mtcache_stale(void);
+extern void test_mtcache_replace(void);
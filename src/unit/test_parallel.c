@@ -0,0 +1,53 @@
+/*
+  cunit tests for parallel.c
+*/
+
+#include <vfplot/parallel.h>
+#include <vfplot/error.h>
+#include "test_parallel.h"
+
+CU_TestInfo tests_parallel[] =
+  {
+    {"jobs",  test_parallel_jobs},
+    {"error", test_parallel_error},
+    CU_TEST_INFO_NULL,
+  };
+
+#define NJOB 1000
+
+static int square(size_t k, size_t *z)
+{
+  z[k] = k*k;
+
+  return ERROR_OK;
+}
+
+/* every job is run exactly once, for any number of threads */
+
+extern void test_parallel_jobs(void)
+{
+  for (int nt = 1 ; nt < 5 ; nt++)
+    {
+      size_t z[NJOB] = {0};
+
+      CU_ASSERT_EQUAL(parallel_for(NJOB, nt, (pfun_t)square, z), ERROR_OK);
+
+      for (size_t k = 0 ; k < NJOB ; k++)
+	CU_ASSERT_EQUAL(z[k], k*k);
+    }
+
+  CU_ASSERT_EQUAL(parallel_for(0, 3, (pfun_t)square, NULL), ERROR_OK);
+}
+
+/* the error of a failing job is returned */
+
+static int fail(size_t k, void *arg)
+{
+  return (k == 17 ? ERROR_NODATA : ERROR_OK);
+}
+
+extern void test_parallel_error(void)
+{
+  for (int nt = 1 ; nt < 5 ; nt++)
+    CU_ASSERT_EQUAL(parallel_for(NJOB, nt, fail, NULL), ERROR_NODATA);
+}
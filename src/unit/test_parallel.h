@@ -0,0 +1,10 @@
+/*
+  test_parallel.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_parallel[];
+
+extern void test_parallel_jobs(void);
+extern void test_parallel_error(void);
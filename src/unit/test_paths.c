@@ -0,0 +1,246 @@
+/*
+  cunit tests for paths.c
+*/
+
+#include <math.h>
+
+#include <vfplot/paths.h>
+#include <vfplot/graph.h>
+#include <vfplot/contact.h>
+#include <vfplot/error.h>
+#include "test_paths.h"
+
+CU_TestInfo tests_paths[] =
+  {
+    {"decimate", test_paths_decimate},
+    {"inter-path decimation", test_paths_decimate_inter},
+    CU_TEST_INFO_NULL,
+  };
+
+/*
+  a closed path of n arrows of varying size around a wavy
+  circle, dense enough that they overlap
+*/
+
+static gstack_t* wavy_path(size_t n)
+{
+  gstack_t *path = gstack_new(sizeof(corner_t), n, n);
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      double
+	t = 2*M_PI*k/n,
+	r = 0.8*n*(1 + 0.1*sin(7*t))/(2*M_PI);
+      corner_t c;
+
+      c.v.x = r*cos(t);
+      c.v.y = r*sin(t);
+      c.active = 1;
+
+      c.A.centre = c.v;
+      c.A.theta  = t + M_PI/2;
+      c.A.length = 3 + sin(3*t);
+      c.A.width  = 0.5 + 0.3*cos(5*t);
+      c.A.curv   = 0;
+      c.A.bend   = rightward;
+
+      gstack_push(path, &c);
+    }
+
+  return path;
+}
+
+/*
+  the decimation with all pairs tested and the greedy
+  deletion by graph_maxedge(), as the spatially indexed
+  version should give the same result
+*/
+
+static void decimate_reference(size_t n, const corner_t *cns,
+			       const arrow_margin_t *M, double Dmin,
+			       int *keep)
+{
+  double xmin = Dmin*Dmin;
+  vector_t e[n];
+  m2_t mt[n];
+  graph_t G;
+
+  for (size_t i = 0 ; i < n ; i++)
+    {
+      ellipse_t E;
+
+      arrow_ellipse_r(M, &(cns[i].A), &E);
+      mt[i] = ellipse_mt(E);
+      e[i] = E.centre;
+    }
+
+  CU_ASSERT_FATAL(graph_init(n, &G) == 0);
+
+  for (size_t i = 0 ; i < n-1 ; i++)
+    {
+      for (size_t j = i+1 ; j < n ; j++)
+	{
+	  double x = contact_mt(vsub(e[j], e[i]), mt[i], mt[j]);
+
+	  if ((x >= 0) && (x < xmin))
+	    {
+	      graph_set_weight(G, i, fmax(graph_get_weight(G, i), x));
+	      graph_set_weight(G, j, fmax(graph_get_weight(G, j), x));
+	      graph_add_edge(G, i, j);
+	    }
+	}
+    }
+
+  size_t maxi;
+
+  while (graph_maxedge(G, &maxi) > 0)
+    graph_del_node(G, maxi);
+
+  for (size_t i = 0 ; i < n ; i++)
+    keep[i] = ! graph_node_flag(G, i, NODE_STALE);
+
+  graph_clean(&G);
+}
+
+extern void test_paths_decimate(void)
+{
+  arrow_margin_t M = {0.0, 2.0, 2.0, 1.0};
+  double Dmin[] = {0.5, 1.0, 1.7};
+  size_t n = 500;
+
+  for (size_t l = 0 ; l < 3 ; l++)
+    {
+      gstack_t
+	*paths = gstack_new(sizeof(gstack_t*), 1, 1),
+	*path = wavy_path(n);
+      corner_t cns[n];
+      int keep[n];
+
+      /* the stack pops in reverse */
+
+      for (size_t i = 0 ; i < n ; i++)
+	CU_ASSERT_FATAL(gstack_pop(path, cns + (n-1-i)) == 0);
+      for (size_t i = 0 ; i < n ; i++)
+	gstack_push(path, cns + i);
+
+      decimate_reference(n, cns, &M, Dmin[l], keep);
+
+      gstack_push(paths, &path);
+
+      CU_ASSERT_EQUAL_FATAL(paths_decimate(paths, &M, Dmin[l]), 0);
+
+      size_t nkeep = 0;
+
+      for (size_t i = 0 ; i < n ; i++)
+	nkeep += keep[i];
+
+      CU_ASSERT_EQUAL(gstack_size(path), nkeep);
+      CU_ASSERT(nkeep < n);
+
+      /* the survivors, in the same order */
+
+      for (size_t i = n ; i-- > 0 ; )
+	{
+	  if (! keep[i]) continue;
+
+	  corner_t c;
+
+	  CU_ASSERT_FATAL(gstack_pop(path, &c) == 0);
+	  CU_ASSERT(c.v.x == cns[i].v.x);
+	  CU_ASSERT(c.v.y == cns[i].v.y);
+	}
+
+      gstack_destroy(path);
+      gstack_destroy(paths);
+    }
+}
+
+/*
+  two rows of glyphs close enough that those on different
+  rows intersect, but those on the same row do not; after
+  the inter-path decimation no glyphs should intersect, and
+  a third distant row should be untouched
+*/
+
+static gstack_t* row_path(size_t n, double y)
+{
+  gstack_t *path = gstack_new(sizeof(corner_t), n, n);
+
+  for (size_t k = 0 ; k < n ; k++)
+    {
+      corner_t c;
+
+      c.v.x = 5.0*k + y;
+      c.v.y = y;
+      c.active = 1;
+
+      c.A.centre = c.v;
+      c.A.theta  = 0;
+      c.A.length = 2;
+      c.A.width  = 0.5;
+      c.A.curv   = 0;
+      c.A.bend   = rightward;
+
+      gstack_push(path, &c);
+    }
+
+  return path;
+}
+
+static int path_pop_all(gstack_t *path, corner_t *c)
+{
+  int n = 0;
+
+  while (gstack_pop(path, c + n) == 0) n++;
+
+  return n;
+}
+
+extern void test_paths_decimate_inter(void)
+{
+  arrow_margin_t M = {0.0, 1.0, 1.0, 1.0};
+  size_t n = 40;
+  gstack_t
+    *paths = gstack_new(sizeof(gstack_t*), 3, 1),
+    *path[3] = {row_path(n, 0.0), row_path(n, 1.5), row_path(n, 100.0)};
+
+  for (int k = 0 ; k < 3 ; k++)
+    gstack_push(paths, path + k);
+
+  CU_ASSERT_EQUAL_FATAL(paths_decimate(paths, &M, 1.0), 0);
+  CU_ASSERT_EQUAL(paths_count(paths), 3*n);
+
+  CU_ASSERT_EQUAL_FATAL(paths_decimate_inter(paths, &M, 1.0), 0);
+  CU_ASSERT(paths_count(paths) < 3*n);
+  CU_ASSERT_EQUAL(gstack_size(path[2]), n);
+
+  corner_t c[3*n];
+  int m0 = path_pop_all(path[0], c), m1 = path_pop_all(path[1], c + m0);
+
+  CU_ASSERT(m0 + m1 >= n);
+
+  /* popped in reverse, so x decreasing along each path */
+
+  for (int i = 1 ; i < m0 ; i++)
+    CU_ASSERT(c[i].v.x < c[i-1].v.x);
+
+  for (int i = m0 + 1 ; i < m0 + m1 ; i++)
+    CU_ASSERT(c[i].v.x < c[i-1].v.x);
+
+  for (int i = 0 ; i < m0 ; i++)
+    {
+      for (int j = m0 ; j < m0 + m1 ; j++)
+	{
+	  ellipse_t Ei, Ej;
+
+	  arrow_ellipse_r(&M, &(c[i].A), &Ei);
+	  arrow_ellipse_r(&M, &(c[j].A), &Ej);
+
+	  CU_ASSERT(contact(Ei, Ej) >= 1.0);
+	}
+    }
+
+  for (int k = 0 ; k < 3 ; k++)
+    gstack_destroy(path[k]);
+  gstack_destroy(paths);
+}
@@ -0,0 +1,10 @@
+/*
+  test_paths.h
+*/
+
+#include <CUnit/CUnit.h>
+
+extern CU_TestInfo tests_paths[];
+
+extern void test_paths_decimate(void);
+extern void test_paths_decimate_inter(void);
@@ -15,12 +15,20 @@
 #include "test_bbox.h"
 #include "test_bilinear.h"
 #include "test_contact.h"
+#include "test_context.h"
 #include "test_cubic.h"
 #include "test_curvature.h"
+#include "test_dindex.h"
 #include "test_domain.h"
 #include "test_ellipse.h"
+#include "test_evcache.h"
+#include "test_graph.h"
 #include "test_margin.h"
 #include "test_matrix.h"
+#include "test_mt.h"
+#include "test_mtcache.h"
+#include "test_parallel.h"
+#include "test_paths.h"
 #include "test_polyline.h"
 #include "test_polynomial.h"
 #include "test_potential.h"
@@ -36,12 +44,20 @@ static CU_SuiteInfo suites[] =
     { "bounding boxes", NULL, NULL, tests_bbox},
     { "bilinear interpolant", NULL, NULL, tests_bilinear},
     { "contact", NULL, NULL, tests_contact},
+    { "context", NULL, NULL, tests_context},
     { "cubic", NULL, NULL, tests_cubic},
     { "curvature", NULL, NULL, tests_curvature},
     { "domain", NULL, NULL, tests_domain},
+    { "domain index", NULL, NULL, tests_dindex},
     { "ellipse", NULL, NULL, tests_ellipse},
+    { "evaluation cache", NULL, NULL, tests_evcache},
+    { "graph", NULL, NULL, tests_graph},
     { "margin", NULL, NULL, tests_margin},
     { "matrix", NULL, NULL, tests_matrix},
+    { "metric tensor", NULL, NULL, tests_mt},
+    { "metric tensor cache", NULL, NULL, tests_mtcache},
+    { "parallel", NULL, NULL, tests_parallel},
+    { "paths", NULL, NULL, tests_paths},
     { "polyline", NULL, NULL, tests_polyline},
     { "polynomial", NULL, NULL, tests_polynomial},
     { "potential", NULL, NULL, tests_potential},
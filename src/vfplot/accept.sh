@@ -48,6 +48,87 @@ do
     rm -f $eps
 done
 
+# a large plot with small glyphs, so many glyphs on
+# each boundary segment
+
+eps="electro2.eps"
+cmd="./vfplot -i0/0 -s0.01 -m4/4/0 -w60i -t electro2 -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps
+
+# --batch
+# run a manifest of jobs, two sharing the same input field
+
+sag="cylinder.sag"
+eps="cylinder.eps"
+cmd="./vfplot --dump-vectors $sag -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+manifest="batch.txt"
+eps1="batch-1.eps"
+eps2="batch-2.eps"
+eps3="batch-3.eps"
+cat > $manifest <<EOF
+# test manifest
+-i30/5 $geometry -o $eps1 $sag
+-p hedgehog $geometry -o $eps2 $sag
+
+-i30/5 $geometry -t electro2 -o $eps3
+EOF
+cmd="./vfplot -j2 --batch $manifest > /dev/null"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps1
+assert_valid_postscript $eps2
+assert_valid_postscript $eps3
+cat > $manifest <<EOF
+-i30/5 $geometry -o $eps1 $sag
+-p hedgehog $geometry $sag
+EOF
+cmd="./vfplot -j2 --batch $manifest > /dev/null 2>&1"
+assert_raises "$cmd" 1
+cmd="./vfplot -j1 --batch $manifest > /dev/null 2>&1"
+assert_raises "$cmd" 1
+rm -f $sag $eps $eps1 $eps2 $eps3 $manifest
+
+# --evaluate-cache, --evaluate-quantum
+# the exact cache does not change the placement
+
+eps="cylinder.eps"
+vgs1="cylinder1.vgs"
+vgs2="cylinder2.vgs"
+rm -f $vgs1 $vgs2
+cmd="./vfplot -i30/5 $geometry -t cylinder -G $vgs1 -o $eps"
+assert_raises "$cmd" 0
+cmd="./vfplot --evaluate-cache 1024 -i30/5 $geometry -t cylinder -G $vgs2 -o $eps"
+assert_raises "$cmd" 0
+assert_raises "cmp $vgs1 $vgs2" 0
+cmd="./vfplot --evaluate-cache 1024 --evaluate-quantum 0.05p -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps $vgs1 $vgs2
+
+# --field-storage
+# reduced-precision storage of a data field
+
+sag="cylinder.sag"
+eps="cylinder.eps"
+cmd="./vfplot --dump-vectors $sag -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+for store in float int16
+do
+    cmd="./vfplot --field-storage $store -i30/5 $geometry -o $eps $sag"
+    assert_raises "$cmd" 0
+    assert_valid_postscript $eps
+done
+
+# --field-pyramid
+# evaluate on the resolution pyramid of a data field
+
+cmd="./vfplot --field-pyramid -i30/5 $geometry -o $eps $sag"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $sag $eps
+
 # -d, --domain
 # using a domain file
 
@@ -69,6 +150,49 @@ assert_valid_vgs $vgs
 assert_raises "$cmd" 0
 rm -f $eps $vgs
 
+# --warm-start
+# create a vgs file, then use it as the start of the dynamics
+
+eps="cylinder.eps"
+vgs="cylinder.vgs"
+cmd="./vfplot -G $vgs -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_vgs $vgs
+cmd="./vfplot --warm-start $vgs $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps $vgs
+
+# --tiles
+# tiled dynamics, in parallel
+
+eps="cylinder.eps"
+cmd="./vfplot --tiles 2/2 -j2 -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps
+
+# --cache-file
+# write the metric tensor cache, then plot reading it
+
+eps="cylinder.eps"
+mtc="cylinder.mtc"
+cmd="./vfplot --cache-file $mtc -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps $mtc
+
+# --cache-tolerance
+# adaptive metric tensor
+
+eps="cylinder.eps"
+cmd="./vfplot --cache-tolerance 0.01 -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps
+
 # --dump-domain
 # create a domain file, then run the plot using that domain
 
@@ -104,6 +228,27 @@ assert_valid_hst $hst
 assert_valid_postscript $eps
 rm -f $eps $hst
 
+# --single-precision
+# the single-precision dynamics should give a final-iteration
+# histogram of pw-distances whose mean is close to that given
+# by the default double-precision dynamics
+
+eps="cylinder.eps"
+hst1="cylinder-single.hst"
+hst2="cylinder-double.hst"
+cmd="./vfplot --single-precision --histogram $hst1 -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_hst $hst1
+assert_valid_postscript $eps
+cmd="./vfplot --histogram $hst2 -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+hstmean='$1 == 29 { n += $3 ; s += $2*$3 } END { print s/n }'
+mean1=$(awk "$hstmean" $hst1)
+mean2=$(awk "$hstmean" $hst2)
+cmd="awk 'BEGIN { exit (($mean1 - $mean2)^2 > 0.05^2) }'"
+assert_raises "$cmd" 0
+rm -f $eps $hst1 $hst2
+
 # -g, --glyphs list
 # list available glyphs
 
@@ -155,6 +300,15 @@ do
     rm -f $eps
 done
 
+# --decimate-paths
+# decimation between the boundaries, the cylinder has two
+
+eps="cylinder.eps"
+cmd="./vfplot --decimate-paths -i30/5 $geometry -t cylinder -o $eps"
+assert_raises "$cmd" 0
+assert_valid_postscript $eps
+rm -f $eps
+
 # -F, --format list
 # list available input formats
 
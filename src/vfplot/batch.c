@@ -0,0 +1,632 @@
+/*
+  batch.c
+
+  run the vfplot jobs listed in a manifest file
+  concurrently over a pool of worker threads
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include <vfplot/context.h>
+
+#include "batch.h"
+
+#define BATCH_LINE_MAX 4096
+#define BATCH_ARGS_MAX 64
+
+/*
+  a field shared by the jobs which have the same input
+  files: it is read by the first of these jobs to run and
+  destroyed when the last of them has finished with it, so
+  refs is the number of jobs yet to finish with the field
+*/
+
+typedef struct
+{
+  format_t format;
+  bilinear_store_t store;
+  bool pyramid, tiles;
+  int n;
+  char **file;
+  size_t refs;
+  bool loaded;
+  field_t *field;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+#endif
+} bfield_t;
+
+/*
+  a job, line is the line-number in the manifest, text
+  a copy of that line and argv its tokens (the strings
+  in opt point into these, so they are kept until the
+  end of the batch)
+*/
+
+typedef struct
+{
+  size_t line;
+  char *text, **argv;
+  opt_t opt;
+  vfp_context_t context;
+  bfield_t *field;
+  int err;
+  double time;
+} job_t;
+
+typedef struct
+{
+  size_t njob, nfield, next;
+  int nworker;
+  job_t *job;
+  bfield_t *field;
+  volatile sig_atomic_t halt;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex, read;
+#endif
+} batch_t;
+
+static int batch_read(const char*, batch_parse_t, batch_t*);
+static int batch_fields(batch_t*);
+static void* batch_worker(batch_t*);
+static void field_release(bfield_t*);
+static void batch_free(batch_t*);
+static double batch_time(void);
+
+/*
+  on SIGINT we halt the dynamics of the running jobs
+  (see context.h) and start no more jobs
+*/
+
+#ifdef HAVE_SIGNAL_H
+
+static batch_t *sigbatch = NULL;
+
+static void sighalt(int sig)
+{
+  if (!sigbatch) return;
+
+  sigbatch->halt = 1;
+
+  for (size_t i = 0 ; i < sigbatch->njob ; i++)
+    vfplot_context_halt(&(sigbatch->job[i].context));
+}
+
+#endif
+
+extern int batch(const char *manifest, batch_parse_t parse,
+		 int nworker, bool_t verbose)
+{
+  batch_t B = {0};
+  int err;
+
+  if ((err = batch_read(manifest, parse, &B)) != ERROR_OK)
+    {
+      batch_free(&B);
+      return err;
+    }
+
+  if (B.njob == 0)
+    {
+      fprintf(stderr, "no jobs in %s\n", manifest);
+      batch_free(&B);
+      return ERROR_USER;
+    }
+
+  if ((err = batch_fields(&B)) != ERROR_OK)
+    {
+      batch_free(&B);
+      return err;
+    }
+
+  if (nworker < 1) nworker = 1;
+  if (nworker > B.njob) nworker = B.njob;
+
+  B.nworker = nworker;
+
+  /*
+    the report of each job is written to stdout, so a job
+    cannot also write its PostScript there, whatever the
+    number of workers (as for verbose output in main.c)
+  */
+
+  for (size_t i = 0 ; i < B.njob ; i++)
+    {
+      if (! B.job[i].opt.v.file.output.path)
+	{
+	  fprintf(stderr, "%s line %zi: output file (-o) needed in batch\n",
+		  manifest, B.job[i].line);
+	  err = ERROR_USER;
+	}
+    }
+
+  if (err != ERROR_OK)
+    {
+      batch_free(&B);
+      return err;
+    }
+
+  if (verbose)
+    printf("%zi job%s, %zi input field%s, %i worker%s\n",
+	   B.njob, (B.njob == 1 ? "" : "s"),
+	   B.nfield, (B.nfield == 1 ? "" : "s"),
+	   nworker, (nworker == 1 ? "" : "s"));
+
+#ifdef HAVE_SIGNAL_H
+
+  struct sigaction act, oldact;
+
+  sigbatch = &B;
+
+  act.sa_handler = sighalt;
+  act.sa_flags   = 0;
+  sigemptyset(&act.sa_mask);
+
+  if (sigaction(SIGINT, &act, &oldact) == -1)
+    fprintf(stderr, "failed to install signal handler\n");
+
+#endif
+
+  double t0 = batch_time();
+
+#ifdef HAVE_PTHREAD_H
+
+  pthread_t thread[nworker];
+  int nthread;
+
+  for (nthread = 0 ; nthread < nworker ; nthread++)
+    {
+      if ((err = pthread_create(thread + nthread,
+				NULL,
+				(void* (*)(void*))batch_worker,
+				(void*)&B)) != 0)
+	{
+	  fprintf(stderr, "failed to create worker %i: %s\n",
+		  nthread, strerror(err));
+	  break;
+	}
+    }
+
+  if (nthread == 0)
+    {
+      /* no workers at all, so we do the work ourselves */
+
+      batch_worker(&B);
+    }
+
+  for (int i = 0 ; i < nthread ; i++)
+    {
+      if ((err = pthread_join(thread[i], NULL)) != 0)
+	fprintf(stderr, "error joining worker %i: %s\n",
+		i, strerror(err));
+    }
+
+#else
+
+  batch_worker(&B);
+
+#endif
+
+  double t1 = batch_time();
+
+#ifdef HAVE_SIGNAL_H
+
+  if (sigaction(SIGINT, &oldact, NULL) == -1)
+    fprintf(stderr, "failed to restore signal handler\n");
+
+  sigbatch = NULL;
+
+#endif
+
+  /* jobs not run after a halt release their fields unread */
+
+  size_t nfail = 0, nrun = B.next;
+
+  for (size_t i = nrun ; i < B.njob ; i++)
+    if (B.job[i].field)
+      field_release(B.job[i].field);
+
+  /* summary */
+
+  err = ERROR_OK;
+
+  for (size_t i = 0 ; i < nrun ; i++)
+    {
+      if (B.job[i].err != ERROR_OK)
+	{
+	  if (nfail++ == 0) err = B.job[i].err;
+	}
+    }
+
+  if (verbose || nfail || (nrun < B.njob))
+    printf("%zi of %zi job%s run, %zi failed, elapsed time %.3f s\n",
+	   nrun, B.njob, (B.njob == 1 ? "" : "s"), nfail, t1 - t0);
+
+  if ((err == ERROR_OK) && (nrun < B.njob))
+    err = ERROR_USER;
+
+  batch_free(&B);
+
+  return err;
+}
+
+/*
+  read the manifest, creating the jobs -- this is done
+  before any job is run so that errors in the manifest
+  are found early (and since the option parsing is not
+  reentrant)
+*/
+
+static int tokenise(char*, char**, int*);
+
+static int batch_read(const char *manifest, batch_parse_t parse, batch_t *B)
+{
+  FILE *st;
+
+  if ((st = fopen(manifest, "r")) == NULL)
+    {
+      fprintf(stderr, "failed to open %s\n", manifest);
+      return ERROR_READ_OPEN;
+    }
+
+  size_t nalloc = 0, line = 0;
+  char buf[BATCH_LINE_MAX];
+  int err = ERROR_OK;
+
+  while (fgets(buf, BATCH_LINE_MAX, st) != NULL)
+    {
+      line++;
+
+      if (strchr(buf, '\n') == NULL && !feof(st))
+	{
+	  fprintf(stderr, "%s line %zi: too long\n", manifest, line);
+	  err = ERROR_USER;
+	  break;
+	}
+
+      /* skip blank and comment lines */
+
+      size_t skip = strspn(buf, " \t\r\n");
+
+      if ((buf[skip] == '\0') || (buf[skip] == '#'))
+	continue;
+
+      if (B->njob == nalloc)
+	{
+	  size_t n = (nalloc ? 2*nalloc : 16);
+	  job_t *job;
+
+	  if ((job = realloc(B->job, n*sizeof(job_t))) == NULL)
+	    {
+	      err = ERROR_MALLOC;
+	      break;
+	    }
+
+	  B->job = job;
+	  nalloc = n;
+	}
+
+      job_t *job = B->job + (B->njob++);
+      int argc;
+
+      memset(job, 0, sizeof(job_t));
+      job->line = line;
+
+      if (((job->text = strdup(buf)) == NULL) ||
+	  ((job->argv = malloc((BATCH_ARGS_MAX + 2)*sizeof(char*))) == NULL))
+	{
+	  err = ERROR_MALLOC;
+	  break;
+	}
+
+      if (tokenise(job->text, job->argv, &argc) != 0)
+	{
+	  fprintf(stderr, "%s line %zi: more than %i arguments\n",
+		  manifest, line, BATCH_ARGS_MAX);
+	  err = ERROR_USER;
+	  break;
+	}
+
+      if ((err = parse(argc, job->argv, &(job->opt))) != ERROR_OK)
+	{
+	  fprintf(stderr, "%s line %zi: bad job\n", manifest, line);
+	  if (err == ERROR_NODATA) err = ERROR_USER;
+	  break;
+	}
+    }
+
+  fclose(st);
+
+  return err;
+}
+
+/*
+  split the line into whitespace-separated tokens in
+  argv[1] ..., argv[0] is the program name
+*/
+
+static int tokenise(char *text, char **argv, int *pargc)
+{
+  char *save, *tok;
+  int argc = 1;
+
+  argv[0] = "vfplot";
+
+  for (tok = strtok_r(text, " \t\r\n", &save) ;
+       tok ;
+       tok = strtok_r(NULL, " \t\r\n", &save))
+    {
+      if (argc > BATCH_ARGS_MAX) return 1;
+      argv[argc++] = tok;
+    }
+
+  argv[argc] = NULL;
+
+  *pargc = argc;
+
+  return 0;
+}
+
+/*
+  assign each job reading an input field to a shared
+  bfield_t, those with the same format and files get
+  the same one; we also point the job options at the
+  job context here, now that the job array is fixed
+*/
+
+static bool same_input(const bfield_t *F, const opt_t *opt)
+{
+  if ((F->format != opt->input.format) ||
+      (F->store != opt->input.store) ||
+      (F->pyramid != opt->input.pyramid) ||
+      (F->tiles != opt->input.tiles) ||
+      (F->n != opt->input.n))
+    return false;
+
+  for (int i = 0 ; i < F->n ; i++)
+    if (strcmp(F->file[i], opt->input.file[i]) != 0)
+      return false;
+
+  return true;
+}
+
+static int batch_fields(batch_t *B)
+{
+  if ((B->field = malloc(B->njob*sizeof(bfield_t))) == NULL)
+    return ERROR_MALLOC;
+
+  for (size_t i = 0 ; i < B->njob ; i++)
+    {
+      job_t *job = B->job + i;
+
+      job->opt.context = &(job->context);
+
+      if (job->opt.test != test_none) continue;
+
+      bfield_t *F = NULL;
+
+      for (size_t j = 0 ; j < B->nfield ; j++)
+	{
+	  if (same_input(B->field + j, &(job->opt)))
+	    {
+	      F = B->field + j;
+	      break;
+	    }
+	}
+
+      if (!F)
+	{
+	  F = B->field + B->nfield;
+
+	  F->format  = job->opt.input.format;
+	  F->store   = job->opt.input.store;
+	  F->pyramid = job->opt.input.pyramid;
+	  F->tiles   = job->opt.input.tiles;
+	  F->n       = job->opt.input.n;
+	  F->file    = job->opt.input.file;
+	  F->refs    = 0;
+	  F->loaded  = false;
+	  F->field   = NULL;
+
+#ifdef HAVE_PTHREAD_H
+	  if (pthread_mutex_init(&(F->mutex), NULL) != 0)
+	    return ERROR_PTHREAD;
+#endif
+
+	  B->nfield++;
+	}
+
+      F->refs++;
+      job->field = F;
+    }
+
+#ifdef HAVE_PTHREAD_H
+
+  if ((pthread_mutex_init(&(B->mutex), NULL) != 0) ||
+      (pthread_mutex_init(&(B->read), NULL) != 0))
+    return ERROR_PTHREAD;
+
+#endif
+
+  return ERROR_OK;
+}
+
+/*
+  get the field for a job, reading it if this is the first
+  job to use it.  The field-reading libraries (netCDF, in
+  particular) are not thread-safe, so the reads themselves
+  are serialised with the batch read mutex.
+*/
+
+static field_t* field_acquire(batch_t *B, bfield_t *F)
+{
+  field_t *field;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(F->mutex));
+#endif
+
+  if (! F->loaded)
+    {
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_lock(&(B->read));
+#endif
+
+      field_opt_t fopt = {
+	.store   = F->store,
+	.pyramid = F->pyramid,
+	.tiles   = F->tiles,
+	.lazy    = false,
+	.threads = B->nworker
+      };
+
+      F->field  = field_read(F->format, &fopt, F->n, F->file);
+      F->loaded = true;
+
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_unlock(&(B->read));
+#endif
+    }
+
+  field = F->field;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(F->mutex));
+#endif
+
+  return field;
+}
+
+static void field_release(bfield_t *F)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(F->mutex));
+#endif
+
+  if (--(F->refs) == 0)
+    {
+      field_destroy(F->field);
+      F->field = NULL;
+    }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(F->mutex));
+#endif
+}
+
+/* take the next job from the queue, NULL if none */
+
+static job_t* next_job(batch_t *B)
+{
+  job_t *job = NULL;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&(B->mutex));
+#endif
+
+  if ((! B->halt) && (B->next < B->njob))
+    job = B->job + (B->next++);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&(B->mutex));
+#endif
+
+  return job;
+}
+
+static void run_job(batch_t *B, job_t *job)
+{
+  double t0 = batch_time();
+
+  if (job->field)
+    {
+      field_t *field = field_acquire(B, job->field);
+
+      if (field)
+	job->err = plot_field(&(job->opt), field);
+      else
+	{
+	  fprintf(stderr, "job %zi: failed to read field\n", job->line);
+	  job->err = ERROR_READ_OPEN;
+	}
+
+      field_release(job->field);
+    }
+  else
+    job->err = plot(&(job->opt));
+
+  job->time = batch_time() - t0;
+}
+
+static void* batch_worker(batch_t *B)
+{
+  job_t *job;
+
+  while ((job = next_job(B)) != NULL)
+    {
+      run_job(B, job);
+
+      const char *path = job->opt.v.file.output.path;
+
+      printf("job %zi %s %.3f s%s%s\n",
+	     job->line,
+	     path,
+	     job->time,
+	     (job->err == ERROR_OK ? "" : ", failed : "),
+	     (job->err == ERROR_OK ? "" : plot_strerror(job->err)));
+      fflush(stdout);
+    }
+
+  return NULL;
+}
+
+static void batch_free(batch_t *B)
+{
+  for (size_t i = 0 ; i < B->njob ; i++)
+    {
+      free(B->job[i].text);
+      free(B->job[i].argv);
+    }
+
+  free(B->job);
+  free(B->field);
+}
+
+/* wall-clock time in seconds */
+
+static double batch_time(void)
+{
+#ifdef HAVE_GETTIMEOFDAY
+
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return tv.tv_sec + tv.tv_usec/1e6;
+
+#else
+
+  return (double)time(NULL);
+
+#endif
+}
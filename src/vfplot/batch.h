@@ -0,0 +1,28 @@
+/*
+  batch.h
+
+  run the vfplot jobs listed in a manifest file
+  concurrently over a pool of worker threads
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <vfplot/vfplot.h>
+
+#include "plot.h"
+
+/*
+  the manifest has one job per line, each being the
+  options and input files for that job as they would
+  be given to vfplot on the command-line; these are
+  converted to an opt_t by the batch_parse_t function
+  passed to batch(), which gets argv[0] set to the
+  program name, like main()
+*/
+
+typedef int (*batch_parse_t)(int, char**, opt_t*);
+
+extern int batch(const char*, batch_parse_t, int, bool_t);
+
+#endif
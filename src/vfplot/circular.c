@@ -41,6 +41,22 @@ extern int cf_curvature(cf_t* cf, double x, double y, double *curv)
   return 0;
 }
 
+/* the field (y, -x) in the direction of cf_vector, and its Jacobian */
+
+extern int cf_jacobian(cf_t* cf, double x, double y,
+		       double *u, double *v, double *J)
+{
+  *u = y;
+  *v = -x;
+
+  J[0] =  0.0;
+  J[1] =  1.0;
+  J[2] = -1.0;
+  J[3] =  0.0;
+
+  return 0;
+}
+
 /* domain to populate */
 
 extern domain_t* cf_domain(double w, double h)
@@ -15,6 +15,7 @@ typedef struct
 
 extern int cf_vector(cf_t*,double,double,double*,double*);
 extern int cf_curvature(cf_t*,double,double,double*);
+extern int cf_jacobian(cf_t*,double,double,double*,double*,double*);
 extern domain_t* cf_domain(double,double);
 
 #endif
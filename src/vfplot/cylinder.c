@@ -42,6 +42,47 @@ extern int cylf_vector(cylf_t* cylf, double x, double y, double* t, double* m)
   return 0;
 }
 
+/*
+  the field (u, v) as in cylf_vector and its Jacobian, with
+  g = G/2pi the derivatives are
+
+  du/dx = -Va^2(2x/R^4 - 4x(x^2-y^2)/R^6) + 2gxy/R^4
+  du/dy =  Va^2(2y/R^4 + 4y(x^2-y^2)/R^6) - g(1/R^2 - 2y^2/R^4)
+  dv/dx = -2Va^2(y/R^4 - 4x^2y/R^6) + g(1/R^2 - 2x^2/R^4)
+  dv/dy = -2Va^2(x/R^4 - 4xy^2/R^6) - 2gxy/R^4
+*/
+
+extern int cylf_jacobian(cylf_t* cylf, double x, double y,
+			 double *u, double *v, double *J)
+{
+  double
+    a  = cylf->radius,
+    G  = cylf->gamma,
+    V  = cylf->speed;
+
+  double
+    x0 = x - cylf->x,
+    y0 = y - cylf->y,
+    R2 = x0*x0+y0*y0,
+    R4 = R2*R2,
+    R6 = R4*R2,
+    a2 = a*a,
+    g  = G/(2*M_PI),
+    d2 = x0*x0 - y0*y0;
+
+  if (R2 < a2) return 1;
+
+  *u = V*(1-a2*d2/R4) - G*y0/(2*R2*M_PI);
+  *v = -V*a2*2.0*x0*y0/R4 + G*x0/(2*R2*M_PI);
+
+  J[0] = -V*a2*(2*x0/R4 - 4*x0*d2/R6) + 2*g*x0*y0/R4;
+  J[1] =  V*a2*(2*y0/R4 + 4*y0*d2/R6) - g*(1/R2 - 2*y0*y0/R4);
+  J[2] = -2*V*a2*(y0/R4 - 4*x0*x0*y0/R6) + g*(1/R2 - 2*x0*x0/R4);
+  J[3] = -2*V*a2*(x0/R4 - 4*x0*y0*y0/R6) - 2*g*x0*y0/R4;
+
+  return 0;
+}
+
 extern domain_t* cylf_domain(cylf_t cylf)
 {
   bbox_t b = {{-1, 1}, {-1, 1}};
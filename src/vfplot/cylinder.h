@@ -14,6 +14,7 @@ typedef struct
 } cylf_t;
 
 extern int cylf_vector(cylf_t*,double,double,double*,double*);
+extern int cylf_jacobian(cylf_t*,double,double,double*,double*,double*);
 extern domain_t* cylf_domain(cylf_t);
 
 #endif
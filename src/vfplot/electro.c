@@ -35,6 +35,51 @@ extern int ef_vector(ef_t* ef, double x, double y, double* t, double* m)
   return 0;
 }
 
+/*
+  the field and its Jacobian, each charge contributing
+  Q(x, y)/R^3 to the former, and Q(I/R^3 - 3(x, y)(x, y)'/R^5)
+  to the latter (in coordinates relative to the charge)
+*/
+
+extern int ef_jacobian(ef_t* ef, double x, double y,
+		       double *u, double *v, double *J)
+{
+  int i, n = ef->n;
+  charge_t *c = ef->charge;
+  double u0 = 0.0, v0 = 0.0, J0[4] = {0.0, 0.0, 0.0, 0.0};
+
+  for (i=0 ; i<n ; i++)
+    {
+      double
+	dx = x - c[i].x,
+	dy = y - c[i].y,
+	R2 = dx*dx + dy*dy;
+
+      if (R2 <= 0.0) return 1;
+
+      double
+	R  = sqrt(R2),
+	R3 = R2*R,
+	R5 = R3*R2,
+	Q  = c[i].Q;
+
+      u0 += Q*dx/R3;
+      v0 += Q*dy/R3;
+
+      J0[0] += Q*(1/R3 - 3*dx*dx/R5);
+      J0[1] -= Q*3*dx*dy/R5;
+      J0[2] -= Q*3*dx*dy/R5;
+      J0[3] += Q*(1/R3 - 3*dy*dy/R5);
+    }
+
+  *u = u0;
+  *v = v0;
+
+  for (i=0 ; i<4 ; i++) J[i] = J0[i];
+
+  return 0;
+}
+
 /*
    generated a domain [-1,1]x[-1,1], with as many
    holes as are needed
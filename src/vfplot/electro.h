@@ -21,6 +21,7 @@ typedef struct
 } ef_t;
 
 extern int ef_vector(ef_t*,double,double,double*,double*);
+extern int ef_jacobian(ef_t*,double,double,double*,double*,double*);
 extern domain_t* ef_domain(ef_t);
 
 #endif
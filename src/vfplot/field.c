@@ -19,6 +19,9 @@
 #include <math.h>
 #include <string.h>
 
+#include <vfplot/error.h>
+#include <vfplot/macros.h>
+
 #include "field_common.h"
 
 #include "field_sag.h"
@@ -39,24 +42,135 @@ extern int fv_field(field_t *field, double x, double y, double *t, double *m)
   return 0;
 }
 
+extern int fv_field_batch(field_t *field, size_t n,
+			  const double *x, const double *y,
+			  double *t, double *m)
+{
+  return bilinear_batch_polar(n, x, y, field->u, field->v, t, m);
+}
+
+/*
+  the lazy curvature is calculated on tiles of the grid of
+  this many nodes on a side, when a cell with a corner in
+  the tile is first queried
+*/
+
+#define FIELD_KTILE_SHIFT 6
+
+static void field_curvature_tiles(field_t *field, double x, double y)
+{
+  int nx, ny;
+  bbox_t bb = bilinear_bbox(field->u);
+
+  bilinear_nxy(field->u, &nx, &ny);
+
+  int
+    i = (int)floor((nx - 1)*(x - bb.x.min)/bbox_width(bb)),
+    j = (int)floor((ny - 1)*(y - bb.y.min)/bbox_height(bb)),
+    s = FIELD_KTILE_SHIFT;
+
+  if ((i < 0) || (i >= nx-1) || (j < 0) || (j >= ny-1)) return;
+
+  for (int ti = i >> s ; ti <= (i+1) >> s ; ti++)
+    {
+      for (int tj = j >> s ; tj <= (j+1) >> s ; tj++)
+	{
+	  unsigned char *done = field->kdone + ((size_t)tj*field->ktx + ti);
+
+	  if (*done) continue;
+
+	  if (bilinear_curvature_fill(field->u, field->v,
+				      ti << s, (ti+1) << s,
+				      tj << s, (tj+1) << s,
+				      field->k) == ERROR_OK)
+	    *done = 1;
+	}
+    }
+}
+
 extern int fc_field(field_t *field, double x, double y, double *k)
 {
+  if (field->kdone) field_curvature_tiles(field, x, y);
+
   return bilinear(x, y, field->k, k);
 }
 
+/*
+  the versions of these using the pyramid, for an arrow at
+  (x, y) we estimate its length from the magnitude on the
+  coarsest level with data there, then take the coarsest
+  level whose cells are at most 1/FIELD_PYRAMID_CELLS of
+  that length, falling back to finer levels on nodata.  The
+  length of the arrow is sqrt(la*m) for field magnitude m,
+  so la is the product of the aspect ratio and any scaling
+  of the field.  Level 0 is the field itself.
+
+  The level is found by field_pyramid_level() and passed to
+  the evaluations, so that a caller evaluating both vector
+  and curvature at a point need only find it once.
+*/
+
+#define FIELD_PYRAMID_CELLS 16
+
+extern size_t field_pyramid_level(field_t *field, double la,
+				  double x, double y)
+{
+  size_t l;
+  double t, m;
+
+  for (l = field->nlev ; l > 0 ; l--)
+    if (fv_field(field->level + (l-1), x, y, &t, &m) == 0) break;
+
+  if (l == 0) return 0;
+
+  double r = sqrt(la*m)/(FIELD_PYRAMID_CELLS*field->h);
+
+  for (l = 0 ; (l < field->nlev) && (r >= 2) ; l++) r /= 2;
+
+  return l;
+}
+
+extern int fv_field_pyramid(field_t *field, size_t level,
+			    double x, double y, double *t, double *m)
+{
+  for (size_t l = level ; l > 0 ; l--)
+    if (fv_field(field->level + (l-1), x, y, t, m) == 0) return 0;
+
+  return fv_field(field, x, y, t, m);
+}
+
+extern int fc_field_pyramid(field_t *field, size_t level,
+			    double x, double y, double *k)
+{
+  for (size_t l = level ; l > 0 ; l--)
+    if (fc_field(field->level + (l-1), x, y, k) == 0) return 0;
+
+  return fc_field(field, x, y, k);
+}
+
 extern bbox_t field_bbox(field_t *field)
 {
   return bilinear_bbox(field->u);
 }
 
-extern void field_destroy(field_t *field)
+static void field_grids_destroy(field_t *field)
 {
-  if (!field) return;
-
   if (field->u) bilinear_destroy(field->u);
   if (field->v) bilinear_destroy(field->v);
   if (field->k) bilinear_destroy(field->k);
+}
+
+extern void field_destroy(field_t *field)
+{
+  if (!field) return;
+
+  field_grids_destroy(field);
 
+  for (size_t l = 0 ; l < field->nlev ; l++)
+    field_grids_destroy(field->level + l);
+
+  free(field->level);
+  free(field->kdone);
   free(field);
 }
 
@@ -64,18 +178,202 @@ extern void field_scale(field_t *field, double M)
 {
   bilinear_scale(field->u, M);
   bilinear_scale(field->v, M);
+
+  for (size_t l = 0 ; l < field->nlev ; l++)
+    field_scale(field->level + l, M);
+}
+
+/*
+  build the pyramid: each level is the decimation (see
+  bilinear_decimate) of the one before, with its curvature
+  calculated from its own u, v, until a level would have
+  fewer than FIELD_PYRAMID_MIN nodes on a side
+*/
+
+#define FIELD_PYRAMID_MIN 16
+#define FIELD_PYRAMID_MAX 16
+
+static int field_pyramid(field_t *field, int nt)
+{
+  field_t level[FIELD_PYRAMID_MAX], *F = field;
+  size_t n = 0;
+  int err = ERROR_OK;
+
+  while (n < FIELD_PYRAMID_MAX)
+    {
+      int nx, ny;
+
+      bilinear_nxy(F->u, &nx, &ny);
+
+      if ((nx < 2*FIELD_PYRAMID_MIN) || (ny < 2*FIELD_PYRAMID_MIN))
+	break;
+
+      field_t *L = level + n;
+
+      L->u = bilinear_decimate(F->u);
+      L->v = bilinear_decimate(F->v);
+      L->k = NULL;
+      L->nlev  = 0;
+      L->level = NULL;
+      L->kdone = NULL;
+
+      if ((L->u == NULL) || (L->v == NULL) ||
+	  ((L->k = bilinear_curvature(L->u, L->v, nt)) == NULL))
+	{
+	  field_grids_destroy(L);
+	  err = ERROR_MALLOC;
+	  break;
+	}
+
+      F = L;
+      n++;
+    }
+
+  if ((err == ERROR_OK) && (n > 0))
+    {
+      if ((field->level = malloc(n*sizeof(field_t))) == NULL)
+	err = ERROR_MALLOC;
+      else
+	{
+	  for (size_t l = 0 ; l < n ; l++)
+	    field->level[l] = level[l];
+	  field->nlev = n;
+	}
+    }
+
+  if (err != ERROR_OK)
+    {
+      for (size_t l = 0 ; l < n ; l++)
+	field_grids_destroy(level + l);
+    }
+
+  return err;
+}
+
+/*
+  the grids are compiled (see bilinear_compile) for faster
+  interpolation unless they have more than this many nodes,
+  the compiled form takes four times the memory of the grid.
+  The grids are not compiled either if reduced-precision
+  storage is asked for, since the point of that is to save
+  memory, nor if tiled storage is asked for; that is not the
+  default since, in our benchmarks, the tiles are slower than
+  the row-major grid and take more memory.  Failure of any
+  of these is not an error, we just interpolate the grid as
+  it is
+*/
+
+#define FIELD_COMPILE_MAX (1 << 22)
+
+static void field_compile_grids(field_t *field,
+				bilinear_store_t store, bool tiles)
+{
+  int nx, ny;
+
+  bilinear_nxy(field->u, &nx, &ny);
+
+  if (store != bilinear_double)
+    {
+      bilinear_store(field->u, store);
+      bilinear_store(field->v, store);
+      bilinear_store(field->k, store);
+    }
+
+  if (tiles)
+    {
+      bilinear_tile(field->u);
+      bilinear_tile(field->v);
+      bilinear_tile(field->k);
+      return;
+    }
+
+  if ((store != bilinear_double) || ((size_t)nx*ny > FIELD_COMPILE_MAX))
+    return;
+
+  bilinear_compile(field->u);
+  bilinear_compile(field->v);
+  bilinear_compile(field->k);
+}
+
+static void field_compile(field_t *field, const field_opt_t *opt)
+{
+  field_compile_grids(field, opt->store, opt->tiles);
+
+  for (size_t l = 0 ; l < field->nlev ; l++)
+    field_compile_grids(field->level + l, opt->store, opt->tiles);
 }
 
 static format_t detect_format(int, char**);
 
-extern field_t* field_read(format_t format, int n, char** file)
+/*
+  the curvature of the field grid, this is calculated lazily
+  if that is allowed, the grid is too large to be compiled and
+  is not to be quantised (since the quantisation needs the
+  range of the values).  In that case it is calculated from
+  the u, v grids as stored, so perhaps in reduced precision
+*/
+
+static int field_curvature(field_t *field, const field_opt_t *opt)
+{
+  int nx, ny;
+
+  bilinear_nxy(field->u, &nx, &ny);
+
+  if (opt->lazy &&
+      ((size_t)nx*ny > FIELD_COMPILE_MAX) &&
+      (opt->store != bilinear_int16))
+    {
+      int
+	s = FIELD_KTILE_SHIFT,
+	ktx = ((nx - 1) >> s) + 1,
+	kty = ((ny - 1) >> s) + 1;
+      bilinear_t *k;
+
+      if ((k = bilinear_new()) == NULL)
+	return ERROR_MALLOC;
+
+      if (bilinear_dimension(nx, ny, bilinear_bbox(field->u), k) != ERROR_OK)
+	{
+	  bilinear_destroy(k);
+	  return ERROR_MALLOC;
+	}
+
+      field->k = k;
+
+      if ((field->kdone = calloc((size_t)ktx*kty, 1)) == NULL)
+	return ERROR_MALLOC;
+
+      field->ktx = ktx;
+      field->kty = kty;
+
+      return ERROR_OK;
+    }
+
+  if ((field->k = bilinear_curvature(field->u, field->v, opt->threads)) == NULL)
+    return ERROR_MALLOC;
+
+#ifdef DUMP_CURVATURE
+  bilinear_write("k.dat", field->k);
+#endif
+
+  return ERROR_OK;
+}
+
+/*
+  the curvature (and the pyramid, if asked for) is calculated
+  from the double-precision grids before any conversion to the
+  storage asked for
+*/
+
+extern field_t* field_read(format_t format, const field_opt_t *opt,
+			   int n, char** file)
 {
   field_t* field = NULL;
 
   switch (format)
     {
     case format_auto:
-      return field_read(detect_format(n, file), n, file);
+      return field_read(detect_format(n, file), opt, n, file);
 
     case format_grd2:
       if (n != 2)
@@ -120,16 +418,20 @@ extern field_t* field_read(format_t format, int n, char** file)
 
   if (field)
     {
-      bilinear_t* k;
-
-      if ((k = bilinear_curvature(field->u, field->v)) != NULL)
+      if (field_curvature(field, opt) == ERROR_OK)
 	{
-	  field->k = k;
+	  int nx, ny;
+	  bbox_t bb = bilinear_bbox(field->u);
 
-#ifdef DUMP_CURVATURE
-	  bilinear_write("k.dat", k);
-#endif
-	  return field;
+	  bilinear_nxy(field->u, &nx, &ny);
+	  field->h = MIN(bbox_width(bb)/(nx - 1), bbox_height(bb)/(ny - 1));
+
+	  if ((! opt->pyramid) ||
+	      (field_pyramid(field, opt->threads) == ERROR_OK))
+	    {
+	      field_compile(field, opt);
+	      return field;
+	    }
 	}
 
       field_destroy(field);
@@ -11,7 +11,10 @@
 #ifndef FIELD_H
 #define FIELD_H
 
+#include <stdbool.h>
+
 #include <vfplot/domain.h>
+#include <vfplot/bilinear.h>
 
 #define INPUT_FILES_MAX 2
 
@@ -30,12 +33,34 @@ typedef enum format_e format_t;
 
 typedef struct field_t field_t;
 
-extern field_t* field_read(format_t, int, char**);
+/*
+  options for field_read(): the storage of the grids, whether
+  to store them in tiles, whether to build the resolution
+  pyramid, the number of threads used
+  to calculate the curvature, and whether it may instead be
+  calculated lazily, only allowed if the field will not be
+  evaluated concurrently
+*/
+
+typedef struct
+{
+  bilinear_store_t store;
+  bool pyramid, tiles, lazy;
+  int threads;
+} field_opt_t;
+
+extern field_t* field_read(format_t, const field_opt_t*, int, char**);
 extern void field_destroy(field_t*);
 extern bbox_t field_bbox(field_t*);
 extern void field_scale(field_t*, double);
 extern int fv_field(field_t*, double, double, double*, double*);
+extern int fv_field_batch(field_t*, size_t, const double*, const double*,
+			  double*, double*);
 extern int fc_field(field_t*, double, double, double*);
+extern size_t field_pyramid_level(field_t*, double, double, double);
+extern int fv_field_pyramid(field_t*, size_t, double, double,
+			    double*, double*);
+extern int fc_field_pyramid(field_t*, size_t, double, double, double*);
 extern domain_t* field_domain(field_t*);
 
 #endif  
@@ -11,9 +11,23 @@
 
 #include "field.h"
 
+/*
+  the optional pyramid (see field_read) is an array of nlev
+  fields of successively halved resolution, those having
+  no pyramid themselves, and h is the cell size of the field.
+  If the curvature is calculated lazily then kdone is the
+  array of flags of the ktx x kty tiles of k which are done,
+  otherwise it is NULL
+*/
+
 struct field_t 
 {
   bilinear_t *u,*v,*k;
+  size_t nlev;
+  struct field_t *level;
+  double h;
+  unsigned char *kdone;
+  int ktx, kty;
 };
 
 #endif
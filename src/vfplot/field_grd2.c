@@ -230,6 +230,9 @@ extern field_t* field_read_grd2(const char* grdu, const char* grdv)
   F->u = B[0];
   F->v = B[1];
   F->k = NULL;
+  F->nlev  = 0;
+  F->level = NULL;
+  F->kdone = NULL;
 
   return F;
 }
@@ -252,6 +252,9 @@ extern field_t* field_read_mat(const char* file)
   F->u = B[0];
   F->v = B[1];
   F->k = NULL;
+  F->nlev  = 0;
+  F->level = NULL;
+  F->kdone = NULL;
 
   return F;
 }
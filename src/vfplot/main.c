@@ -32,8 +32,15 @@
 
 #include "options.h"
 #include "plot.h"
+#include "batch.h"
+
+/* default iterations for a warm start, see get_options() */
+
+#define WARM_ITERATIONS "10/10"
 
 static int get_options(struct gengetopt_args_info*, opt_t*);
+static int get_job(int, char**, opt_t*);
+static int get_workers(struct gengetopt_args_info*);
 
 int main(int argc, char **argv)
 {
@@ -55,6 +62,22 @@ int main(int argc, char **argv)
       return ERROR_OK;
     }
 
+  if (info.batch_given)
+    {
+      int nw = get_workers(&info);
+
+      if (nw < 1)
+	return EXIT_FAILURE;
+
+      if ((err = batch(info.batch_arg, get_job, nw, info.verbose_given)) != ERROR_OK)
+	{
+	  fprintf(stderr, "failure in batch : %s\n", plot_strerror(err));
+	  return EXIT_FAILURE;
+	}
+
+      return EXIT_SUCCESS;
+    }
+
   switch (get_options(&info, &opt))
     {
     case ERROR_OK: break;
@@ -71,23 +94,7 @@ int main(int argc, char **argv)
 
   if ((err = plot(&opt)) != ERROR_OK)
     {
-      const char* msg;
-
-      switch (err)
-        {
-        case ERROR_USER:       msg = "unfortunate option selection?"; break;
-        case ERROR_READ_OPEN:  msg = "failed to read file"; break;
-        case ERROR_WRITE_OPEN: msg = "failed to write file"; break;
-        case ERROR_MALLOC:     msg = "out of memory"; break;
-        case ERROR_BUG:        msg = "probably a bug"; break;
-        case ERROR_LIBGSL:     msg = "error from libgsl call"; break;
-        case ERROR_NODATA:     msg = "no data"; break;
-	case ERROR_PTHREAD:    msg = "thread error"; break;
-        default:               msg = "unknown error - weird";
-        }
-
-      fprintf(stderr, "failure plotting : %s\n", msg);
-
+      fprintf(stderr, "failure plotting : %s\n", plot_strerror(err));
       return EXIT_FAILURE;
     }
 
@@ -281,6 +288,7 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
     }
 
   opt->input.n = nf;
+  opt->context = NULL;
 
   for (int i = 0 ; i < nf ; i++)
     {
@@ -333,6 +341,24 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
 
   opt->input.format = format;
 
+  int store = bilinear_double;
+
+  if (info->field_storage_given)
+    {
+      string_opt_t o[] = {
+	{"double", "double precision", bilinear_double},
+	{"float", "single precision", bilinear_float},
+	{"int16", "quantised 16-bit integer", bilinear_int16},
+	SO_NULL};
+
+      int err = string_opt(o, "field storage", 6, info->field_storage_arg, &store);
+      if (err != ERROR_OK) return err;
+    }
+
+  opt->input.store   = store;
+  opt->input.pyramid = info->field_pyramid_given;
+  opt->input.tiles   = info->field_tiles_given;
+
   /* graphics state */
 
   opt->state.action = state_none;
@@ -387,6 +413,31 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
 
     }
 
+  /* warm start */
+
+  opt->warm.file = (info->warm_start_given ? info->warm_start_arg : NULL);
+
+  /* evaluation cache */
+
+  if (info->evaluate_cache_arg < 0)
+    {
+      fprintf(stderr,
+	      "evaluation cache size %i is negative\n",
+	      info->evaluate_cache_arg);
+      return ERROR_USER;
+    }
+
+  opt->evcache.n = info->evaluate_cache_arg;
+  opt->evcache.quantum = 0.0;
+
+  if (info->evaluate_quantum_given)
+    {
+      int err = scan_length(info->evaluate_quantum_arg,
+			    "evaluation quantum",
+			    &(opt->evcache.quantum));
+      if (err != ERROR_OK) return err;
+    }
+
   /*
      libvfplot options, these are in the vpopt_t structure
      contained in opt->v, and this is passed to the later
@@ -727,9 +778,74 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
 
 	  opt->v.place.adaptive.mtcache = info->cache_arg;
 
+	  if (info->cache_tolerance_given)
+	    {
+	      if (! (info->cache_tolerance_arg > 0))
+		{
+		  fprintf(stderr,
+			  "metric tensor tolerance must be positive, not %f\n",
+			  info->cache_tolerance_arg);
+		  return ERROR_USER;
+		}
+
+	      opt->v.place.adaptive.mttol = info->cache_tolerance_arg;
+	    }
+	  else
+	    opt->v.place.adaptive.mttol = 0.0;
+
+	  if (info->cache_file_given)
+	    {
+	      if (info->cache_tolerance_given)
+		{
+		  fprintf(stderr,
+			  "cache file not supported for adaptive metric tensor\n");
+		  return ERROR_USER;
+		}
+
+	      opt->v.place.adaptive.mtfile.file = info->cache_file_arg;
+	    }
+	  else
+	    opt->v.place.adaptive.mtfile.file = NULL;
+
+	  opt->v.place.adaptive.mtfile.key = 0;
+
 	  opt->v.place.adaptive.histogram =
 	    (info->histogram_given ? info->histogram_arg : NULL);
 
+	  opt->v.place.adaptive.single = info->single_precision_given;
+
+	  opt->v.place.adaptive.warm.n = 0;
+	  opt->v.place.adaptive.warm.A = NULL;
+
+	  opt->v.place.adaptive.tiles.x = 1;
+	  opt->v.place.adaptive.tiles.y = 1;
+
+	  if (info->tiles_given)
+	    {
+	      int t[2];
+
+	      switch (sscanf(info->tiles_arg, "%i/%i", t+0, t+1))
+		{
+		case 1:
+		  t[1] = t[0];
+		  break;
+		case 2:
+		  break;
+		default :
+		  fprintf(stderr, "malformed tiles %s\n", info->tiles_arg);
+		  return ERROR_USER;
+		}
+
+	      if ((t[0] < 1) || (t[1] < 1))
+		{
+		  fprintf(stderr, "bad tiling %i x %i\n", t[0], t[1]);
+		  return ERROR_USER;
+		}
+
+	      opt->v.place.adaptive.tiles.x = t[0];
+	      opt->v.place.adaptive.tiles.y = t[1];
+	    }
+
 	  if (info->break_given)
 	    {
 	      /*
@@ -760,11 +876,21 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
 	      opt->v.place.adaptive.breakout = brk;
 	    }
 
-	  if (!info->iterations_arg) return ERROR_BUG;
+	  /*
+	    a warm start skips the initial phases of the
+	    dynamics, so needs fewer iterations by default
+	  */
+
+	  const char *iterations =
+	    ((info->warm_start_given && ! info->iterations_given) ?
+	     WARM_ITERATIONS :
+	     info->iterations_arg);
+
+	  if (!iterations) return ERROR_BUG;
 
 	  int k[2];
 
-	  switch (sscanf(info->iterations_arg, "%i/%i", k+0, k+1))
+	  switch (sscanf(iterations, "%i/%i", k+0, k+1))
 	    {
 	    case 1:
 	      opt->v.place.adaptive.iter.main  = k[0];
@@ -775,13 +901,14 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
 	      opt->v.place.adaptive.iter.euler = k[1];
 	      break;
 	    default :
-	      fprintf(stderr, "malformed iteration %s\n", info->iterations_arg);
+	      fprintf(stderr, "malformed iteration %s\n", iterations);
 	      return ERROR_USER;
 	    }
 
 	  opt->v.place.adaptive.iter.populate = 0;
 	  opt->v.place.adaptive.animate = info->animate_given;
 	  opt->v.place.adaptive.decimate.late = info->decimate_late_given;
+	  opt->v.place.adaptive.decimate.inter = info->decimate_paths_given;
 
 	  if (info->decimate_contact_arg < 0)
 	    {
@@ -878,3 +1005,79 @@ static int get_options(struct gengetopt_args_info *info, opt_t *opt)
 
   return ERROR_OK;
 }
+
+/*
+  options for a batch job, as get_options(), but the
+  strings in the opt_t point into the info struct so
+  it is not freed, and the number of threads used in
+  the dynamics defaults to one (since the jobs are
+  already run concurrently)
+*/
+
+static int get_job(int argc, char **argv, opt_t *opt)
+{
+  struct gengetopt_args_info *info;
+
+  if ((info = malloc(sizeof(struct gengetopt_args_info))) == NULL)
+    return ERROR_MALLOC;
+
+  options(argc, argv, info);
+
+  int err;
+
+  if (info->help_given || info->version_given || info->batch_given)
+    {
+      fprintf(stderr, "help, version and batch options not allowed in a batch job\n");
+      err = ERROR_USER;
+      goto failed;
+    }
+
+  if ((err = get_options(info, opt)) != ERROR_OK)
+    goto failed;
+
+  if (! info->threads_given)
+    opt->v.threads = 1;
+
+  return ERROR_OK;
+
+ failed:
+
+  options_free(info);
+  free(info);
+
+  return err;
+}
+
+/*
+  the number of batch workers, given by the -j option
+  for the batch (with the same semantics as for the
+  dynamics), and as many as there are processors if
+  not given
+*/
+
+static int get_workers(struct gengetopt_args_info *info)
+{
+  if (info->threads_given && (info->threads_arg != 0))
+    {
+      if (info->threads_arg < 0)
+	{
+	  fprintf(stderr, "bad number of workers (%i) specified\n",
+		  info->threads_arg);
+	  return 0;
+	}
+
+      return info->threads_arg;
+    }
+
+#if (defined _SC_NPROCESSORS_ONLN) && (defined HAVE_SYSCONF)
+
+  long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return (nproc > 0 ? nproc : 1);
+
+#else
+
+  return 1;
+
+#endif
+}
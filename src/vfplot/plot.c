@@ -33,6 +33,10 @@
 
 #include <time.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 /* library */
 
 #include <vfplot/vfplot.h>
@@ -40,6 +44,8 @@
 #include <vfplot/hedgehog.h>
 #include <vfplot/sagwrite.h>
 #include <vfplot/gstate.h>
+#include <vfplot/mtcache.h>
+#include <vfplot/evcache.h>
 
 #include <vfplot/domain.h>
 #include <vfplot/bbox.h>
@@ -57,7 +63,9 @@ static int plot_electro2(opt_t*);
 static int plot_electro3(opt_t*);
 static int plot_cylinder(opt_t*);
 
-static int plot_generic(domain_t*, vfun_t, cfun_t, void*, opt_t*);
+static int plot_generic(domain_t*, vfun_t, cfun_t, vfun_batch_t, jfun_t,
+			void*, opt_t*);
+static int field_key(const opt_t*, uint64_t*);
 
 
 #ifdef HAVE_GETTIMEOFDAY
@@ -148,7 +156,16 @@ extern int plot(opt_t *opt)
 	    }
 	}
 
+      field_opt_t fopt = {
+	.store   = opt->input.store,
+	.pyramid = opt->input.pyramid,
+	.tiles   = opt->input.tiles,
+	.lazy    = (opt->v.threads == 1),
+	.threads = opt->v.threads
+      };
+
       field_t *field = field_read(opt->input.format,
+				  &fopt,
 				  opt->input.n,
 				  opt->input.file);
 
@@ -158,27 +175,9 @@ extern int plot(opt_t *opt)
 	  return ERROR_READ_OPEN;
 	}
 
-      /* this needs to be in libvfplot */
-
-      field_scale(field, opt->v.arrow.scale);
-
-      domain_t* dom;
-
-      if (opt->domain.file)
-	dom = domain_read(opt->domain.file);
-      else
-	dom = field_domain(field);
-
-      if (!dom)
-	{
-	  fprintf(stderr, "no domain\n");
-	  return ERROR_BUG;
-	}
-
-      err = plot_generic(dom, (vfun_t)fv_field, (cfun_t)fc_field, (void*)field, opt);
+      err = plot_field(opt, field);
 
       field_destroy(field);
-      domain_destroy(dom);
     }
 
 #ifdef HAVE_STAT
@@ -257,6 +256,193 @@ extern int plot(opt_t *opt)
   return err;
 }
 
+/*
+  plot a field which has been read, the field is not
+  modified so may be shared between concurrent plots;
+  the scaling is applied by the sf_t wrapper, as is the
+  choice of the level of the field pyramid if there is one
+  (when la, the arrow length for unit field magnitude, squared,
+  is positive)
+
+  The arrows are evaluated by a call of the vector function
+  then of the curvature at the same point, so the level found
+  for the former is kept (for each thread, since the dynamics
+  may evaluate concurrently) and reused by the latter.
+*/
+
+typedef struct
+{
+  double x, y;
+  size_t level;
+} sf_level_t;
+
+typedef struct
+{
+  field_t *field;
+  double scale, la;
+#ifdef HAVE_PTHREAD_H
+  pthread_key_t key;
+#else
+  sf_level_t *last;
+#endif
+} sf_t;
+
+/* the last level of the calling thread, allocated on first use */
+
+static sf_level_t* sf_last(sf_t *sf)
+{
+#ifdef HAVE_PTHREAD_H
+
+  sf_level_t *L = pthread_getspecific(sf->key);
+
+  if (L) return L;
+
+  if ((L = malloc(sizeof(sf_level_t))) == NULL)
+    return NULL;
+
+  if (pthread_setspecific(sf->key, L) != 0)
+    {
+      free(L);
+      return NULL;
+    }
+
+  L->x = L->y = NAN;
+
+  return L;
+
+#else
+
+  return sf->last;
+
+#endif
+}
+
+static size_t sf_level(sf_t *sf, double x, double y)
+{
+  sf_level_t *L = sf_last(sf);
+
+  if (L && (L->x == x) && (L->y == y))
+    return L->level;
+
+  size_t level = field_pyramid_level(sf->field, sf->la, x, y);
+
+  if (L)
+    {
+      L->x = x;
+      L->y = y;
+      L->level = level;
+    }
+
+  return level;
+}
+
+static int sf_vector(sf_t *sf, double x, double y, double *t, double *m)
+{
+  int err = (sf->la > 0 ?
+	     fv_field_pyramid(sf->field, sf_level(sf, x, y),
+			      x, y, t, m) :
+	     fv_field(sf->field, x, y, t, m));
+
+  *m *= sf->scale;
+
+  return err;
+}
+
+static int sf_vector_batch(sf_t *sf, size_t n,
+			   const double *x, const double *y,
+			   double *t, double *m)
+{
+  int err = fv_field_batch(sf->field, n, x, y, t, m);
+
+  for (size_t k = 0 ; k < n ; k++)
+    m[k] *= sf->scale;
+
+  return err;
+}
+
+static int sf_curvature(sf_t *sf, double x, double y, double *k)
+{
+  return (sf->la > 0 ?
+	  fc_field_pyramid(sf->field, sf_level(sf, x, y),
+			   x, y, k) :
+	  fc_field(sf->field, x, y, k));
+}
+
+extern int plot_field(opt_t *opt, field_t *field)
+{
+  bool pyramid = opt->input.pyramid;
+  sf_t sf = {
+    .field = field,
+    .scale = opt->v.arrow.scale,
+    .la    = (pyramid ? opt->v.arrow.aspect * opt->v.arrow.scale : 0.0)
+  };
+
+  domain_t* dom;
+
+  if (opt->domain.file)
+    dom = domain_read(opt->domain.file);
+  else
+    dom = field_domain(field);
+
+  if (!dom)
+    {
+      fprintf(stderr, "no domain\n");
+      return ERROR_BUG;
+    }
+
+#ifdef HAVE_PTHREAD_H
+
+  if (pthread_key_create(&(sf.key), free) != 0)
+    {
+      domain_destroy(dom);
+      return ERROR_BUG;
+    }
+
+#else
+
+  sf_level_t last = { .x = NAN, .y = NAN };
+
+  sf.last = &last;
+
+#endif
+
+  int err = plot_generic(dom,
+			 (vfun_t)sf_vector,
+			 (cfun_t)sf_curvature,
+			 (pyramid ? NULL : (vfun_batch_t)sf_vector_batch),
+			 NULL,
+			 &sf, opt);
+
+  /* those of other threads were freed as they exited */
+
+#ifdef HAVE_PTHREAD_H
+  free(pthread_getspecific(sf.key));
+  pthread_key_delete(sf.key);
+#endif
+
+  domain_destroy(dom);
+
+  return err;
+}
+
+extern const char* plot_strerror(int err)
+{
+  switch (err)
+    {
+    case ERROR_OK:         return "success";
+    case ERROR_USER:       return "unfortunate option selection?";
+    case ERROR_READ_OPEN:  return "failed to read file";
+    case ERROR_WRITE_OPEN: return "failed to write file";
+    case ERROR_MALLOC:     return "out of memory";
+    case ERROR_BUG:        return "probably a bug";
+    case ERROR_LIBGSL:     return "error from libgsl call";
+    case ERROR_NODATA:     return "no data";
+    case ERROR_PTHREAD:    return "thread error";
+    }
+
+  return "unknown error - weird";
+}
+
 static int timeval_subtract(struct timeval *res,
 			    const struct timeval *t2,
 			    const struct timeval *t1)
@@ -273,7 +459,8 @@ static int timeval_subtract(struct timeval *res,
 #define DUMP_X_SAMPLES 128
 #define DUMP_Y_SAMPLES 128
 
-static int plot_generic(domain_t* dom, vfun_t fv, cfun_t fc, void *field, opt_t *opt)
+static int plot_generic(domain_t* dom, vfun_t fv, cfun_t fc, vfun_batch_t fvb,
+			jfun_t fj, void *field, opt_t *opt)
 {
   int err = ERROR_BUG;
   size_t nA; arrow_t* A;
@@ -317,22 +504,110 @@ static int plot_generic(domain_t* dom, vfun_t fv, cfun_t fc, void *field, opt_t
     }
   else
     {
+      vfp_context_t local, *ctx = opt->context;
+      evcache_t *cache = NULL;
+
+      if (opt->evcache.n > 0)
+	{
+	  if ((cache = evcache_new(opt->evcache.n,
+				   opt->evcache.quantum)) == NULL)
+	    return ERROR_MALLOC;
+	}
+
+      /*
+	a batch field function, Jacobian or evaluation cache
+	can only be registered with a context, if we have one
+	but were not given a context we use a local one (and
+	must then handle SIGINT in the dynamics, as
+	vfplot_adaptive() would)
+      */
+
+      if ((fvb || fj || cache) && !ctx) ctx = &local;
+
+      if (ctx)
+	{
+	  vfplot_context_init(ctx, fv, fc, field, opt->v.arrow.aspect);
+	  vfplot_context_batch(ctx, fvb);
+	  vfplot_context_jacobian(ctx, fj);
+	  vfplot_context_cache(ctx, cache);
+	}
+
       switch (opt->place)
 	{
 	case place_hedgehog:
-	  err = vfplot_hedgehog(dom, fv, fc, field,
-				&(opt->v),
-				&nA, &A);
+	  err = (ctx ?
+		 vfplot_hedgehog_r(ctx, dom, &(opt->v), &nA, &A) :
+		 vfplot_hedgehog(dom, fv, fc, field,
+				 &(opt->v),
+				 &nA, &A));
 	  break;
 	case place_adaptive:
-	  err = vfplot_adaptive(dom, fv, fc, field,
-				&(opt->v),
-				&nA, &A,
-				&nN, &N);
+	  {
+	    gstate_t warm = GSTATE_NULL;
+
+	    if (opt->v.place.adaptive.mtfile.file)
+	      {
+		if ((err = field_key(opt, &(opt->v.place.adaptive.mtfile.key))) != ERROR_OK)
+		  {
+		    evcache_destroy(cache);
+		    return err;
+		  }
+	      }
+
+	    if (opt->warm.file)
+	      {
+		if (opt->v.verbose)
+		  printf("warm start from %s\n", opt->warm.file);
+
+		if ((err = gstate_read(opt->warm.file, &warm)) != ERROR_OK)
+		  {
+		    fprintf(stderr, "failed read of %s\n", opt->warm.file);
+		    evcache_destroy(cache);
+		    return err;
+		  }
+
+		opt->v.place.adaptive.warm.n = warm.arrow.n;
+		opt->v.place.adaptive.warm.A = warm.arrow.A;
+	      }
+
+	    /* with a local context halt on SIGINT, as vfplot_adaptive() does */
+
+	    if (ctx == &local) vfplot_context_sigint(ctx);
+
+	    err = (ctx ?
+		   vfplot_adaptive_r(ctx, dom, &(opt->v),
+				     &nA, &A, &nN, &N) :
+		   vfplot_adaptive(dom, fv, fc, field,
+				   &(opt->v),
+				   &nA, &A,
+				   &nN, &N));
+
+	    if (ctx == &local) vfplot_context_sigint_restore();
+
+	    opt->v.place.adaptive.warm.n = 0;
+	    opt->v.place.adaptive.warm.A = NULL;
+
+	    free(warm.arrow.A);
+	    free(warm.nbs.N);
+	  }
 	  break;
 	default:
 	  err = ERROR_BUG;
 	}
+
+      if (cache)
+	{
+	  if (opt->v.verbose)
+	    {
+	      size_t hit, miss;
+
+	      evcache_stats(cache, &hit, &miss);
+	      printf("evaluation cache %zu hits, %zu misses\n", hit, miss);
+	    }
+
+	  if (ctx == opt->context) vfplot_context_cache(ctx, NULL);
+	  evcache_destroy(cache);
+	}
     }
 
   if (err) return err;
@@ -380,6 +655,65 @@ static int plot_generic(domain_t* dom, vfun_t fv, cfun_t fc, void *field, opt_t
   return err;
 }
 
+/*
+  the key of the field data for the metric tensor cache, a
+  hash of the test field type or of the format and contents
+  of the input files, of the arrow scaling and of the
+  evaluation cache quantum
+*/
+
+static int field_key(const opt_t *opt, uint64_t *key)
+{
+  uint64_t h = MTCACHE_HASH_INIT;
+  double scale = opt->v.arrow.scale;
+
+  h = mtcache_hash(h, &(opt->test), sizeof(opt->test));
+  h = mtcache_hash(h, &scale, sizeof(scale));
+
+  /* a quantised evaluation cache changes the tensors */
+
+  if ((opt->evcache.n > 0) && (opt->evcache.quantum > 0))
+    h = mtcache_hash(h, &(opt->evcache.quantum), sizeof(double));
+
+  if (opt->test == test_none)
+    {
+      h = mtcache_hash(h, &(opt->input.format), sizeof(opt->input.format));
+      h = mtcache_hash(h, &(opt->input.store), sizeof(opt->input.store));
+      h = mtcache_hash(h, &(opt->input.pyramid), sizeof(opt->input.pyramid));
+
+      for (int i = 0 ; i < opt->input.n ; i++)
+	{
+	  const char *file = opt->input.file[i];
+	  char buf[BUFSIZ];
+	  size_t n;
+	  FILE *st;
+
+	  if ((st = fopen(file, "rb")) == NULL)
+	    {
+	      fprintf(stderr, "error opening %s : %s\n", file, strerror(errno));
+	      return ERROR_READ_OPEN;
+	    }
+
+	  while ((n = fread(buf, 1, BUFSIZ, st)) > 0)
+	    h = mtcache_hash(h, buf, n);
+
+	  int err = ferror(st);
+
+	  fclose(st);
+
+	  if (err)
+	    {
+	      fprintf(stderr, "error reading %s\n", file);
+	      return ERROR_READ_OPEN;
+	    }
+	}
+    }
+
+  *key = h;
+
+  return ERROR_OK;
+}
+
 /*
   circular.h
 */
@@ -404,7 +738,12 @@ static int plot_circular(opt_t *opt)
     }
 
   int err =
-    plot_generic(dom, (vfun_t)cf_vector, (cfun_t)cf_curvature, (void*)&cf, opt);
+    plot_generic(dom,
+		 (vfun_t)cf_vector,
+		 (cfun_t)cf_curvature,
+		 NULL,
+		 (jfun_t)cf_jacobian,
+		 (void*)&cf, opt);
 
   domain_destroy(dom);
 
@@ -441,7 +780,7 @@ static int plot_electro2(opt_t *opt)
     }
 
   int err =
-    plot_generic(dom, (vfun_t)ef_vector, NULL, &ef, opt);
+    plot_generic(dom, (vfun_t)ef_vector, NULL, NULL, (jfun_t)ef_jacobian, &ef, opt);
 
   domain_destroy(dom);
 
@@ -475,7 +814,7 @@ static int plot_electro3(opt_t *opt)
       return ERROR_BUG;
     }
 
-  int err = plot_generic(dom, (vfun_t)ef_vector, NULL, &ef, opt);
+  int err = plot_generic(dom, (vfun_t)ef_vector, NULL, NULL, (jfun_t)ef_jacobian, &ef, opt);
 
   domain_destroy(dom);
 
@@ -511,7 +850,7 @@ static int plot_cylinder(opt_t *opt)
     }
 
   int err =
-    plot_generic(dom, (vfun_t)cylf_vector, NULL, &cylf, opt);
+    plot_generic(dom, (vfun_t)cylf_vector, NULL, NULL, (jfun_t)cylf_jacobian, &cylf, opt);
 
   domain_destroy(dom);
 
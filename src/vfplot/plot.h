@@ -10,6 +10,7 @@
 #define PLOT_H
 
 #include <vfplot/vfplot.h>
+#include <vfplot/context.h>
 
 #include "field.h"
 
@@ -41,6 +42,8 @@ typedef struct opt_t
   place_type_t place;
   struct {
     format_t format;
+    bilinear_store_t store;
+    bool pyramid, tiles;
     int n;
     char* file[INPUT_FILES_MAX];
   } input;
@@ -54,9 +57,25 @@ typedef struct opt_t
     state_action_t action;
     char *file;
   } state;
+  struct {
+    char *file;
+  } warm;
+  struct {
+    size_t n;
+    double quantum;
+  } evcache;
   vfp_opt_t v;
+  vfp_context_t *context;
 } opt_t;
 
+/*
+  if the context is non-NULL then the plot is made with
+  the reentrant libvfplot constructors using it, so that
+  several plots can be made concurrently (see batch.c)
+*/
+
 extern int plot(opt_t*);
+extern int plot_field(opt_t*, field_t*);
+extern const char* plot_strerror(int);
 
 #endif